@@ -2,35 +2,93 @@
 #define Difference_HPP
 
 #include <cmath>
+#include <typeinfo>
+#include <vector>
+
+/** The sum of the squared differences of the channels c < TNumberOfChannels of two pixels for which bit c of TChannelMask
+ *  is set, each multiplied by weights[c] if TWeighted. Channel c of a pixel is at pixel[c * channelStride] (1 for an
+ *  interleaved image buffer, the number of pixels for channel planes). With the channels known at compile time the loop
+ *  is unrolled and the unused channels drop out. */
+template <unsigned int TNumberOfChannels, unsigned int TChannelMask, bool TWeighted>
+struct DifferenceKernel
+{
+  static const unsigned int NumberOfChannels = TNumberOfChannels;
+  static const unsigned int ChannelMask = TChannelMask;
+  static const bool Weighted = TWeighted;
+
+  static float Compute(const float* const a, const float* const b, const float* const weights,
+                       const unsigned int channelStride)
+  {
+    float sum = 0.0f;
+    for(unsigned int component = 0; component < TNumberOfChannels; ++component)
+      {
+      if(TChannelMask & (1u << component))
+        {
+        float difference = a[component * channelStride] - b[component * channelStride];
+        sum += (TWeighted ? weights[component] : 1.0f) * difference * difference;
+        }
+      }
+    return sum;
+  }
+};
 
 class Difference
 {
 public:
   typedef itk::VariableLengthVector<float> VectorType;
-  virtual float ComputeDifference(const VectorType& a,  const VectorType& b) = 0;
+
+  /** The color and depth channels the differences can be computed over (the validity channel is never used) */
+  static const unsigned int NumberOfChannels = 4;
+
+  virtual ~Difference() {}
+
+  float ComputeDifference(const VectorType& a,  const VectorType& b)
+  {
+    float sum = 0.0f;
+    const float* const weights = GetWeights();
+    for(unsigned int component = 0; component < NumberOfChannels; ++component)
+      {
+      if(GetChannelMask() & (1u << component))
+        {
+        float difference = a[component] - b[component];
+        sum += (weights ? weights[component] : 1.0f) * difference * difference;
+        }
+      }
+    return sum;
+  }
+
+  /** The channels the difference is computed over (bit c for channel c). Together with GetWeights, this selects the
+   *  DifferenceKernel which is used for a whole image. */
+  virtual unsigned int GetChannelMask() const = 0;
+
+  /** The weight of each of the NumberOfChannels channels, or NULL if they are not weighted */
+  virtual const float* GetWeights() const
+  {
+    return NULL;
+  }
+
+  /** Two difference functions are equal if they are of the same type and have the same parameters. */
+  virtual bool IsEqual(const Difference* const other) const
+  {
+    return typeid(*this) == typeid(*other);
+  }
 };
 
 class DepthDifference : public Difference
 {
   public:
-  float ComputeDifference(const VectorType& a, const VectorType& b)
+  unsigned int GetChannelMask() const
   {
-    //std::cout << "Difference between " << a << " and " << b << std::endl;
-    return pow(a[3] - b[3], 2);
+    return 1u << 3;
   }
 };
 
 class ColorDifference : public Difference
 {
   public:
-  float ComputeDifference(const VectorType& a, const VectorType& b)
+  unsigned int GetChannelMask() const
   {
-    float sum = 0.0f;
-    for(unsigned int component = 0; component < 3; ++component)
-      {
-      sum += pow(a[component] - b[component], 2);
-      }
-    return sum;
+    return (1u << 0) | (1u << 1) | (1u << 2);
   }
 };
 
@@ -39,18 +97,26 @@ class WeightedDifference : public Difference
   public:
   std::vector<float> Weights;
   
+  /** The weights of the R, G, B and depth channels (missing weights are 0) */
   WeightedDifference(const std::vector<float>& weights) : Weights(weights)
   {
+    this->Weights.resize(NumberOfChannels, 0.0f);
+  }
+
+  bool IsEqual(const Difference* const other) const
+  {
+    return Difference::IsEqual(other) &&
+           static_cast<const WeightedDifference*>(other)->Weights == this->Weights;
   }
   
-  float ComputeDifference(const VectorType& a, const VectorType& b)
+  unsigned int GetChannelMask() const
   {
-    float sum = 0.0f;
-    for(unsigned int component = 0; component < a.GetSize(); ++component)
-      {
-      sum += Weights[component] * pow(a[component] - b[component], 2);
-      }
-    return sum;
+    return (1u << NumberOfChannels) - 1;
+  }
+
+  const float* GetWeights() const
+  {
+    return &this->Weights[0];
   }
 };
 
@@ -0,0 +1,167 @@
+/*
+Copyright (C) 2010 David Doria, daviddoria@gmail.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FlatHistogram.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FLATHISTOGRAM_X86
+#include <immintrin.h>
+#endif
+
+/** Append the bins of one channel of 'count' pixels to their bins so far: bin = bin * numberOfBinsPerChannel +
+ *  channelBin, with channelBin computed and clamped as in HistogramBinning::ComputeBin */
+typedef void (*AppendChannelBinsFunction)(const float* const channel, const float minimum, const float scale,
+                                          const float lastBin, const unsigned int numberOfBinsPerChannel,
+                                          const unsigned int count, unsigned int* const bins);
+
+static void AppendChannelBinsScalar(const float* const channel, const float minimum, const float scale,
+                                    const float lastBin, const unsigned int numberOfBinsPerChannel,
+                                    const unsigned int count, unsigned int* const bins)
+{
+  for(unsigned int i = 0; i < count; ++i)
+    {
+    float channelBin = (channel[i] - minimum) * scale;
+    channelBin = channelBin < lastBin ? channelBin : lastBin;
+    channelBin = channelBin > 0.0f ? channelBin : 0.0f;
+    bins[i] = bins[i] * numberOfBinsPerChannel + static_cast<unsigned int>(channelBin);
+    }
+}
+
+#ifdef FLATHISTOGRAM_X86
+__attribute__((target("avx2"))) static void AppendChannelBinsAVX2(const float* const channel, const float minimum,
+                                                                  const float scale, const float lastBin,
+                                                                  const unsigned int numberOfBinsPerChannel,
+                                                                  const unsigned int count, unsigned int* const bins)
+{
+  unsigned int i = 0;
+  for(; i + 8 <= count; i += 8)
+    {
+    __m256 channelBin = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(channel + i), _mm256_set1_ps(minimum)),
+                                      _mm256_set1_ps(scale));
+    // min_ps returns its second operand if one is NaN, so NaNs go to the last bin like in ComputeBin
+    channelBin = _mm256_max_ps(_mm256_min_ps(channelBin, _mm256_set1_ps(lastBin)), _mm256_setzero_ps());
+
+    // The channel bin is less than 2^31, so the signed conversion is exact
+    __m256i* const binsI = reinterpret_cast<__m256i*>(bins + i);
+    __m256i bin = _mm256_mullo_epi32(_mm256_loadu_si256(binsI), _mm256_set1_epi32(numberOfBinsPerChannel));
+    _mm256_storeu_si256(binsI, _mm256_add_epi32(bin, _mm256_cvttps_epi32(channelBin)));
+    }
+
+  AppendChannelBinsScalar(channel + i, minimum, scale, lastBin, numberOfBinsPerChannel, count - i, bins + i);
+}
+#endif
+
+static AppendChannelBinsFunction GetAppendChannelBinsFunction()
+{
+#ifdef FLATHISTOGRAM_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2"))
+    {
+    return &AppendChannelBinsAVX2;
+    }
+#endif
+  return &AppendChannelBinsScalar;
+}
+
+HistogramBinning::HistogramBinning()
+{
+  this->NumberOfBinsPerChannel = 1;
+  this->NumberOfBins = 1;
+  this->LastBin = 0.0f;
+}
+
+void HistogramBinning::Initialize(const std::vector<unsigned int>& channels, const unsigned int numberOfBinsPerChannel,
+                                  const std::vector<float>& minimum, const std::vector<float>& maximum)
+{
+  if(numberOfBinsPerChannel == 0)
+    {
+    throw std::runtime_error("HistogramBinning::Initialize: there must be at least one bin per channel");
+    }
+
+  this->Channels = channels;
+  this->NumberOfBinsPerChannel = numberOfBinsPerChannel;
+  this->LastBin = static_cast<float>(numberOfBinsPerChannel - 1);
+
+  double numberOfBins = 1.0;
+  this->Minimum.resize(channels.size());
+  this->Scale.resize(channels.size());
+  for(unsigned int i = 0; i < channels.size(); ++i)
+    {
+    float range = maximum[channels[i]] - minimum[channels[i]];
+    this->Minimum[i] = minimum[channels[i]];
+    this->Scale[i] = range > 0 ? numberOfBinsPerChannel / range : 0.0f;
+    numberOfBins *= numberOfBinsPerChannel;
+    }
+
+  if(numberOfBins > std::numeric_limits<unsigned int>::max())
+    {
+    throw std::runtime_error("HistogramBinning::Initialize: too many bins");
+    }
+  this->NumberOfBins = static_cast<unsigned int>(numberOfBins);
+}
+
+void HistogramBinning::ComputeBins(const float* const pixels, const unsigned int channelStride,
+                                   const unsigned int count, unsigned int* const bins) const
+{
+  static const AppendChannelBinsFunction appendChannelBins = GetAppendChannelBinsFunction();
+
+  // One channel at a time, so that the pixels are consecutive
+  std::fill(bins, bins + count, 0u);
+  for(unsigned int i = 0; i < this->Channels.size(); ++i)
+    {
+    appendChannelBins(pixels + this->Channels[i] * channelStride, this->Minimum[i], this->Scale[i], this->LastBin,
+                      this->NumberOfBinsPerChannel, count, bins);
+    }
+}
+
+bool HistogramBinning::IsEqual(const HistogramBinning& other) const
+{
+  return this->Channels == other.Channels && this->NumberOfBinsPerChannel == other.NumberOfBinsPerChannel &&
+         this->Minimum == other.Minimum && this->Scale == other.Scale;
+}
+
+void FlatHistogram::Initialize(const unsigned int numberOfBins)
+{
+  this->Counts.assign(numberOfBins, 0);
+  this->TotalCount = 0;
+  this->ChangedBins.clear();
+  this->NegativeLogCounts.assign(numberOfBins, std::numeric_limits<float>::infinity());
+  this->LogTotalCount = std::numeric_limits<float>::infinity();
+  this->MaximumNegativeLogLikelihood = 0.0f;
+}
+
+void FlatHistogram::ComputeNegativeLogLikelihoods(const float minimumProbability)
+{
+  for(unsigned int i = 0; i < this->ChangedBins.size(); ++i)
+    {
+    const unsigned int bin = this->ChangedBins[i];
+    this->NegativeLogCounts[bin] = this->Counts[bin] > 0 ? -log(static_cast<float>(this->Counts[bin])) :
+                                                           std::numeric_limits<float>::infinity();
+    }
+  this->ChangedBins.clear();
+
+  // GetNegativeLogLikelihood caps the bins whose probability is at most minimumProbability
+  this->LogTotalCount = this->TotalCount > 0 ? log(static_cast<float>(this->TotalCount)) :
+                                               std::numeric_limits<float>::infinity();
+  this->MaximumNegativeLogLikelihood = -log(minimumProbability);
+}
@@ -0,0 +1,136 @@
+/*
+Copyright (C) 2010 David Doria, daviddoria@gmail.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Histograms for the t-weights. HistogramBinning maps a pixel to a single bin index: each of the used channels is
+ * divided into the same number of equal bins between the minimum and the maximum of the channel (the maximum itself
+ * is in the last bin). FlatHistogram counts the pixels of each bin in a flat array and keeps a table of -log(count),
+ * so that looking up a pixel is one table load and adding or removing pixels only updates the bins they are in. The bins of a whole image are computed
+ * once (ComputeBins) and shared by the histograms and the t-weights.
+*/
+
+#ifndef FlatHistogram_H
+#define FlatHistogram_H
+
+// STL
+#include <algorithm>
+#include <vector>
+
+class HistogramBinning
+{
+public:
+  HistogramBinning();
+
+  /** Use 'numberOfBinsPerChannel' bins for each of the 'channels' of the pixels. The minimum and maximum are
+   *  indexed by channel (like the pixels). */
+  void Initialize(const std::vector<unsigned int>& channels, const unsigned int numberOfBinsPerChannel,
+                  const std::vector<float>& minimum, const std::vector<float>& maximum);
+
+  /** The number of bins of a histogram with this binning */
+  unsigned int GetNumberOfBins() const
+  {
+    return this->NumberOfBins;
+  }
+
+  /** Get the bin of a pixel. Channel c of the pixel is at pixel[c * channelStride]. */
+  unsigned int ComputeBin(const float* const pixel, const unsigned int channelStride) const
+  {
+    unsigned int bin = 0;
+    for(unsigned int i = 0; i < this->Channels.size(); ++i)
+      {
+      // Values outside of the range go to the nearest end (NaNs to the last bin)
+      float channelBin = (pixel[this->Channels[i] * channelStride] - this->Minimum[i]) * this->Scale[i];
+      channelBin = channelBin < this->LastBin ? channelBin : this->LastBin;
+      channelBin = channelBin > 0.0f ? channelBin : 0.0f;
+      bin = bin * this->NumberOfBinsPerChannel + static_cast<unsigned int>(channelBin);
+      }
+    return bin;
+  }
+
+  /** Get the bins of 'count' consecutive pixels (as ComputeBin), using AVX2 if the CPU supports it */
+  void ComputeBins(const float* const pixels, const unsigned int channelStride, const unsigned int count,
+                   unsigned int* const bins) const;
+
+  /** Whether 'other' maps every pixel to the same bin */
+  bool IsEqual(const HistogramBinning& other) const;
+
+private:
+  std::vector<unsigned int> Channels;
+  unsigned int NumberOfBinsPerChannel;
+  unsigned int NumberOfBins;
+
+  /** The minimum and the bins per unit of every used channel */
+  std::vector<float> Minimum;
+  std::vector<float> Scale;
+
+  /** NumberOfBinsPerChannel - 1 */
+  float LastBin;
+};
+
+class FlatHistogram
+{
+public:
+  /** Make an empty histogram of 'numberOfBins' bins */
+  void Initialize(const unsigned int numberOfBins);
+
+  /** Count a pixel in 'bin' */
+  void AddSample(const unsigned int bin)
+  {
+    this->Counts[bin]++;
+    this->TotalCount++;
+    this->ChangedBins.push_back(bin);
+  }
+
+  /** Remove a pixel which was counted in 'bin' */
+  void RemoveSample(const unsigned int bin)
+  {
+    this->Counts[bin]--;
+    this->TotalCount--;
+    this->ChangedBins.push_back(bin);
+  }
+
+  unsigned int GetTotalCount() const
+  {
+    return this->TotalCount;
+  }
+
+  /** Update the -log(count / total count) of the bins after samples were added or removed. Empty bins (and all bins
+   *  if the histogram is empty) get -log(minimumProbability). Only the bins whose counts changed since the last call
+   *  are recomputed (the total count is applied in GetNegativeLogLikelihood). */
+  void ComputeNegativeLogLikelihoods(const float minimumProbability);
+
+  /** Get -log of the probability of a bin (only valid after ComputeNegativeLogLikelihoods) */
+  float GetNegativeLogLikelihood(const unsigned int bin) const
+  {
+    return std::min(this->NegativeLogCounts[bin] + this->LogTotalCount, this->MaximumNegativeLogLikelihood);
+  }
+
+private:
+  std::vector<unsigned int> Counts;
+  unsigned int TotalCount;
+
+  /** The bins whose counts changed since the last ComputeNegativeLogLikelihoods (possibly several times) */
+  std::vector<unsigned int> ChangedBins;
+
+  /** -log(count) of every bin (infinity if it is empty), log(TotalCount) (infinity if it is 0) and
+   *  -log(minimumProbability) */
+  std::vector<float> NegativeLogCounts;
+  float LogTotalCount;
+  float MaximumNegativeLogLikelihood;
+};
+
+#endif
@@ -25,14 +25,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "itkBilateralImageFilter.h"
 #include "itkBinaryBallStructuringElement.h"
 #include "itkBinaryDilateImageFilter.h"
-#include "itkConnectedComponentImageFilter.h"
 #include "itkGradientMagnitudeImageFilter.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
 #include "itkImageRegionIterator.h"
-#include "itkLabelShapeKeepNObjectsImageFilter.h"
+#include "itkImageRegionIteratorWithIndex.h"
 #include "itkMaskImageFilter.h"
 #include "itkMaximumImageFilter.h"
 #include "itkMinimumMaximumImageCalculator.h"
-#include "itkRescaleIntensityImageFilter.h"
 #include "itkShapedNeighborhoodIterator.h"
 #include "itkVectorGradientMagnitudeImageFilter.h"
 #include "itkVectorIndexSelectionCastImageFilter.h"
@@ -41,7 +40,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // STL
 #include <algorithm>
 #include <cmath>
+#include <cstdlib>
+#include <functional> // for greater<>
 #include <iostream>
+#include <limits>
 #include <vector>
 #include <stdexcept>
 #include <numeric> // for accumulate()
@@ -58,19 +60,105 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <vtkXMLPolyDataWriter.h>
 
 // Qt
+#include <QFuture>
 #include <QMessageBox>
+#include <QThread>
+#include <QtConcurrentRun>
 
 // Submodules
 #include "Helpers/Helpers.h"
 
+// Max-flow
+#include "graph.h"
+
+// Since the t-weight function takes the log of the histogram value,
+// we must handle bins with frequency = 0 specially (because log(0) = -inf)
+// For empty histogram bins we use TinyHistogramValue instead of 0.
+static const float TinyHistogramValue = 1e-10;
+
+// The node id of the pixels which are not nodes of the graph
+static const MaxFlowBackend::NodeId NoNode = std::numeric_limits<MaxFlowBackend::NodeId>::max();
+
+// Split 'numberOfRows' rows into about 4 blocks per core (every block has at least one row) and return the first row
+// of every block and the end of the last block
+static std::vector<int> SplitRows(const int numberOfRows)
+{
+  int numberOfBlocks = std::max(1, std::min(numberOfRows, 4 * QThread::idealThreadCount()));
+  std::vector<int> rowBlocks(numberOfBlocks + 1);
+  for(int block = 0; block <= numberOfBlocks; ++block)
+    {
+    rowBlocks[block] = static_cast<int>(static_cast<int64_t>(block) * numberOfRows / numberOfBlocks);
+    }
+  return rowBlocks;
+}
+
+// Find the root of a pixel in a union-find in which every pixel is linked to a smaller pixel id (halving the path)
+static unsigned int FindComponentRoot(std::vector<unsigned int>& parents, unsigned int pixelId)
+{
+  while(parents[pixelId] != pixelId)
+    {
+    parents[pixelId] = parents[parents[pixelId]];
+    pixelId = parents[pixelId];
+    }
+  return pixelId;
+}
+
+// Join the components of two pixels, keeping the smaller root. Returns the root of the joined component.
+static unsigned int UniteComponents(std::vector<unsigned int>& parents, const unsigned int pixelA,
+                                   const unsigned int pixelB)
+{
+  unsigned int rootA = FindComponentRoot(parents, pixelA);
+  unsigned int rootB = FindComponentRoot(parents, pixelB);
+  if(rootA < rootB)
+    {
+    parents[rootB] = rootA;
+    return rootA;
+    }
+  parents[rootA] = rootB;
+  return rootB;
+}
+
 ImageGraphCut::ImageGraphCut()
 {
   this->DifferenceFunction = NULL;
 
+  this->Graph = NULL;
+  this->GraphMemory = NULL;
+  this->UseHugePages = false;
+  this->GraphHasIntegerCapacities = false;
+  this->GraphHasPixelEdges = false;
+  this->GridGraph = NULL;
+  this->MaxFlowBackendName = "BK";
+  this->UseGridGraph = false;
+  this->PersistentGraph = false;
+  this->UseIntegerCapacities = false;
+  this->UseParallelMaxFlow = false;
+  this->CapacityScale = 1.0f;
+  this->UseSuperpixels = false;
+  this->SuperpixelSize = 100;
+  this->SuperpixelRefinementRadius = 0;
+  this->UseCoarseToFine = false;
+  this->CoarseToFineFactor = 4;
+  this->KeepSourceSeedComponents = false;
+  this->ContractHardSeeds = true;
+  this->DropInvalidPixels = true;
+  this->SolveComponentsSeparately = false;
+  this->UsePersistencyReduction = false;
+  this->InitialSegmentationBandRadius = 8;
+  this->NumberOfPixelGroups = 0;
+  this->PixelGroupLabelsSize = 0;
+  this->PixelGroupLabelsAreBlocks = false;
+  this->MaxPixelsPerNode = 1;
+
+  this->MaxNWeightSum = 0.0f;
+  this->HardTWeight = std::numeric_limits<float>::max();
+
   this->Debug = false;
   
   this->IncludeDepthInHistogram = false;
   this->NumberOfHistogramComponents = 0;
+  this->SparseHistogramThreshold = 1 << 20;
+  this->UseSparseHistograms = false;
   
   // Debug
   this->DebugGraphPolyData = vtkSmartPointer<vtkPolyData>::New();
@@ -100,6 +188,75 @@ ImageGraphCut::ImageGraphCut()
   
 }
 
+ImageGraphCut::~ImageGraphCut()
+{
+  DeleteGraph();
+  DeleteGraphMemory();
+  delete this->DifferenceFunction;
+}
+
+void ImageGraphCut::SetDifferenceFunction(Difference* const difference)
+{
+  if(this->DifferenceFunction && difference && !this->DifferenceFunction->IsEqual(difference))
+    {
+    // The cached N-weights are no longer valid. The edges of a persistent pixel graph which can be updated are changed
+    // to the new N-weights by the next cut (see UpdateGraphNWeights), so the N-weights it was built with are kept.
+    if(this->Graph && this->GraphHasPixelEdges && this->Graph->SupportsEdgeUpdates() &&
+       (!this->GraphNWeights.empty() || !this->NWeights.empty()))
+      {
+      if(this->GraphNWeights.empty())
+        {
+        this->GraphNWeights.swap(this->NWeights);
+        }
+      }
+    else
+      {
+      DeleteGraph();
+      }
+    std::vector<float>().swap(this->NWeights);
+    }
+
+  delete this->DifferenceFunction;
+  this->DifferenceFunction = difference;
+}
+
+void ImageGraphCut::DeleteGraph()
+{
+  delete this->Graph;
+  this->Graph = NULL;
+  this->GraphHasPixelEdges = false;
+  std::vector<float>().swap(this->GraphNWeights);
+
+  delete this->GridGraph;
+  this->GridGraph = NULL;
+}
+
+GraphArena* ImageGraphCut::GetGraphMemory()
+{
+  if(this->GraphMemory && this->GraphMemory->get_huge_pages() != this->UseHugePages)
+    {
+    delete this->GraphMemory;
+    this->GraphMemory = NULL;
+    }
+  if(!this->GraphMemory)
+    {
+    this->GraphMemory = new GraphArena(this->UseHugePages);
+    }
+  return this->GraphMemory;
+}
+
+void ImageGraphCut::DeleteGraphMemory()
+{
+  delete this->GraphMemory;
+  this->GraphMemory = NULL;
+
+  for(unsigned int i = 0; i < this->ComponentGraphMemory.size(); ++i)
+    {
+    delete this->ComponentGraphMemory[i];
+    }
+  this->ComponentGraphMemory.clear();
+}
+
 void ImageGraphCut::CreateDebugPolyData()
 {
   this->DebugGraphPointIds->SetRegions(this->Image->GetLargestPossibleRegion());
@@ -129,11 +286,43 @@ ImageType::Pointer ImageGraphCut::GetImage()
   return this->Image;
 }
 
+const ImageStatistics& ImageGraphCut::GetImageStatistics() const
+{
+  return this->Statistics;
+}
+
 void ImageGraphCut::SetImage(const ImageType* const image)
 {
+  // A persistent graph (and its memory), the pixel groups, the N-weights, the bin image and the initial segmentation
+  // belong to the previous image
+  DeleteGraph();
+  this->PixelGroupLabels = NULL;
+  std::vector<float>().swap(this->NWeights);
+  std::vector<unsigned int>().swap(this->BinImage);
+  std::vector<Mask::PixelType>().swap(this->InitialSegmentation);
+  DeleteGraphMemory();
+
   this->Image = ImageType::New();
   ITKHelpers::DeepCopy(image, this->Image.GetPointer());
 
+  // Store the channels as planes for the N-weight kernels and the bin image
+  const unsigned int numberOfPixels = this->Image->GetLargestPossibleRegion().GetNumberOfPixels();
+  const unsigned int numberOfComponents = this->Image->GetNumberOfComponentsPerPixel();
+  const float* const buffer = this->Image->GetBufferPointer();
+  this->ImageChannelPlanes.resize(numberOfComponents * numberOfPixels);
+  for(unsigned int component = 0; component < numberOfComponents; ++component)
+    {
+    float* const plane = &this->ImageChannelPlanes[component * numberOfPixels];
+    for(unsigned int pixelId = 0; pixelId < numberOfPixels; ++pixelId)
+      {
+      plane[pixelId] = buffer[pixelId * numberOfComponents + component];
+      }
+    }
+
+  // The channel ranges of the histograms (and the other statistics) only change with the image
+  const itk::Size<2> size = this->Image->GetLargestPossibleRegion().GetSize();
+  this->Statistics.Compute(&this->ImageChannelPlanes[0], numberOfComponents, size[0], size[1]);
+
   // Setup the output (mask) image
   //this->SegmentMask = GrayscaleImageType::New();
   this->SegmentMask = Mask::New();
@@ -145,14 +334,18 @@ void ImageGraphCut::SetImage(const ImageType* const image)
   this->NodeImage->SetRegions(this->Image->GetLargestPossibleRegion());
   this->NodeImage->Allocate();
 
+  // Setup the image of the lambda breakpoints (see PerformLambdaSweep)
+  this->LambdaBreakpointImage = FloatScalarImageType::New();
+  this->LambdaBreakpointImage->SetRegions(this->Image->GetLargestPossibleRegion());
+  this->LambdaBreakpointImage->Allocate();
+  this->LambdaBreakpointImage->FillBuffer(std::numeric_limits<float>::infinity());
+  this->NumberOfUnnestedPixels = 0;
+  this->SweptLambdas.clear();
+  this->SweptSegmentations.clear();
+
   // Default paramters
   this->Lambda = 0.01;
   this->NumberOfHistogramBins = 10; // This value is never used - it is set from the slider
-
-  // Initializations
-  this->ForegroundHistogram = NULL;
-  this->BackgroundHistogram = NULL;
-
 }
 
 ImageType::Pointer ImageGraphCut::GetMaskedOutput()
@@ -178,7 +371,7 @@ ImageType::Pointer ImageGraphCut::GetMaskedOutput()
   return maskFilter->GetOutput();
 }
 
-void ImageGraphCut::CutGraph()
+void ImageGraphCut::CutGraph(const bool reuseTrees)
 {
   if(this->Debug)
     {
@@ -186,242 +379,1748 @@ void ImageGraphCut::CutGraph()
     }
   
   // Compute max-flow
-  this->Graph->maxflow();
+  if(this->UseGridGraph)
+    {
+    if(this->UseParallelMaxFlow)
+      {
+      ParallelGridMaxFlow();
+      }
+    else
+      {
+      this->GridGraph->maxflow();
+      }
+    }
+  else
+    {
+    this->Graph->ComputeMaxFlow(reuseTrees);
+    }
+
+  // Read the segment of every pixel straight into the mask
+  const itk::Size<2> size = this->Image->GetLargestPossibleRegion().GetSize();
+  const NodeImageType::PixelType* const nodes = this->NodeImage->GetBufferPointer();
+  Mask::PixelType* const segment = this->SegmentMask->GetBufferPointer();
+  for(unsigned int y = 0, pixelId = 0; y < size[1]; ++y)
+    {
+    for(unsigned int x = 0; x < size[0]; ++x, ++pixelId)
+      {
+      bool isSource;
+      if(this->UseGridGraph)
+        {
+        isSource = this->GridGraph->what_segment(this->GridGraph->node(x, y)) == GridGraphType::SOURCE;
+        }
+      else if(nodes[pixelId] == NoNode)
+        {
+        isSource = this->FixedPixels[pixelId] == FixedSourcePixel;
+        }
+      else
+        {
+        isSource = this->Graph->GetSegment(nodes[pixelId]) == MaxFlowBackend::SOURCE;
+        }
+      segment[pixelId] = isSource ? 255 : 0;
+      }
+    }
+
+  FilterSegmentComponents();
+}
 
-  // Setup the values of the output (mask) image
-  //GrayscalePixelType sinkPixel;
-  //sinkPixel[0] = 0;
-  Mask::PixelType sinkPixel = 0;
+void ImageGraphCut::FilterSegmentComponents()
+{
+  const itk::Size<2> size = this->Image->GetLargestPossibleRegion().GetSize();
+  const unsigned int width = size[0];
+  const unsigned int numberOfPixels = size[0] * size[1];
+  const Mask::PixelType* const segment = this->SegmentMask->GetBufferPointer();
+  this->ComponentParents.resize(numberOfPixels);
+
+  // Find the components within blocks of rows on all cores...
+  std::vector<int> rowBlocks = SplitRows(size[1]);
+  std::vector<QFuture<void> > futures;
+  for(unsigned int block = 0; block + 1 < rowBlocks.size(); ++block)
+    {
+    futures.push_back(QtConcurrent::run(this, &ImageGraphCut::LinkComponentRows,
+                                        rowBlocks[block], rowBlocks[block + 1]));
+    }
+  for(unsigned int i = 0; i < futures.size(); ++i)
+    {
+    futures[i].waitForFinished();
+    }
 
-  //GrayscalePixelType sourcePixel;
-  //sourcePixel[0] = 255;
-  Mask::PixelType sourcePixel = 255;
+  // ...and join them across the block boundaries
+  for(unsigned int block = 1; block + 1 < rowBlocks.size(); ++block)
+    {
+    const unsigned int firstPixel = rowBlocks[block] * width;
+    for(unsigned int pixelId = firstPixel; pixelId < firstPixel + width; ++pixelId)
+      {
+      if(segment[pixelId] && segment[pixelId - width])
+        {
+        UniteComponents(this->ComponentParents, pixelId, pixelId - width);
+        }
+      }
+    }
 
-  // Iterate over the node image, querying the Kolmorogov graph object for the association of each pixel
-  // and storing them as the output mask
-  itk::ImageRegionConstIterator<NodeImageType> nodeImageIterator(this->NodeImage,
-                                                                 this->NodeImage->GetLargestPossibleRegion());
-  nodeImageIterator.GoToBegin();
+  // Every pixel is linked to a smaller pixel id, so in raster order the parent of a pixel already points to its root
+  std::vector<unsigned int> componentSizes(numberOfPixels, 0);
+  for(unsigned int pixelId = 0; pixelId < numberOfPixels; ++pixelId)
+    {
+    if(segment[pixelId])
+      {
+      this->ComponentParents[pixelId] = this->ComponentParents[this->ComponentParents[pixelId]];
+      componentSizes[this->ComponentParents[pixelId]]++;
+      }
+    }
 
-  while(!nodeImageIterator.IsAtEnd())
+  this->IsKeptComponent.assign(numberOfPixels, 0);
+  if(this->KeepSourceSeedComponents)
     {
-    if(this->Graph->what_segment(nodeImageIterator.Get()) == GraphType::SOURCE)
+    for(unsigned int i = 0; i < this->Sources.size(); ++i)
       {
-      this->SegmentMask->SetPixel(nodeImageIterator.GetIndex(), sourcePixel);
+      unsigned int pixelId = this->Image->ComputeOffset(this->Sources[i]);
+      if(segment[pixelId])
+        {
+        this->IsKeptComponent[this->ComponentParents[pixelId]] = 1;
+        }
       }
-    else if(this->Graph->what_segment(nodeImageIterator.Get()) == GraphType::SINK)
+    }
+  else
+    {
+    // The largest component (the first one if there are several)
+    std::vector<unsigned int>::const_iterator largestComponent =
+        std::max_element(componentSizes.begin(), componentSizes.end());
+    if(largestComponent != componentSizes.end() && *largestComponent > 0)
       {
-      this->SegmentMask->SetPixel(nodeImageIterator.GetIndex(), sinkPixel);
+      this->IsKeptComponent[largestComponent - componentSizes.begin()] = 1;
       }
-    ++nodeImageIterator;
     }
 
-  // Only keep the largest segment
-  typedef itk::ConnectedComponentImageFilter<Mask, Mask> ConnectedComponentImageFilterType;
-  ConnectedComponentImageFilterType::Pointer connectedComponentFilter = ConnectedComponentImageFilterType::New ();
-  connectedComponentFilter->SetInput(SegmentMask);
-  connectedComponentFilter->Update();
+  futures.clear();
+  for(unsigned int block = 0; block + 1 < rowBlocks.size(); ++block)
+    {
+    futures.push_back(QtConcurrent::run(this, &ImageGraphCut::KeepComponentRows,
+                                        rowBlocks[block], rowBlocks[block + 1]));
+    }
+  for(unsigned int i = 0; i < futures.size(); ++i)
+    {
+    futures[i].waitForFinished();
+    }
 
-  //std::cout << "Number of objects: " << connectedComponentFilter->GetObjectCount() << std::endl;
+  std::vector<unsigned int>().swap(this->ComponentParents);
+  std::vector<unsigned char>().swap(this->IsKeptComponent);
+}
 
-  typedef itk::LabelShapeKeepNObjectsImageFilter<Mask> LabelShapeKeepNObjectsImageFilterType;
-  LabelShapeKeepNObjectsImageFilterType::Pointer labelShapeKeepNObjectsImageFilter =
-           LabelShapeKeepNObjectsImageFilterType::New();
-  labelShapeKeepNObjectsImageFilter->SetInput(connectedComponentFilter->GetOutput());
-  labelShapeKeepNObjectsImageFilter->SetBackgroundValue(0);
-  labelShapeKeepNObjectsImageFilter->SetNumberOfObjects(1);
-  labelShapeKeepNObjectsImageFilter
-            ->SetAttribute(LabelShapeKeepNObjectsImageFilterType::LabelObjectType::NUMBER_OF_PIXELS);
-  labelShapeKeepNObjectsImageFilter->Update();
+void ImageGraphCut::LinkComponentRows(const int y0, const int y1)
+{
+  const int width = this->Image->GetLargestPossibleRegion().GetSize()[0];
+  const Mask::PixelType* const segment = this->SegmentMask->GetBufferPointer();
 
-  typedef itk::RescaleIntensityImageFilter<Mask, Mask> RescaleFilterType;
-  RescaleFilterType::Pointer rescaleFilter = RescaleFilterType::New();
-  rescaleFilter->SetOutputMinimum(0);
-  rescaleFilter->SetOutputMaximum(255);
-  rescaleFilter->SetInput(labelShapeKeepNObjectsImageFilter->GetOutput());
-  rescaleFilter->Update();
+  for(int y = y0; y < y1; ++y)
+    {
+    for(int x = 0; x < width; ++x)
+      {
+      const unsigned int pixelId = y * width + x;
+      if(!segment[pixelId])
+        {
+        continue;
+        }
 
-  ITKHelpers::DeepCopy(rescaleFilter->GetOutput(), SegmentMask.GetPointer());
+      // Join the component of the left and the top neighbor (4-connected), if they are in the foreground
+      this->ComponentParents[pixelId] = pixelId;
+      if(x > 0 && segment[pixelId - 1])
+        {
+        this->ComponentParents[pixelId] = FindComponentRoot(this->ComponentParents, pixelId - 1);
+        }
+      if(y > y0 && segment[pixelId - width])
+        {
+        this->ComponentParents[pixelId] = UniteComponents(this->ComponentParents, pixelId, pixelId - width);
+        }
+      }
+    }
 }
 
-void ImageGraphCut::PerformSegmentation()
+void ImageGraphCut::KeepComponentRows(const int y0, const int y1)
 {
-  std::cout << "PerformSegmentation() " << std::endl;
-  // This function performs some initializations and then creates and cuts the graph
+  const int width = this->Image->GetLargestPossibleRegion().GetSize()[0];
+  Mask::PixelType* const segment = this->SegmentMask->GetBufferPointer();
 
-  // Ensure at least one pixel has been specified for both the foreground and background
-  if((this->Sources.size() <= 0) || (this->Sinks.size() <= 0))
+  for(unsigned int pixelId = y0 * width; pixelId < static_cast<unsigned int>(y1 * width); ++pixelId)
     {
-    std::cout << "At least one source (foreground) pixel and one sink (background) pixel must be specified!" << std::endl;
-    return;
+    if(segment[pixelId] && !this->IsKeptComponent[this->ComponentParents[pixelId]])
+      {
+      segment[pixelId] = 0;
+      }
+    }
+}
+
+void ImageGraphCut::RefineSegmentationBand(const unsigned int bandRadius)
+{
+  if(this->Debug)
+    {
+    std::cout << "RefineSegmentationBand()" << std::endl;
     }
 
-  // Blank the NodeImage
-  itk::ImageRegionIterator<NodeImageType> nodeImageIterator(this->NodeImage, this->NodeImage->GetLargestPossibleRegion());
-  nodeImageIterator.GoToBegin();
+  itk::ImageRegion<2> region = this->Image->GetLargestPossibleRegion();
+  const int width = region.GetSize()[0];
+  const int height = region.GetSize()[1];
+  const int radius = bandRadius;
+  Mask::PixelType* segment = this->SegmentMask->GetBufferPointer();
 
-  while(!nodeImageIterator.IsAtEnd())
+  // Find the pixels at the boundary of the segmentation...
+  std::vector<unsigned char> isBoundary(width * height, 0);
+  for(int y = 0; y < height; ++y)
     {
-    nodeImageIterator.Set(NULL);
-    ++nodeImageIterator;
+    for(int x = 0; x < width; ++x)
+      {
+      for(int dy = -1; dy <= 1 && !isBoundary[y * width + x]; ++dy)
+        {
+        for(int dx = -1; dx <= 1; ++dx)
+          {
+          if(x + dx >= 0 && x + dx < width && y + dy >= 0 && y + dy < height &&
+             segment[(y + dy) * width + x + dx] != segment[y * width + x])
+            {
+            isBoundary[y * width + x] = 1;
+            break;
+            }
+          }
+        }
+      }
     }
 
-  // Blank the output image
-  //itk::ImageRegionIterator<GrayscaleImageType> segmentMaskImageIterator(this->SegmentMask,
-  //             this->SegmentMask->GetLargestPossibleRegion());
-  itk::ImageRegionIterator<Mask> segmentMaskImageIterator(this->SegmentMask,
-                                                          this->SegmentMask->GetLargestPossibleRegion());
-  segmentMaskImageIterator.GoToBegin();
+  // ...and widen the boundary to a band of the refinement radius (a square dilation, done separably)
+  std::vector<unsigned char> isInRows(width * height, 0);
+  for(int y = 0; y < height; ++y)
+    {
+    for(int x = 0; x < width; ++x)
+      {
+      if(isBoundary[y * width + x])
+        {
+        for(int bandX = std::max(0, x - radius); bandX <= std::min(width - 1, x + radius); ++bandX)
+          {
+          isInRows[y * width + bandX] = 1;
+          }
+        }
+      }
+    }
+  std::vector<unsigned char> isInBand(width * height, 0);
+  for(int y = 0; y < height; ++y)
+    {
+    for(int x = 0; x < width; ++x)
+      {
+      if(isInRows[y * width + x])
+        {
+        for(int bandY = std::max(0, y - radius); bandY <= std::min(height - 1, y + radius); ++bandY)
+          {
+          isInBand[bandY * width + x] = 1;
+          }
+        }
+      }
+    }
 
-  Mask::PixelType empty = 0;
-  //empty[0] = 0;
+  // Every band pixel is a node
+  std::vector<MaxFlowBackend::NodeId> bandNodes(width * height, 0);
+  MaxFlowBackend::NodeId numberOfBandNodes = 0;
+  for(int pixelId = 0; pixelId < width * height; ++pixelId)
+    {
+    if(isInBand[pixelId])
+      {
+      bandNodes[pixelId] = numberOfBandNodes++;
+      }
+    }
+  if(numberOfBandNodes == 0)
+    {
+    return;
+    }
 
-  while(!segmentMaskImageIterator.IsAtEnd())
+  // The band graph is made after the Graph is deleted, so it can use the same memory
+  MaxFlowBackend* graph = MaxFlowBackend::Create(this->MaxFlowBackendName, this->UseIntegerCapacities,
+                                                 numberOfBandNodes, 4 * numberOfBandNodes, GetGraphMemory());
+  graph->AddNodes(numberOfBandNodes);
+
+  // The band pixels keep their own t-weights. The pixels outside of the band keep their segment, so the N-weight
+  // between a band pixel and an outside pixel is added to the t-weight of the band pixel to the outside pixel's terminal.
+  std::vector<float> sourceWeights(numberOfBandNodes);
+  std::vector<float> sinkWeights(numberOfBandNodes);
+  for(int pixelId = 0; pixelId < width * height; ++pixelId)
     {
-    segmentMaskImageIterator.Set(empty);
-    ++segmentMaskImageIterator;
+    if(isInBand[pixelId])
+      {
+      sourceWeights[bandNodes[pixelId]] = this->SourceTWeights[pixelId];
+      sinkWeights[bandNodes[pixelId]] = this->SinkTWeights[pixelId];
+      }
     }
 
-  if(this->IncludeDepthInHistogram)
+  std::vector<NeighborhoodIteratorType::OffsetType> neighbors;
+  NeighborhoodIteratorType iterator(ITKHelpers::Get1x1Radius(), this->Image, region);
+  ConstructNeighborhoodIterator(&iterator, neighbors);
+
+  // The N-weights were computed for the whole image by CreateNWeights (they are 0 for invalid pixels)
+  for(int pixelId = 0; pixelId < width * height; ++pixelId)
     {
-    this->NumberOfHistogramComponents = 4;
+    const int x = pixelId % width;
+    const int y = pixelId / width;
+
+    for(unsigned int i = 0; i < neighbors.size(); i++)
+      {
+      const int neighborX = x + neighbors[i][0];
+      const int neighborY = y + neighbors[i][1];
+      if(neighborX < 0 || neighborX >= width || neighborY < 0 || neighborY >= height)
+        {
+        continue;
+        }
+
+      int neighborId = neighborY * width + neighborX;
+      float weight = this->NWeights[i * width * height + pixelId];
+      if((!isInBand[pixelId] && !isInBand[neighborId]) || weight == 0)
+        {
+        continue;
+        }
+
+      if(isInBand[pixelId] && isInBand[neighborId])
+        {
+        if(this->UseIntegerCapacities)
+          {
+          int quantizedWeight = QuantizeWeight(weight);
+          graph->AddEdge(bandNodes[pixelId], bandNodes[neighborId], quantizedWeight, quantizedWeight);
+          }
+        else
+          {
+          graph->AddEdge(bandNodes[pixelId], bandNodes[neighborId], weight, weight);
+          }
+        }
+      else
+        {
+        int bandPixelId = isInBand[pixelId] ? pixelId : neighborId;
+        int fixedPixelId = isInBand[pixelId] ? neighborId : pixelId;
+        if(segment[fixedPixelId])
+          {
+          sourceWeights[bandNodes[bandPixelId]] += weight;
+          }
+        else
+          {
+          sinkWeights[bandNodes[bandPixelId]] += weight;
+          }
+        }
+      }
     }
-  else
+
+  for(MaxFlowBackend::NodeId node = 0; node < numberOfBandNodes; ++node)
     {
-    this->NumberOfHistogramComponents = 3;
+    if(this->UseIntegerCapacities)
+      {
+      graph->AddTWeights(node, QuantizeWeight(sourceWeights[node]), QuantizeWeight(sinkWeights[node]));
+      }
+    else
+      {
+      graph->AddTWeights(node, sourceWeights[node], sinkWeights[node]);
+      }
     }
-    
-  if(this->Debug)
+
+  graph->ComputeMaxFlow(false);
+
+  for(int pixelId = 0; pixelId < width * height; ++pixelId)
     {
-    //this->DifferenceFunction->WriteImages();
+    if(isInBand[pixelId])
+      {
+      segment[pixelId] = graph->GetSegment(bandNodes[pixelId]) == MaxFlowBackend::SOURCE ? 255 : 0;
+      }
     }
-  this->CreateGraph();
-  
-  this->CutGraph();
-  
-  delete this->Graph;
+
+  delete graph;
 }
 
-const HistogramType* ImageGraphCut::CreateHistogram(std::vector<itk::Index<2> > pixels, std::vector<unsigned int> channelsToUse)
-//void ImageGraphCut::CreateHistogram(std::vector<itk::Index<2> > pixels, std::vector<unsigned int> channelsToUse, const HistogramType* histogramOutput)
+void ImageGraphCut::ComputePixelWeights()
 {
-  std::cout << "CreateHistogram()" << std::endl;
-  unsigned int numberOfComponents = channelsToUse.size();
+  // The weights of the pixel graph, as CreateGraph computes them. The hard constraint t-weight depends on the
+  // N-weight sums.
+  UpdateNWeights();
+  std::vector<int> rowBlocks = SplitRows(this->Image->GetLargestPossibleRegion().GetSize()[1]);
+  std::vector<QFuture<float> > sums;
+  for(unsigned int block = 0; block + 1 < rowBlocks.size(); ++block)
+    {
+    sums.push_back(QtConcurrent::run(this, &ImageGraphCut::ComputeMaxNWeightSum,
+                                     rowBlocks[block], rowBlocks[block + 1]));
+    }
+  this->MaxNWeightSum = 0.0f;
+  for(unsigned int i = 0; i < sums.size(); ++i)
+    {
+    this->MaxNWeightSum = std::max(this->MaxNWeightSum, sums[i].result());
+    }
 
-  // Typedefs
-  typedef itk::Statistics::ListSample<PixelType> SampleType;
-  typedef itk::Statistics::SampleToHistogramFilter<SampleType, HistogramType> SampleToHistogramFilterType;
+  CreateTWeights();
+  SetHardSinks(this->Sinks);
+  SetHardSources(this->Sources);
+}
 
-  SampleToHistogramFilterType::Pointer histogramFilter = SampleToHistogramFilterType::New();
+void ImageGraphCut::RefineInitialSegmentation()
+{
+  // The seeds are in their segment, so the seeds which the initial segmentation contradicts are on its boundary
+  std::copy(this->InitialSegmentation.begin(), this->InitialSegmentation.end(), this->SegmentMask->GetBufferPointer());
+  for(unsigned int i = 0; i < this->Sources.size(); ++i)
+    {
+    this->SegmentMask->SetPixel(this->Sources[i], 255);
+    }
+  for(unsigned int i = 0; i < this->Sinks.size(); ++i)
+    {
+    this->SegmentMask->SetPixel(this->Sinks[i], 0);
+    }
 
-  SampleType::Pointer sample = SampleType::New();
-  
-  std::vector<float> debugNormalizedPixelValues;
-  
-  // We want the histogram bins to take values from 0 to 1 in all dimensions
-  HistogramType::MeasurementVectorType binMinimum(numberOfComponents);
-  HistogramType::MeasurementVectorType binMaximum(numberOfComponents);
-  for(unsigned int component = 0; component < numberOfComponents; component++)
+  ComputePixelWeights();
+  this->MaxPixelsPerNode = 1;
+  if(this->UseIntegerCapacities)
     {
-    binMinimum[component] = 0;
-    binMaximum[component] = 1;
+    this->CapacityScale = ComputeCapacityScale();
     }
 
-  // Setup the histogram size
-  SampleToHistogramFilterType::HistogramSizeType histogramSize(numberOfComponents);
-  histogramSize.Fill(this->NumberOfHistogramBins);
+  RefineSegmentationBand(std::max(1u, this->InitialSegmentationBandRadius));
+  FilterSegmentComponents();
+}
+
+void ImageGraphCut::SolveComponents()
+{
+  const itk::Size<2> size = this->Image->GetLargestPossibleRegion().GetSize();
+  const unsigned int numberOfPixels = size[0] * size[1];
+  std::vector<int> rowBlocks = SplitRows(size[1]);
+
+  FixPixels();
+  ComputePixelWeights();
+  this->GraphSourceTWeights = this->SourceTWeights;
+  this->GraphSinkTWeights = this->SinkTWeights;
+  AddFixedPixelNWeights(&this->GraphSourceTWeights, &this->GraphSinkTWeights);
 
-  // Create samples and histogram
-  sample->Clear();
-  sample->SetMeasurementVectorSize(numberOfComponents);
-  //std::cout << "Measurement vector size: " << this->ForegroundSample->GetMeasurementVectorSize() << std::endl;
-  //std::cout << "Pixel size: " << this->Image->GetPixel(this->Sources[0]).GetNumberOfElements() << std::endl;
+  if(this->UsePersistencyReduction)
+    {
+    ReducePersistentPixels();
+    }
+  CreatePixelNodeImage();
+  if(this->UseIntegerCapacities)
+    {
+    this->CapacityScale = ComputeCapacityScale();
+    }
 
-  std::vector<ImageType::InternalPixelType> minimumOfChannels =
-          ITKHelpers::ComputeMinOfAllChannels(this->Image.GetPointer());
-  std::vector<ImageType::InternalPixelType> maximumOfChannels =
-          ITKHelpers::ComputeMaxOfAllChannels(this->Image.GetPointer());
+  // Find the components within blocks of rows on all cores and join them across the block boundaries
+  this->ComponentParents.resize(numberOfPixels);
+  for(unsigned int pixelId = 0; pixelId < numberOfPixels; ++pixelId)
+    {
+    this->ComponentParents[pixelId] = pixelId;
+    }
+  std::vector<QFuture<void> > links;
+  for(unsigned int block = 0; block + 1 < rowBlocks.size(); ++block)
+    {
+    links.push_back(QtConcurrent::run(this, &ImageGraphCut::LinkGraphComponentRows, rowBlocks[block],
+                                      rowBlocks[block + 1], rowBlocks[block], rowBlocks[block + 1]));
+    }
+  for(unsigned int i = 0; i < links.size(); ++i)
+    {
+    links[i].waitForFinished();
+    }
+  for(unsigned int block = 1; block + 1 < rowBlocks.size(); ++block)
+    {
+    const int y = rowBlocks[block];
+    LinkGraphComponentRows(y - 1, y + 1, y - 1, y + 1);
+    }
 
-  // Add all of the indicated foreground pixels to the histogram
-  for(unsigned int pixelId = 0; pixelId < pixels.size(); pixelId++) 
+  // Number the components in the order of their first pixels. Every pixel is linked to a smaller pixel id, so in
+  // raster order the root of a pixel is already numbered.
+  MaxFlowBackend::NodeId* const nodes = this->NodeImage->GetBufferPointer();
+  std::vector<unsigned int> pixelComponents(numberOfPixels);
+  std::vector<unsigned int> componentSizes;
+  for(unsigned int pixelId = 0; pixelId < numberOfPixels; ++pixelId)
     {
-    if(!this->Image->GetPixel(pixels[pixelId])[4]) // Don't include invalid pixels in the histogram
+    if(nodes[pixelId] == NoNode)
       {
       continue;
       }
-      
-    itk::VariableLengthVector<float> normalizedPixel;
-    PixelType pixel = this->Image->GetPixel(pixels[pixelId]);
-    normalizedPixel.SetSize(numberOfComponents);
-    for(unsigned int component = 0; component < numberOfComponents; component++)
-      {
-      unsigned int channel = channelsToUse[component];
-      normalizedPixel[component] = (pixel[channel] - minimumOfChannels[channel])/
-                                   (maximumOfChannels[channel] - minimumOfChannels[channel]);
-      if(this->Debug)
-	{
-	std::cout << "Pixel " << pixelId << " (" << pixels[pixelId] << ") channel " << channel << " has value " << pixel[channel] << " and normalized value " << normalizedPixel[component] << std::endl;
-	debugNormalizedPixelValues.push_back(normalizedPixel[component]);
-	}
+    const unsigned int root = FindComponentRoot(this->ComponentParents, pixelId);
+    if(root == pixelId)
+      {
+      pixelComponents[pixelId] = componentSizes.size();
+      componentSizes.push_back(0);
+      }
+    else
+      {
+      pixelComponents[pixelId] = pixelComponents[root];
+      }
+    componentSizes[pixelComponents[pixelId]]++;
+    }
+
+  // Sort the pixels by component. The node of a pixel is its index in its component.
+  this->ComponentFirstPixels.resize(componentSizes.size() + 1);
+  this->ComponentFirstPixels[0] = 0;
+  for(unsigned int component = 0; component < componentSizes.size(); ++component)
+    {
+    this->ComponentFirstPixels[component + 1] = this->ComponentFirstPixels[component] + componentSizes[component];
+    componentSizes[component] = 0;
+    }
+  this->ComponentPixels.resize(this->ComponentFirstPixels.back());
+  for(unsigned int pixelId = 0; pixelId < numberOfPixels; ++pixelId)
+    {
+    if(nodes[pixelId] != NoNode)
+      {
+      const unsigned int component = pixelComponents[pixelId];
+      this->ComponentPixels[this->ComponentFirstPixels[component] + componentSizes[component]] = pixelId;
+      nodes[pixelId] = componentSizes[component]++;
+      }
+    }
+
+  // The fixed pixels are in their segment. If every pixel of a component is cheaper to cut from the same terminal,
+  // putting all of them in the other segment cuts no N-weight and is the minimum cut of the component (on a tie the
+  // solver leaves a pixel in the sink segment). All other components are solved on all cores, the largest first.
+  Mask::PixelType* const segment = this->SegmentMask->GetBufferPointer();
+  for(unsigned int pixelId = 0; pixelId < numberOfPixels; ++pixelId)
+    {
+    if(nodes[pixelId] == NoNode)
+      {
+      segment[pixelId] = this->FixedPixels[pixelId] == FixedSourcePixel ? 255 : 0;
+      }
+    }
+
+  std::vector<std::pair<unsigned int, unsigned int> > solvedComponents;
+  for(unsigned int component = 0; component + 1 < this->ComponentFirstPixels.size(); ++component)
+    {
+    unsigned int numberOfSourcePixels = 0;
+    for(unsigned int i = this->ComponentFirstPixels[component]; i < this->ComponentFirstPixels[component + 1]; ++i)
+      {
+      const unsigned int pixelId = this->ComponentPixels[i];
+      bool isSource;
+      if(this->UseIntegerCapacities)
+        {
+        isSource = QuantizeWeight(this->GraphSourceTWeights[pixelId]) > QuantizeWeight(this->GraphSinkTWeights[pixelId]);
+        }
+      else
+        {
+        isSource = this->GraphSourceTWeights[pixelId] > this->GraphSinkTWeights[pixelId];
+        }
+      segment[pixelId] = isSource ? 255 : 0;
+      numberOfSourcePixels += isSource;
+      }
+
+    if(numberOfSourcePixels > 0 && numberOfSourcePixels < componentSizes[component])
+      {
+      solvedComponents.push_back(std::make_pair(componentSizes[component], component));
+      }
+    }
+  std::sort(solvedComponents.begin(), solvedComponents.end(), std::greater<std::pair<unsigned int, unsigned int> >());
+
+  // Every core solves a list of components with the graphs in a memory of its own, which is kept for the next cut.
+  // Each component goes to the list with the fewest pixels so far.
+  const unsigned int numberOfLists = std::max(1, QThread::idealThreadCount());
+  if(!this->ComponentGraphMemory.empty() && this->ComponentGraphMemory[0]->get_huge_pages() != this->UseHugePages)
+    {
+    DeleteGraphMemory();
+    }
+  while(this->ComponentGraphMemory.size() < numberOfLists)
+    {
+    this->ComponentGraphMemory.push_back(new GraphArena(this->UseHugePages));
+    }
+  std::vector<std::vector<unsigned int> > componentLists(numberOfLists);
+  std::vector<unsigned int> listSizes(numberOfLists, 0);
+  for(unsigned int i = 0; i < solvedComponents.size(); ++i)
+    {
+    const unsigned int list = std::min_element(listSizes.begin(), listSizes.end()) - listSizes.begin();
+    componentLists[list].push_back(solvedComponents[i].second);
+    listSizes[list] += solvedComponents[i].first;
+    }
+
+  std::vector<QFuture<void> > futures;
+  for(unsigned int list = 0; list < numberOfLists; ++list)
+    {
+    if(!componentLists[list].empty())
+      {
+      futures.push_back(QtConcurrent::run(this, &ImageGraphCut::SolveComponentList, componentLists[list],
+                                          this->ComponentGraphMemory[list]));
+      }
+    }
+  for(unsigned int i = 0; i < futures.size(); ++i)
+    {
+    futures[i].waitForFinished();
+    }
+
+  std::cout << "Solved " << solvedComponents.size() << " of " << componentSizes.size() << " components" << std::endl;
+
+  FilterSegmentComponents();
+}
+
+unsigned char ImageGraphCut::GetPersistentLabel(const unsigned int pixelId) const
+{
+  // If the difference of the t-weights is larger than all N-weights to the free neighbors, the pixel is in the segment
+  // of its larger t-weight in every minimum cut, whatever the segments of the neighbors are
+  const float difference = this->GraphSourceTWeights[pixelId] - this->GraphSinkTWeights[pixelId];
+  if(difference > this->FreeNWeightSums[pixelId])
+    {
+    return FixedSourcePixel;
+    }
+  if(-difference > this->FreeNWeightSums[pixelId])
+    {
+    return FixedSinkPixel;
+    }
+  return FreePixel;
+}
+
+std::vector<unsigned int> ImageGraphCut::FindPersistentPixelRows(const int y0, const int y1)
+{
+  const itk::Size<2> size = this->Image->GetLargestPossibleRegion().GetSize();
+  const int width = size[0];
+  const int height = size[1];
+  const unsigned int numberOfPixels = size[0] * size[1];
+  std::vector<NeighborhoodIteratorType::OffsetType> neighbors = GetNeighborOffsets();
+
+  std::vector<unsigned int> persistentPixels;
+  for(int y = y0; y < y1; ++y)
+    {
+    for(int x = 0; x < width; ++x)
+      {
+      const unsigned int pixelId = y * width + x;
+      if(this->FixedPixels[pixelId] != FreePixel)
+        {
+        continue;
+        }
+
+      // The N-weights of the edges to the neighbors after the pixel and from the neighbors before it
+      float nWeightSum = 0.0f;
+      for(unsigned int i = 0; i < neighbors.size(); i++)
+        {
+        for(int side = -1; side <= 1; side += 2)
+          {
+          const int neighborX = x + side * neighbors[i][0];
+          const int neighborY = y + side * neighbors[i][1];
+          if(neighborX < 0 || neighborX >= width || neighborY < 0 || neighborY >= height)
+            {
+            continue;
+            }
+          const unsigned int neighborId = neighborY * width + neighborX;
+          if(this->FixedPixels[neighborId] == FreePixel)
+            {
+            nWeightSum += this->NWeights[i * numberOfPixels + (side > 0 ? pixelId : neighborId)];
+            }
+          }
+        }
+      this->FreeNWeightSums[pixelId] = nWeightSum;
+
+      if(GetPersistentLabel(pixelId) != FreePixel)
+        {
+        persistentPixels.push_back(pixelId);
+        }
+      }
+    }
+  return persistentPixels;
+}
+
+void ImageGraphCut::ReducePersistentPixels()
+{
+  const itk::Size<2> size = this->Image->GetLargestPossibleRegion().GetSize();
+  const int width = size[0];
+  const int height = size[1];
+  const unsigned int numberOfPixels = size[0] * size[1];
+  std::vector<NeighborhoodIteratorType::OffsetType> neighbors = GetNeighborOffsets();
+
+  // The first pass over all pixels is done in blocks of rows on all cores
+  this->FreeNWeightSums.resize(numberOfPixels);
+  std::vector<int> rowBlocks = SplitRows(height);
+  std::vector<QFuture<std::vector<unsigned int> > > futures;
+  for(unsigned int block = 0; block + 1 < rowBlocks.size(); ++block)
+    {
+    futures.push_back(QtConcurrent::run(this, &ImageGraphCut::FindPersistentPixelRows,
+                                        rowBlocks[block], rowBlocks[block + 1]));
+    }
+  std::vector<unsigned int> candidates;
+  for(unsigned int i = 0; i < futures.size(); ++i)
+    {
+    std::vector<unsigned int> blockCandidates = futures[i].result();
+    candidates.insert(candidates.end(), blockCandidates.begin(), blockCandidates.end());
+    }
+
+  // Fixing a pixel moves its N-weights to the t-weights of its free neighbors, which can make them persistent too.
+  // This only makes the other pixels more persistent, so every candidate is still persistent when it is fixed.
+  unsigned int numberOfFixedPixels = 0;
+  while(!candidates.empty())
+    {
+    const unsigned int pixelId = candidates.back();
+    candidates.pop_back();
+    if(this->FixedPixels[pixelId] != FreePixel)
+      {
+      continue;
+      }
+    const unsigned char label = GetPersistentLabel(pixelId);
+    if(label == FreePixel)
+      {
+      continue;
+      }
+
+    this->FixedPixels[pixelId] = label;
+    this->FixedPixelIds.push_back(pixelId);
+    numberOfFixedPixels++;
+
+    std::vector<float>& tWeights = label == FixedSourcePixel ? this->GraphSourceTWeights : this->GraphSinkTWeights;
+    const int x = pixelId % width;
+    const int y = pixelId / width;
+    for(unsigned int i = 0; i < neighbors.size(); i++)
+      {
+      for(int side = -1; side <= 1; side += 2)
+        {
+        const int neighborX = x + side * neighbors[i][0];
+        const int neighborY = y + side * neighbors[i][1];
+        if(neighborX < 0 || neighborX >= width || neighborY < 0 || neighborY >= height)
+          {
+          continue;
+          }
+        const unsigned int neighborId = neighborY * width + neighborX;
+        const float weight = this->NWeights[i * numberOfPixels + (side > 0 ? pixelId : neighborId)];
+        if(this->FixedPixels[neighborId] == FreePixel && weight > 0)
+          {
+          tWeights[neighborId] += weight;
+          this->FreeNWeightSums[neighborId] -= weight;
+          candidates.push_back(neighborId);
+          }
+        }
+      }
+    }
+
+  std::cout << "Fixed " << numberOfFixedPixels << " persistent pixels" << std::endl;
+}
+
+void ImageGraphCut::LinkGraphComponentRows(const int y0, const int y1, const int neighborY0, const int neighborY1)
+{
+  const itk::Size<2> size = this->Image->GetLargestPossibleRegion().GetSize();
+  const int width = size[0];
+  const unsigned int numberOfPixels = size[0] * size[1];
+  const MaxFlowBackend::NodeId* const nodes = this->NodeImage->GetBufferPointer();
+  std::vector<NeighborhoodIteratorType::OffsetType> neighbors = GetNeighborOffsets();
+
+  for(unsigned int i = 0; i < neighbors.size(); i++)
+    {
+    const int dx = neighbors[i][0];
+    const int dy = neighbors[i][1];
+    const float* const plane = &this->NWeights[i * numberOfPixels];
+    for(int y = std::max(y0, neighborY0 - dy); y < std::min(y1, neighborY1 - dy); ++y)
+      {
+      for(int x = std::max(0, -dx); x < std::min(width, width - dx); ++x)
+        {
+        const unsigned int pixelId = y * width + x;
+        const unsigned int neighborId = pixelId + dy * width + dx;
+        if(plane[pixelId] > 0 && nodes[pixelId] != NoNode && nodes[neighborId] != NoNode)
+          {
+          UniteComponents(this->ComponentParents, pixelId, neighborId);
+          }
+        }
+      }
+    }
+}
+
+void ImageGraphCut::SolveComponentList(const std::vector<unsigned int>& components, GraphArena* const memory)
+{
+  for(unsigned int i = 0; i < components.size(); ++i)
+    {
+    SolveComponent(components[i], memory);
+    }
+}
+
+void ImageGraphCut::SolveComponent(const unsigned int component, GraphArena* const memory)
+{
+  const itk::Size<2> size = this->Image->GetLargestPossibleRegion().GetSize();
+  const int width = size[0];
+  const int height = size[1];
+  const unsigned int numberOfPixels = size[0] * size[1];
+  const MaxFlowBackend::NodeId* const nodes = this->NodeImage->GetBufferPointer();
+  std::vector<NeighborhoodIteratorType::OffsetType> neighbors = GetNeighborOffsets();
+
+  const unsigned int* const pixels = &this->ComponentPixels[this->ComponentFirstPixels[component]];
+  const unsigned int numberOfNodes = this->ComponentFirstPixels[component + 1] - this->ComponentFirstPixels[component];
+  MaxFlowBackend* graph = MaxFlowBackend::Create(this->MaxFlowBackendName, this->UseIntegerCapacities,
+                                                 numberOfNodes, 4 * numberOfNodes, memory);
+  graph->AddNodes(numberOfNodes);
+
+  // A free neighbor with a positive N-weight is in the same component
+  for(MaxFlowBackend::NodeId node = 0; node < numberOfNodes; ++node)
+    {
+    const unsigned int pixelId = pixels[node];
+    const int x = pixelId % width;
+    const int y = pixelId / width;
+    for(unsigned int i = 0; i < neighbors.size(); i++)
+      {
+      const int neighborX = x + neighbors[i][0];
+      const int neighborY = y + neighbors[i][1];
+      if(neighborX < 0 || neighborX >= width || neighborY < 0 || neighborY >= height)
+        {
+        continue;
+        }
+      const unsigned int neighborId = neighborY * width + neighborX;
+      const float weight = this->NWeights[i * numberOfPixels + pixelId];
+      if(weight == 0 || nodes[neighborId] == NoNode)
+        {
+        continue;
+        }
+
+      if(this->UseIntegerCapacities)
+        {
+        int quantizedWeight = QuantizeWeight(weight);
+        graph->AddEdge(node, nodes[neighborId], quantizedWeight, quantizedWeight);
+        }
+      else
+        {
+        graph->AddEdge(node, nodes[neighborId], weight, weight);
+        }
+      }
+
+    if(this->UseIntegerCapacities)
+      {
+      graph->AddTWeights(node, QuantizeWeight(this->GraphSourceTWeights[pixelId]),
+                         QuantizeWeight(this->GraphSinkTWeights[pixelId]));
+      }
+    else
+      {
+      graph->AddTWeights(node, this->GraphSourceTWeights[pixelId], this->GraphSinkTWeights[pixelId]);
+      }
+    }
+
+  graph->ComputeMaxFlow(false);
+
+  Mask::PixelType* const segment = this->SegmentMask->GetBufferPointer();
+  for(MaxFlowBackend::NodeId node = 0; node < numberOfNodes; ++node)
+    {
+    segment[pixels[node]] = graph->GetSegment(node) == MaxFlowBackend::SOURCE ? 255 : 0;
+    }
+
+  delete graph;
+}
+
+void ImageGraphCut::PerformSegmentation()
+{
+  std::cout << "PerformSegmentation() " << std::endl;
+  // This function performs some initializations and then creates and cuts the graph
+
+  // Ensure at least one pixel has been specified for both the foreground and background
+  if((this->Sources.size() <= 0) || (this->Sinks.size() <= 0))
+    {
+    std::cout << "At least one source (foreground) pixel and one sink (background) pixel must be specified!" << std::endl;
+    return;
+    }
+
+  // The persistent graph can only be reused if it was built by a backend which can be re-solved, and with the
+  // backend and capacity type which are currently selected. It is deleted whenever the image changes, and when the
+  // difference function changes unless its edges can be updated (see SetDifferenceFunction). The pixels which were
+  // fixed when it was built must still be fixed to the same terminal (new seeds get hard t-weights).
+  // An integer graph can only be reused if its capacity scale still leaves room for the t-weights of the current Lambda.
+  bool reuseGraph = false;
+  if(this->PersistentGraph && !this->UseGridGraph && !UsePixelGroups() && this->Graph != NULL)
+    {
+    reuseGraph = this->Graph->SupportsReuse() &&
+                 this->GraphBackendName == this->MaxFlowBackendName &&
+                 this->GraphHasIntegerCapacities == this->UseIntegerCapacities;
+    if(reuseGraph && this->UseIntegerCapacities)
+      {
+      reuseGraph = ComputeCapacityScale() >= this->CapacityScale;
+      }
+    reuseGraph = reuseGraph && FixedPixelsAreCurrent();
+    }
+
+  if(!reuseGraph)
+    {
+    DeleteGraph();
+    }
+
+  // Blank the output image
+  //itk::ImageRegionIterator<GrayscaleImageType> segmentMaskImageIterator(this->SegmentMask,
+  //             this->SegmentMask->GetLargestPossibleRegion());
+  itk::ImageRegionIterator<Mask> segmentMaskImageIterator(this->SegmentMask,
+                                                          this->SegmentMask->GetLargestPossibleRegion());
+  segmentMaskImageIterator.GoToBegin();
+
+  Mask::PixelType empty = 0;
+  //empty[0] = 0;
+
+  while(!segmentMaskImageIterator.IsAtEnd())
+    {
+    segmentMaskImageIterator.Set(empty);
+    ++segmentMaskImageIterator;
+    }
+
+  if(this->IncludeDepthInHistogram)
+    {
+    this->NumberOfHistogramComponents = 4;
+    }
+  else
+    {
+    this->NumberOfHistogramComponents = 3;
+    }
+    
+  if(this->Debug)
+    {
+    //this->DifferenceFunction->WriteImages();
+    }
+  const bool refineInitialSegmentation = !this->InitialSegmentation.empty() && !reuseGraph && !this->UseGridGraph;
+  if(reuseGraph)
+    {
+    this->UpdateGraph();
+    this->CutGraph(true);
+    }
+  else if(refineInitialSegmentation)
+    {
+    this->RefineInitialSegmentation();
+    }
+  else if(this->SolveComponentsSeparately && !this->PersistentGraph && !this->UseGridGraph && !UsePixelGroups() &&
+          !this->Debug)
+    {
+    this->SolveComponents();
+    }
+  else
+    {
+    this->CreateGraph();
+    this->CutGraph(false);
+    }
+
+  std::vector<Mask::PixelType>().swap(this->InitialSegmentation);
+
+  // The coarse segmentation is only accurate to about a block, so the band must be at least that wide.
+  // The graph on the pixel groups is not reused (see below), so the band graph can take over its memory.
+  const bool refinePixelGroups = UsePixelGroups() && !refineInitialSegmentation;
+  if(refinePixelGroups && (this->UseCoarseToFine || this->SuperpixelRefinementRadius > 0))
+    {
+    DeleteGraph();
+    }
+  if(refinePixelGroups && this->UseCoarseToFine)
+    {
+    RefineSegmentationBand(this->CoarseToFineFactor);
+    }
+  else if(refinePixelGroups && this->SuperpixelRefinementRadius > 0)
+    {
+    RefineSegmentationBand(this->SuperpixelRefinementRadius);
+    }
+
+  // The nodes of a graph on pixel groups depend on the hard constraints, so it cannot be reused. There is no Graph
+  // after RefineInitialSegmentation (it only solves a band graph), so the next cut builds a new one.
+  if(!this->PersistentGraph || this->UseGridGraph || UsePixelGroups() || !this->Graph ||
+     !this->Graph->SupportsReuse())
+    {
+    DeleteGraph();
+    }
+}
+
+void ImageGraphCut::PerformLambdaSweep(const std::vector<float>& lambdas)
+{
+  std::cout << "PerformLambdaSweep() " << std::endl;
+
+  if((this->Sources.size() <= 0) || (this->Sinks.size() <= 0) || lambdas.empty())
+    {
+    std::cout << "At least one source pixel, one sink pixel and one lambda must be specified!" << std::endl;
+    return;
+    }
+
+  // Lambda only scales the t-weights, so the cuts are computed one after another on the persistent graph and
+  // every cut starts from the residual flow of the previous one. Going from the largest to the smallest lambda,
+  // the capacity scale an integer graph is created with stays valid for all of the following cuts.
+  // The current Lambda is swept as well, so that the output segmentation is the actual cut at Lambda.
+  std::vector<float> sortedLambdas(lambdas);
+  sortedLambdas.push_back(this->Lambda);
+  std::sort(sortedLambdas.begin(), sortedLambdas.end(), std::greater<float>());
+  sortedLambdas.erase(std::unique(sortedLambdas.begin(), sortedLambdas.end()), sortedLambdas.end());
+
+  const float lambda = this->Lambda;
+  const bool persistentGraph = this->PersistentGraph;
+  this->PersistentGraph = true;
+
+  const unsigned int numberOfPixels = this->Image->GetLargestPossibleRegion().GetNumberOfPixels();
+  this->SweptSegmentations.assign(sortedLambdas.size(), std::vector<bool>(numberOfPixels, false));
+
+  for(unsigned int lambdaId = 0; lambdaId < sortedLambdas.size(); ++lambdaId)
+    {
+    SetLambda(sortedLambdas[lambdaId]);
+    PerformSegmentation();
+
+    // Store the segmentations in ascending order of lambda
+    std::vector<bool>& segmentation = this->SweptSegmentations[sortedLambdas.size() - 1 - lambdaId];
+    itk::ImageRegionConstIterator<Mask> maskIterator(this->SegmentMask, this->SegmentMask->GetLargestPossibleRegion());
+    for(unsigned int pixelId = 0; !maskIterator.IsAtEnd(); ++maskIterator, ++pixelId)
+      {
+      segmentation[pixelId] = maskIterator.Get() != 0;
+      }
+    }
+  this->SweptLambdas.assign(sortedLambdas.rbegin(), sortedLambdas.rend());
+
+  this->Lambda = lambda;
+  this->PersistentGraph = persistentGraph;
+  if(!this->PersistentGraph)
+    {
+    DeleteGraph();
+    }
+
+  // The breakpoint of a pixel is the smallest lambda of the run of foreground segmentations which ends with the
+  // largest lambda. The segmentations are not nested for a pixel which is in the foreground before that run.
+  this->NumberOfUnnestedPixels = 0;
+  itk::ImageRegionIterator<FloatScalarImageType> breakpointIterator(this->LambdaBreakpointImage,
+                                                                    this->LambdaBreakpointImage->GetLargestPossibleRegion());
+  for(unsigned int pixelId = 0; !breakpointIterator.IsAtEnd(); ++breakpointIterator, ++pixelId)
+    {
+    int lambdaId = static_cast<int>(this->SweptLambdas.size()) - 1;
+    while(lambdaId >= 0 && this->SweptSegmentations[lambdaId][pixelId])
+      {
+      lambdaId--;
+      }
+
+    float breakpoint = std::numeric_limits<float>::infinity();
+    if(lambdaId < static_cast<int>(this->SweptLambdas.size()) - 1)
+      {
+      breakpoint = this->SweptLambdas[lambdaId + 1];
+      }
+
+    for(int lowerLambdaId = lambdaId - 1; lowerLambdaId >= 0; --lowerLambdaId)
+      {
+      if(this->SweptSegmentations[lowerLambdaId][pixelId])
+        {
+        breakpoint = std::numeric_limits<float>::quiet_NaN();
+        this->NumberOfUnnestedPixels++;
+        break;
+        }
+      }
+    breakpointIterator.Set(breakpoint);
+    }
+
+  if(this->NumberOfUnnestedPixels > 0)
+    {
+    std::cout << "PerformLambdaSweep: " << this->NumberOfUnnestedPixels
+              << " pixels change their segment more than once, they have no lambda breakpoint." << std::endl;
+    }
+
+  SetSegmentMaskFromLambdaSweep(this->Lambda);
+}
+
+float ImageGraphCut::SetSegmentMaskFromLambdaSweep(const float lambda)
+{
+  if(this->SweptLambdas.empty())
+    {
+    throw std::runtime_error("SetSegmentMaskFromLambdaSweep: PerformLambdaSweep was not called for this image!");
+    }
+
+  unsigned int closestLambdaId = 0;
+  for(unsigned int lambdaId = 1; lambdaId < this->SweptLambdas.size(); ++lambdaId)
+    {
+    if(std::fabs(this->SweptLambdas[lambdaId] - lambda) < std::fabs(this->SweptLambdas[closestLambdaId] - lambda))
+      {
+      closestLambdaId = lambdaId;
+      }
+    }
+
+  const std::vector<bool>& segmentation = this->SweptSegmentations[closestLambdaId];
+  itk::ImageRegionIterator<Mask> maskIterator(this->SegmentMask, this->SegmentMask->GetLargestPossibleRegion());
+  for(unsigned int pixelId = 0; !maskIterator.IsAtEnd(); ++maskIterator, ++pixelId)
+    {
+    maskIterator.Set(segmentation[pixelId] ? 255 : 0);
+    }
+
+  return this->SweptLambdas[closestLambdaId];
+}
+
+const std::vector<float>& ImageGraphCut::GetSweptLambdas() const
+{
+  return this->SweptLambdas;
+}
+
+unsigned int ImageGraphCut::GetNumberOfUnnestedPixels() const
+{
+  return this->NumberOfUnnestedPixels;
+}
+
+FloatScalarImageType* ImageGraphCut::GetLambdaBreakpointImage()
+{
+  return this->LambdaBreakpointImage;
+}
+
+template <typename THistogram>
+void ImageGraphCut::CountSeeds(const std::vector<itk::Index<2> >& seeds, const unsigned int first,
+                               const unsigned int end, const bool add, THistogram* const histogram)
+{
+  const unsigned int numberOfPixels = this->Image->GetLargestPossibleRegion().GetNumberOfPixels();
+  const float* const validity = &this->ImageChannelPlanes[4 * numberOfPixels];
+
+  for(unsigned int i = first; i < end; i++)
+    {
+    unsigned int pixelId = this->Image->ComputeOffset(seeds[i]);
+    if(!validity[pixelId]) // Don't include invalid pixels in the histogram
+      {
+      continue;
+      }
+
+    if(add)
+      {
+      histogram->AddSample(this->BinImage[pixelId]);
+      }
+    else
+      {
+      histogram->RemoveSample(this->BinImage[pixelId]);
+      }
+    }
+}
+
+template <typename THistogram>
+void ImageGraphCut::UpdateHistogram(const std::vector<itk::Index<2> >& seeds,
+                                    std::vector<itk::Index<2> >* const countedSeeds, THistogram* const histogram)
+{
+  std::cout << "UpdateHistogram()" << std::endl;
+
+  // Strokes are appended to the seeds and cleared from their end, so usually one list starts with the other and
+  // only the difference has to be counted
+  if(seeds.size() >= countedSeeds->size() && std::equal(countedSeeds->begin(), countedSeeds->end(), seeds.begin()))
+    {
+    CountSeeds(seeds, countedSeeds->size(), seeds.size(), true, histogram);
+    }
+  else if(seeds.size() < countedSeeds->size() && std::equal(seeds.begin(), seeds.end(), countedSeeds->begin()))
+    {
+    CountSeeds(*countedSeeds, seeds.size(), countedSeeds->size(), false, histogram);
+    }
+  else
+    {
+    histogram->Initialize(this->TWeightBinning.GetNumberOfBins());
+    CountSeeds(seeds, 0, seeds.size(), true, histogram);
+    }
+  *countedSeeds = seeds;
+
+  // For empty histogram bins we use TinyHistogramValue instead of 0 (see there)
+  histogram->ComputeNegativeLogLikelihoods(TinyHistogramValue);
+
+  if(this->Debug)
+    {
+    std::cout << "The histogram has " << histogram->GetTotalCount() << " valid pixels" << std::endl;
+    }
+}
+
+void ImageGraphCut::ComputeBinImage()
+{
+  this->BinImageBinning = this->TWeightBinning;
+  this->BinImage.resize(this->Image->GetLargestPossibleRegion().GetNumberOfPixels());
+
+  std::vector<int> rowBlocks = SplitRows(this->Image->GetLargestPossibleRegion().GetSize()[1]);
+  std::vector<QFuture<void> > futures;
+  for(unsigned int block = 0; block + 1 < rowBlocks.size(); ++block)
+    {
+    futures.push_back(QtConcurrent::run(this, &ImageGraphCut::ComputeBinImageRows,
+                                        rowBlocks[block], rowBlocks[block + 1]));
+    }
+  for(unsigned int i = 0; i < futures.size(); ++i)
+    {
+    futures[i].waitForFinished();
+    }
+}
+
+void ImageGraphCut::ComputeBinImageRows(const int y0, const int y1)
+{
+  const unsigned int numberOfPixels = this->Image->GetLargestPossibleRegion().GetNumberOfPixels();
+  const unsigned int width = this->Image->GetLargestPossibleRegion().GetSize()[0];
+  const unsigned int firstPixel = y0 * width;
+  this->BinImageBinning.ComputeBins(&this->ImageChannelPlanes[firstPixel], numberOfPixels, (y1 - y0) * width,
+                                    &this->BinImage[firstPixel]);
+}
+
+void ImageGraphCut::CreateHistograms()
+{
+  // This function computes the foreground and background histograms from the scribbled pixels.
+  // Their bins span the range of every channel of the image.
+  //std::cout << "CreateHistograms()" << std::endl;
+  
+  std::vector<unsigned int> channelsToUse;
+  if(this->IncludeColorInHistogram)
+    {
+    channelsToUse.push_back(0);
+    channelsToUse.push_back(1);
+    channelsToUse.push_back(2);
+    }
+  if(this->IncludeDepthInHistogram)
+    {
+    channelsToUse.push_back(3);
+    }
+
+  this->TWeightBinning.Initialize(channelsToUse, this->NumberOfHistogramBins, this->Statistics.GetMinimum(),
+                                  this->Statistics.GetMaximum());
+
+  // The bins of the pixels only change with the image and the binning. When they change, the histograms start over.
+  bool recount = false;
+  if(this->BinImage.empty() || !this->TWeightBinning.IsEqual(this->BinImageBinning))
+    {
+    ComputeBinImage();
+    recount = true;
+    }
+
+  // A flat histogram of many bins is mostly empty (there are far fewer seed pixels than bins), so above the threshold
+  // only the non-empty bins are stored. The histograms of the other kind are emptied to release their memory.
+  const bool useSparseHistograms = this->TWeightBinning.GetNumberOfBins() > this->SparseHistogramThreshold;
+  if(recount || useSparseHistograms != this->UseSparseHistograms)
+    {
+    this->UseSparseHistograms = useSparseHistograms;
+    const unsigned int numberOfFlatBins = useSparseHistograms ? 0 : this->TWeightBinning.GetNumberOfBins();
+    this->ForegroundHistogram.Initialize(numberOfFlatBins);
+    this->BackgroundHistogram.Initialize(numberOfFlatBins);
+    this->SparseForegroundHistogram.Initialize(0);
+    this->SparseBackgroundHistogram.Initialize(0);
+    this->HistogramSources.clear();
+    this->HistogramSinks.clear();
+    }
+
+  if(this->UseSparseHistograms)
+    {
+    UpdateHistogram(this->Sources, &this->HistogramSources, &this->SparseForegroundHistogram);
+    UpdateHistogram(this->Sinks, &this->HistogramSinks, &this->SparseBackgroundHistogram);
+    }
+  else
+    {
+    UpdateHistogram(this->Sources, &this->HistogramSources, &this->ForegroundHistogram);
+    UpdateHistogram(this->Sinks, &this->HistogramSinks, &this->BackgroundHistogram);
+    }
+}
+
+
+void ImageGraphCut::CreateGraphNodes()
+{
+  if(this->UseGridGraph)
+    {
+    // The grid graph nodes are implicit, so there is nothing to add and the NodeImage is not used
+    itk::Size<2> size = this->Image->GetLargestPossibleRegion().GetSize();
+    this->GridGraph = new GridGraphType(size[0], size[1]);
+    this->FixedPixels.assign(size[0] * size[1], FreePixel);
+    this->FixedPixelIds.clear();
+    return;
+    }
+
+  FixPixels();
+
+  // Form the graph. Every free pixel (or group of pixels) gets a node and (away from the border) about 4 edges to the
+  // neighbors that follow it, so the node and arc arrays can be allocated once.
+  // The node id of every pixel is stored in a "node image".
+  unsigned int numberOfNodes;
+  if(UsePixelGroups())
+    {
+    numberOfNodes = CreatePixelGroupNodeImage();
+    }
+  else
+    {
+    numberOfNodes = CreatePixelNodeImage();
+    }
+
+  // Add all of the nodes to the graph. The ids of nodes added in one call to a new graph are 0,1,2,...
+  if(this->UseIntegerCapacities)
+    {
+    this->CapacityScale = ComputeCapacityScale();
+    }
+  // The node and arc arrays are kept in the GraphMemory from one graph of the image to the next
+  this->Graph = MaxFlowBackend::Create(this->MaxFlowBackendName, this->UseIntegerCapacities,
+                                       numberOfNodes, 4 * numberOfNodes, GetGraphMemory());
+  this->GraphBackendName = this->MaxFlowBackendName;
+  this->GraphHasIntegerCapacities = this->UseIntegerCapacities;
+  this->Graph->AddNodes(numberOfNodes);
+  this->GraphHasPixelEdges = false;
+}
+
+unsigned int ImageGraphCut::CreatePixelNodeImage()
+{
+  // Every free pixel is a node; the node image is the table from the pixels to the consecutive node ids
+  const unsigned int numberOfPixels = this->Image->GetLargestPossibleRegion().GetNumberOfPixels();
+  MaxFlowBackend::NodeId* const nodes = this->NodeImage->GetBufferPointer();
+  unsigned int numberOfNodes = 0;
+  for(unsigned int pixelId = 0; pixelId < numberOfPixels; ++pixelId)
+    {
+    nodes[pixelId] = this->FixedPixels[pixelId] == FreePixel ? numberOfNodes++ : NoNode;
+    }
+  this->MaxPixelsPerNode = 1;
+  return numberOfNodes;
+}
+
+bool ImageGraphCut::UsePixelGroups() const
+{
+  return (this->UseSuperpixels || this->UseCoarseToFine) && !this->UseGridGraph;
+}
+
+void ImageGraphCut::ComputePixelGroupLabels()
+{
+  // The pixel groups only depend on the image, so they are computed once per image and group size
+  if(this->UseCoarseToFine)
+    {
+    if(this->PixelGroupLabels.IsNotNull() && this->PixelGroupLabelsAreBlocks &&
+       this->PixelGroupLabelsSize == this->CoarseToFineFactor)
+      {
+      return;
+      }
+
+    // The blocks of CoarseToFineFactor x CoarseToFineFactor pixels are the pixels of the downsampled image.
+    // Invalid pixels have no N- and t-weights, so they do not contribute to the weights of their block.
+    itk::Size<2> size = this->Image->GetLargestPossibleRegion().GetSize();
+    const unsigned int factor = std::max(1u, this->CoarseToFineFactor);
+    const unsigned int blocksPerRow = (size[0] + factor - 1) / factor;
+
+    this->PixelGroupLabels = SLICSuperpixels::LabelImageType::New();
+    this->PixelGroupLabels->SetRegions(this->Image->GetLargestPossibleRegion());
+    this->PixelGroupLabels->Allocate();
+
+    itk::ImageRegionIteratorWithIndex<SLICSuperpixels::LabelImageType> labelIterator(this->PixelGroupLabels,
+                                                                                   this->PixelGroupLabels->GetLargestPossibleRegion());
+    for(; !labelIterator.IsAtEnd(); ++labelIterator)
+      {
+      itk::Index<2> index = labelIterator.GetIndex();
+      labelIterator.Set((index[1] / factor) * blocksPerRow + index[0] / factor);
+      }
+
+    this->NumberOfPixelGroups = blocksPerRow * ((size[1] + factor - 1) / factor);
+    this->PixelGroupLabelsSize = this->CoarseToFineFactor;
+    this->PixelGroupLabelsAreBlocks = true;
+    }
+  else
+    {
+    if(this->PixelGroupLabels.IsNotNull() && !this->PixelGroupLabelsAreBlocks &&
+       this->PixelGroupLabelsSize == this->SuperpixelSize)
+      {
+      return;
+      }
+
+    SLICSuperpixels superpixels;
+    superpixels.SuperpixelSize = this->SuperpixelSize;
+    this->PixelGroupLabels = SLICSuperpixels::LabelImageType::New();
+    this->NumberOfPixelGroups = superpixels.Compute(this->Image, this->PixelGroupLabels);
+    this->PixelGroupLabelsSize = this->SuperpixelSize;
+    this->PixelGroupLabelsAreBlocks = false;
+    std::cout << "Computed " << this->NumberOfPixelGroups << " superpixels." << std::endl;
+    }
+}
+
+unsigned int ImageGraphCut::CreatePixelGroupNodeImage()
+{
+  ComputePixelGroupLabels();
+
+  // The pixels with hard constraints which are not fixed get nodes of their own: the hard t-weight is only large
+  // enough to force a single pixel to a terminal (see ComputeHardTWeight), and a group can contain both
+  // source and sink pixels.
+  std::vector<unsigned char> isHardPixel(this->Image->GetLargestPossibleRegion().GetNumberOfPixels(), 0);
+  for(unsigned int i = 0; i < this->Sources.size(); ++i)
+    {
+    isHardPixel[this->Image->ComputeOffset(this->Sources[i])] = 1;
+    }
+  for(unsigned int i = 0; i < this->Sinks.size(); ++i)
+    {
+    isHardPixel[this->Image->ComputeOffset(this->Sinks[i])] = 1;
+    }
+
+  std::vector<unsigned int> groupSizes(this->NumberOfPixelGroups, 0);
+  MaxFlowBackend::NodeId nodeId = this->NumberOfPixelGroups;
+
+  itk::ImageRegionConstIterator<SLICSuperpixels::LabelImageType> labelIterator(this->PixelGroupLabels,
+                                                                              this->PixelGroupLabels->GetLargestPossibleRegion());
+  itk::ImageRegionIterator<NodeImageType> nodeImageIterator(this->NodeImage, this->NodeImage->GetLargestPossibleRegion());
+
+  for(unsigned int pixelId = 0; !nodeImageIterator.IsAtEnd(); ++pixelId, ++nodeImageIterator, ++labelIterator)
+    {
+    if(this->FixedPixels[pixelId] != FreePixel)
+      {
+      nodeImageIterator.Set(NoNode);
+      }
+    else if(isHardPixel[pixelId])
+      {
+      nodeImageIterator.Set(nodeId++);
+      }
+    else
+      {
+      nodeImageIterator.Set(labelIterator.Get());
+      groupSizes[labelIterator.Get()]++;
+      }
+    }
+
+  this->MaxPixelsPerNode = 1;
+  if(!groupSizes.empty())
+    {
+    this->MaxPixelsPerNode = std::max(1u, *(std::max_element(groupSizes.begin(), groupSizes.end())));
+    }
+
+  return nodeId;
+}
+
+std::vector<unsigned char> ImageGraphCut::ComputeSeedLabels()
+{
+  std::vector<unsigned char> labels(this->Image->GetLargestPossibleRegion().GetNumberOfPixels(), FreePixel);
+  for(unsigned int i = 0; i < this->Sources.size(); ++i)
+    {
+    labels[this->Image->ComputeOffset(this->Sources[i])] |= FixedSourcePixel;
+    }
+  for(unsigned int i = 0; i < this->Sinks.size(); ++i)
+    {
+    labels[this->Image->ComputeOffset(this->Sinks[i])] |= FixedSinkPixel;
+    }
+
+  // A pixel which is both a source and a sink seed is left to the cut (with both hard t-weights)
+  for(unsigned int pixelId = 0; pixelId < labels.size(); ++pixelId)
+    {
+    if(labels[pixelId] == (FixedSourcePixel | FixedSinkPixel))
+      {
+      labels[pixelId] = FreePixel;
+      }
+    }
+  return labels;
+}
+
+std::vector<unsigned char> ImageGraphCut::ComputeFixedPixels()
+{
+  const unsigned int numberOfPixels = this->Image->GetLargestPossibleRegion().GetNumberOfPixels();
+  std::vector<unsigned char> seedLabels = ComputeSeedLabels();
+  std::vector<unsigned char> fixedPixels(numberOfPixels, FreePixel);
+  if(this->ContractHardSeeds)
+    {
+    fixedPixels = seedLabels;
+    }
+
+  if(this->DropInvalidPixels)
+    {
+    const float* const validity = &this->ImageChannelPlanes[4 * numberOfPixels];
+    for(unsigned int pixelId = 0; pixelId < numberOfPixels; ++pixelId)
+      {
+      if(!validity[pixelId] && seedLabels[pixelId] == FreePixel)
+        {
+        fixedPixels[pixelId] = FixedSinkPixel;
+        }
+      }
+    }
+  return fixedPixels;
+}
+
+void ImageGraphCut::FixPixels()
+{
+  this->FixedPixels = ComputeFixedPixels();
+
+  const float* const validity = &this->ImageChannelPlanes[4 * this->FixedPixels.size()];
+  this->FixedPixelIds.clear();
+  for(unsigned int pixelId = 0; pixelId < this->FixedPixels.size(); ++pixelId)
+    {
+    if(this->FixedPixels[pixelId] != FreePixel && validity[pixelId])
+      {
+      this->FixedPixelIds.push_back(pixelId);
+      }
+    }
+}
+
+bool ImageGraphCut::FixedPixelsAreCurrent()
+{
+  // Pixels which became seeds since can stay nodes (with hard t-weights)
+  std::vector<unsigned char> fixedPixels = ComputeFixedPixels();
+  for(unsigned int pixelId = 0; pixelId < fixedPixels.size(); ++pixelId)
+    {
+    if(this->FixedPixels[pixelId] != FreePixel && this->FixedPixels[pixelId] != fixedPixels[pixelId])
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+void ImageGraphCut::AddFixedPixelNWeights(std::vector<float>* const sourceTWeights,
+                                          std::vector<float>* const sinkTWeights)
+{
+  // A fixed pixel is in its segment, so the N-weight to a free neighbor is cut exactly if the neighbor is in the other
+  // segment, like the t-weight of the neighbor to the terminal of the fixed pixel
+  const itk::Size<2> size = this->Image->GetLargestPossibleRegion().GetSize();
+  const int width = size[0];
+  const int height = size[1];
+  const unsigned int numberOfPixels = width * height;
+  std::vector<NeighborhoodIteratorType::OffsetType> neighbors = GetNeighborOffsets();
+
+  for(unsigned int fixedId = 0; fixedId < this->FixedPixelIds.size(); ++fixedId)
+    {
+    const unsigned int pixelId = this->FixedPixelIds[fixedId];
+    std::vector<float>& tWeights = this->FixedPixels[pixelId] == FixedSourcePixel ? *sourceTWeights : *sinkTWeights;
+    const int x = pixelId % width;
+    const int y = pixelId / width;
+    for(unsigned int i = 0; i < neighbors.size(); i++)
+      {
+      // The edges to the neighbor after the pixel and from the neighbor before it
+      for(int side = -1; side <= 1; side += 2)
+        {
+        const int neighborX = x + side * neighbors[i][0];
+        const int neighborY = y + side * neighbors[i][1];
+        if(neighborX < 0 || neighborX >= width || neighborY < 0 || neighborY >= height)
+          {
+          continue;
+          }
+        const unsigned int neighborId = neighborY * width + neighborX;
+        if(this->FixedPixels[neighborId] == FreePixel)
+          {
+          tWeights[neighborId] += this->NWeights[i * numberOfPixels + (side > 0 ? pixelId : neighborId)];
+          }
+        }
+      }
+    }
+}
+
+template <typename TKernel>
+void ImageGraphCut::ComputeNWeights(const float* const weights)
+{
+  itk::ImageRegion<2> region = this->Image->GetLargestPossibleRegion();
+  this->NWeights.assign(GetNeighborOffsets().size() * region.GetNumberOfPixels(), 0.0f);
+
+  // The SSE2/AVX2 or scalar row kernel, selected once for the whole image
+  NWeightRowFunction computeRow = GetNWeightRowFunction<TKernel>();
+
+  std::vector<int> rowBlocks = SplitRows(region.GetSize()[1]);
+  std::vector<QFuture<void> > futures;
+  for(unsigned int block = 0; block + 1 < rowBlocks.size(); ++block)
+    {
+    futures.push_back(QtConcurrent::run(this, &ImageGraphCut::ComputeNWeightRows, computeRow, weights,
+                                        rowBlocks[block], rowBlocks[block + 1]));
+    }
+  for(unsigned int i = 0; i < futures.size(); ++i)
+    {
+    futures[i].waitForFinished();
+    }
+}
+
+void ImageGraphCut::ComputeNWeightRows(NWeightRowFunction computeRow, const float* const weights,
+                                       const int y0, const int y1)
+{
+  itk::ImageRegion<2> region = this->Image->GetLargestPossibleRegion();
+  const int width = region.GetSize()[0];
+  const int height = region.GetSize()[1];
+  const unsigned int numberOfPixels = width * height;
+  const float* const planes = &this->ImageChannelPlanes[0];
+  const float scale = -1.0f / (2.0f * this->Sigma * this->Sigma);
+
+  std::vector<NeighborhoodIteratorType::OffsetType> neighbors = GetNeighborOffsets();
+  for(unsigned int i = 0; i < neighbors.size(); i++)
+    {
+    const int dx = neighbors[i][0];
+    const int dy = neighbors[i][1];
+    float* const plane = &this->NWeights[i * numberOfPixels];
+
+    // Only the pixels whose neighbor is inside the image
+    const int x0 = std::max(0, -dx);
+    const int x1 = std::min(width, width - dx);
+    for(int y = std::max(y0, -dy); y < std::min(y1, height - dy); ++y)
+      {
+      const int pixelId = y * width + x0;
+      computeRow(planes + pixelId, planes + pixelId + dy * width + dx, numberOfPixels, weights, scale,
+                 x1 - x0, plane + pixelId);
+      }
+    }
+}
+
+unsigned int ImageGraphCut::CountPixelEdges(const int y0, const int y1)
+{
+  itk::ImageRegion<2> region = this->Image->GetLargestPossibleRegion();
+  const int width = region.GetSize()[0];
+  const int height = region.GetSize()[1];
+  const MaxFlowBackend::NodeId* const nodes = this->NodeImage->GetBufferPointer();
+
+  std::vector<NeighborhoodIteratorType::OffsetType> neighbors = GetNeighborOffsets();
+  unsigned int numberOfEdges = 0;
+  for(unsigned int i = 0; i < neighbors.size(); i++)
+    {
+    const int dx = neighbors[i][0];
+    const int dy = neighbors[i][1];
+
+    // The pixels whose neighbor is inside the image
+    const int x0 = std::max(0, -dx);
+    const int x1 = std::min(width, width - dx);
+    for(int y = std::max(y0, -dy); y < std::min(y1, height - dy); ++y)
+      {
+      for(int pixelId = y * width + x0; pixelId < y * width + x1; ++pixelId)
+        {
+        if(nodes[pixelId] != NoNode && nodes[pixelId + dy * width + dx] != NoNode)
+          {
+          numberOfEdges++;
+          }
+        }
+      }
+    }
+  return numberOfEdges;
+}
+
+float ImageGraphCut::SetPixelEdges(const MaxFlowBackend::EdgeId firstEdge, const int y0, const int y1)
+{
+  itk::ImageRegion<2> region = this->Image->GetLargestPossibleRegion();
+  const int width = region.GetSize()[0];
+  const int height = region.GetSize()[1];
+  const unsigned int numberOfPixels = width * height;
+  const MaxFlowBackend::NodeId* const nodes = this->NodeImage->GetBufferPointer();
+
+  // The edges are numbered in the order of CountPixelEdges
+  std::vector<NeighborhoodIteratorType::OffsetType> neighbors = GetNeighborOffsets();
+  MaxFlowBackend::EdgeId edge = firstEdge;
+  for(unsigned int i = 0; i < neighbors.size(); i++)
+    {
+    const int dx = neighbors[i][0];
+    const int dy = neighbors[i][1];
+    const float* const plane = &this->NWeights[i * numberOfPixels];
+
+    const int x0 = std::max(0, -dx);
+    const int x1 = std::min(width, width - dx);
+    for(int y = std::max(y0, -dy); y < std::min(y1, height - dy); ++y)
+      {
+      for(int pixelId = y * width + x0; pixelId < y * width + x1; ++pixelId)
+        {
+        const MaxFlowBackend::NodeId node1 = nodes[pixelId];
+        const MaxFlowBackend::NodeId node2 = nodes[pixelId + dy * width + dx];
+        if(node1 == NoNode || node2 == NoNode)
+          {
+          continue;
+          }
+
+        // This is an undirected graph so we create a bidirectional edge with both weights set to 'weight'
+        float weight = plane[pixelId];
+        if(this->UseIntegerCapacities)
+          {
+          int quantizedWeight = QuantizeWeight(weight);
+          this->Graph->SetEdge(edge++, node1, node2, quantizedWeight, quantizedWeight);
+          }
+        else
+          {
+          this->Graph->SetEdge(edge++, node1, node2, weight, weight);
+          }
+        }
+      }
+    }
+
+  return ComputeMaxNWeightSum(y0, y1);
+}
+
+void ImageGraphCut::UpdateGraphNWeights()
+{
+  UpdateNWeights();
+  std::vector<int> rowBlocks = SplitRows(this->Image->GetLargestPossibleRegion().GetSize()[1]);
+
+  // The edges are changed one block after another, since the changes of the flow and the t-weights of the nodes on
+  // the block borders cannot be made concurrently. The pixel edges are the only edges of the graph (see CreateNWeights).
+  std::vector<QFuture<float> > sums;
+  MaxFlowBackend::EdgeId edge = 0;
+  for(unsigned int block = 0; block + 1 < rowBlocks.size(); ++block)
+    {
+    edge = UpdatePixelEdges(edge, rowBlocks[block], rowBlocks[block + 1]);
+    sums.push_back(QtConcurrent::run(this, &ImageGraphCut::ComputeMaxNWeightSum,
+                                     rowBlocks[block], rowBlocks[block + 1]));
+    }
+  this->MaxNWeightSum = 0.0f;
+  for(unsigned int i = 0; i < sums.size(); ++i)
+    {
+    this->MaxNWeightSum = std::max(this->MaxNWeightSum, sums[i].result());
+    }
+
+  std::vector<float>().swap(this->GraphNWeights);
+}
+
+MaxFlowBackend::EdgeId ImageGraphCut::UpdatePixelEdges(const MaxFlowBackend::EdgeId firstEdge,
+                                                       const int y0, const int y1)
+{
+  itk::ImageRegion<2> region = this->Image->GetLargestPossibleRegion();
+  const int width = region.GetSize()[0];
+  const int height = region.GetSize()[1];
+  const unsigned int numberOfPixels = width * height;
+  const MaxFlowBackend::NodeId* const nodes = this->NodeImage->GetBufferPointer();
+
+  std::vector<NeighborhoodIteratorType::OffsetType> neighbors = GetNeighborOffsets();
+  MaxFlowBackend::EdgeId edge = firstEdge;
+  for(unsigned int i = 0; i < neighbors.size(); i++)
+    {
+    const int dx = neighbors[i][0];
+    const int dy = neighbors[i][1];
+    const float* const plane = &this->NWeights[i * numberOfPixels];
+    const float* const graphPlane = &this->GraphNWeights[i * numberOfPixels];
+
+    const int x0 = std::max(0, -dx);
+    const int x1 = std::min(width, width - dx);
+    for(int y = std::max(y0, -dy); y < std::min(y1, height - dy); ++y)
+      {
+      for(int pixelId = y * width + x0; pixelId < y * width + x1; ++pixelId)
+        {
+        const MaxFlowBackend::NodeId node1 = nodes[pixelId];
+        const MaxFlowBackend::NodeId node2 = nodes[pixelId + dy * width + dx];
+        if(node1 == NoNode || node2 == NoNode)
+          {
+          continue;
+          }
+
+        // As with the t-weights, the old and the new weights of an integer graph are quantized separately
+        double delta;
+        if(this->UseIntegerCapacities)
+          {
+          delta = QuantizeWeight(plane[pixelId]) - QuantizeWeight(graphPlane[pixelId]);
+          }
+        else
+          {
+          delta = plane[pixelId] - graphPlane[pixelId];
+          }
+        if(delta != 0)
+          {
+          this->Graph->AddEdgeCapacities(edge, delta, delta);
+          this->Graph->MarkNode(node1);
+          this->Graph->MarkNode(node2);
+          }
+        edge++;
+        }
+      }
+    }
+
+  return edge;
+}
+
+float ImageGraphCut::ComputeMaxNWeightSum(const int y0, const int y1)
+{
+  itk::ImageRegion<2> region = this->Image->GetLargestPossibleRegion();
+  const int width = region.GetSize()[0];
+  const int height = region.GetSize()[1];
+  const unsigned int numberOfPixels = width * height;
+  std::vector<NeighborhoodIteratorType::OffsetType> neighbors = GetNeighborOffsets();
+
+  // The N-weights incident to a pixel are those of its edges to the neighbors after it and of the edges of the
+  // pixels before it
+  float maxNWeightSum = 0.0f;
+  for(int y = y0; y < y1; ++y)
+    {
+    for(int x = 0; x < width; ++x)
+      {
+      float nWeightSum = 0.0f;
+      for(unsigned int i = 0; i < neighbors.size(); i++)
+        {
+        const float* const plane = &this->NWeights[i * numberOfPixels];
+        nWeightSum += plane[y * width + x];
+
+        const int previousX = x - neighbors[i][0];
+        const int previousY = y - neighbors[i][1];
+        if(previousX >= 0 && previousX < width && previousY >= 0 && previousY < height)
+          {
+          nWeightSum += plane[previousY * width + previousX];
+          }
+        }
+      maxNWeightSum = std::max(maxNWeightSum, nWeightSum);
       }
-    
-    sample->PushBack(normalizedPixel);
     }
 
-  Helpers::WriteVectorToFile<float>(debugNormalizedPixelValues, "histogram.txt");
-  
-  histogramFilter->SetHistogramSize(histogramSize);
-  histogramFilter->SetHistogramBinMinimum(binMinimum);
-  histogramFilter->SetHistogramBinMaximum(binMaximum);
-  histogramFilter->SetAutoMinimumMaximum(false);
-  histogramFilter->SetInput(sample);
-  histogramFilter->Modified();
-  histogramFilter->Update();
-  histogramFilter->Register();
-
-  return histogramFilter->GetOutput();
-  //histogramOutput = histogramFilter->GetOutput();
+  return maxNWeightSum;
 }
 
-void ImageGraphCut::CreateHistograms()
+void ImageGraphCut::UpdateNWeights()
 {
-  // This function creates ITK samples from the scribbled pixels and then computes the foreground and background histograms
-  //std::cout << "CreateHistograms()" << std::endl;
-  
-  std::vector<unsigned int> channelsToUse;
-  if(this->IncludeColorInHistogram)
-    {
-    channelsToUse.push_back(0);
-    channelsToUse.push_back(1);
-    channelsToUse.push_back(2);
-    }
-  if(this->IncludeDepthInHistogram)
+  if(this->NWeights.empty())
     {
-    channelsToUse.push_back(3);
+    this->Sigma = ComputeAverageRandomDifferences(1000);
+    ComputeNWeights();
     }
-
-  this->ForegroundHistogram = CreateHistogram(this->Sources, channelsToUse);
-  this->BackgroundHistogram = CreateHistogram(this->Sinks, channelsToUse);
-  
-  //CreateHistogram(this->Sources, channelsToUse, this->ForegroundHistogram);
-  //CreateHistogram(this->Sinks, channelsToUse, this->BackgroundHistogram);
 }
 
-
-void ImageGraphCut::CreateGraphNodes()
+void ImageGraphCut::ComputeNWeights()
 {
-  
-  // Form the graph
-  this->Graph = new GraphType;
-
-  // Add all of the nodes to the graph and store their IDs in a "node image"
-  itk::ImageRegionIterator<NodeImageType> nodeImageIterator(this->NodeImage, this->NodeImage->GetLargestPossibleRegion());
-  nodeImageIterator.GoToBegin();
+  const unsigned int allChannels = (1u << Difference::NumberOfChannels) - 1;
+  const unsigned int channelMask = this->DifferenceFunction->GetChannelMask();
+  const float* const weights = this->DifferenceFunction->GetWeights();
 
-  while(!nodeImageIterator.IsAtEnd())
+  if(!weights && channelMask == (1u << 3))
+    {
+    ComputeNWeights<DifferenceKernel<Difference::NumberOfChannels, 1u << 3, false> >(NULL);
+    }
+  else if(!weights && channelMask == ((1u << 0) | (1u << 1) | (1u << 2)))
+    {
+    ComputeNWeights<DifferenceKernel<Difference::NumberOfChannels, (1u << 0) | (1u << 1) | (1u << 2), false> >(NULL);
+    }
+  else if(!weights && channelMask == allChannels)
+    {
+    ComputeNWeights<DifferenceKernel<Difference::NumberOfChannels, allChannels, false> >(NULL);
+    }
+  else
     {
-    nodeImageIterator.Set(this->Graph->add_node());
-    ++nodeImageIterator;
+    // Any other difference is a weighted sum over all channels, with weight 0 for the channels it does not use
+    std::vector<float> channelWeights(Difference::NumberOfChannels, 0.0f);
+    for(unsigned int component = 0; component < Difference::NumberOfChannels; ++component)
+      {
+      if(channelMask & (1u << component))
+        {
+        channelWeights[component] = weights ? weights[component] : 1.0f;
+        }
+      }
+    ComputeNWeights<DifferenceKernel<Difference::NumberOfChannels, allChannels, true> >(&channelWeights[0]);
     }
 }
 
@@ -429,8 +2128,11 @@ void ImageGraphCut::CreateNWeights()
 {
   ////////// Create n-edges and set n-edge weights (links between image nodes) //////////
 
-  this->Sigma = ComputeAverageRandomDifferences(1000);
-  
+  // The N-weights (and the Sigma they are computed with) only depend on the image and the difference function, so
+  // they are kept until SetImage or SetDifferenceFunction change one of them. Changing Lambda, the histogram bins or
+  // the strokes only recomputes the t-weights.
+  UpdateNWeights();
+
   if(this->Debug)
     {
     this->DebugGraphLines->Initialize();
@@ -439,11 +2141,9 @@ void ImageGraphCut::CreateNWeights()
     this->DebugGraphEdgeWeights->SetNumberOfValues(1);
     }
   
-  // We use a neighborhood iterator here even though we are looking only at a single pixel index in all images on each iteration because we use the neighborhood to determine edge validity.
-  std::vector<NeighborhoodIteratorType::OffsetType> neighbors;
-  NeighborhoodIteratorType iterator(ITKHelpers::Get1x1Radius(), this->Image,
-                                    this->Image->GetLargestPossibleRegion());
-  ConstructNeighborhoodIterator(&iterator, neighbors);
+  itk::ImageRegion<2> region = this->Image->GetLargestPossibleRegion();
+  const unsigned int numberOfPixels = region.GetNumberOfPixels();
+  std::vector<NeighborhoodIteratorType::OffsetType> neighbors = GetNeighborOffsets();
 
   // Traverse the image adding an edge between:
   // - the current pixel and the pixel below it
@@ -451,205 +2151,275 @@ void ImageGraphCut::CreateNWeights()
   // - the current pixel and the pixel to the bottom-right of it
   // This prevents duplicate edges (i.e. we cannot add an edge to all 8-connected neighbors of every pixel or almost every edge would be duplicated.
   std::cout << "Setting N-Weights..." << std::endl;
-  
-  for(iterator.GoToBegin(); !iterator.IsAtEnd(); ++iterator)
+
+  // A pixel graph gets all of its edges at once, so that blocks of rows of them can be set on all cores. The edges to
+  // fixed pixels are t-weights (see AddFixedPixelNWeights).
+  if(!this->UseGridGraph && !UsePixelGroups() && !this->Debug)
     {
-    PixelType centerPixel = iterator.GetCenterPixel();
-  
+    // The edges of every block of rows follow those of the blocks before it
+    std::vector<int> rowBlocks = SplitRows(region.GetSize()[1]);
+    std::vector<QFuture<unsigned int> > counts;
+    for(unsigned int block = 0; block + 1 < rowBlocks.size(); ++block)
+      {
+      counts.push_back(QtConcurrent::run(this, &ImageGraphCut::CountPixelEdges, rowBlocks[block], rowBlocks[block + 1]));
+      }
+    std::vector<MaxFlowBackend::EdgeId> blockFirstEdges(counts.size(), 0);
+    unsigned int numberOfEdges = 0;
+    for(unsigned int block = 0; block < counts.size(); ++block)
+      {
+      blockFirstEdges[block] = numberOfEdges;
+      numberOfEdges += counts[block].result();
+      }
+    MaxFlowBackend::EdgeId firstEdge = this->Graph->AddEdges(numberOfEdges);
+
+    std::vector<QFuture<float> > futures;
+    for(unsigned int block = 0; block + 1 < rowBlocks.size(); ++block)
+      {
+      futures.push_back(QtConcurrent::run(this, &ImageGraphCut::SetPixelEdges, firstEdge + blockFirstEdges[block],
+                                          rowBlocks[block], rowBlocks[block + 1]));
+      }
+    this->MaxNWeightSum = 0.0f;
+    for(unsigned int i = 0; i < futures.size(); ++i)
+      {
+      this->MaxNWeightSum = std::max(this->MaxNWeightSum, futures[i].result());
+      }
+    this->GraphHasPixelEdges = true;
+    return;
+    }
+
+  // The sum of the N-weights incident to each pixel, used to compute the hard constraint t-weight
+  std::vector<float> nWeightSums(numberOfPixels, 0.0f);
+
+  // With pixel groups, the N-weights of all pixel pairs between two nodes are collected and added up (keyed by the
+  // node pair), and every pair of nodes gets a single edge
+  std::vector<std::pair<uint64_t, float> > groupEdges;
+
+  itk::ImageRegionConstIteratorWithIndex<ImageType> imageIterator(this->Image, region);
+  for(unsigned int pixelId = 0; !imageIterator.IsAtEnd(); ++imageIterator, ++pixelId)
+    {
+    const itk::Index<2> index = imageIterator.GetIndex();
+
     for(unsigned int i = 0; i < neighbors.size(); i++)
       {
-      //float weight = std::numeric_limits<float>::max(); // This will be the assigned weight if the edge is not computed (if one or both of the pixels is invalid)
-      float weight = 0.0;
-      bool inbounds = false;
-      ImageType::PixelType neighborPixel = iterator.GetPixel(neighbors[i], inbounds);
+      const itk::Index<2> neighborIndex = index + neighbors[i];
 
       // If the current neighbor is outside the image, skip it
-      if(!inbounds)
+      if(!region.IsInside(neighborIndex))
         {
         continue;
         }
 
-      // If pixel or its neighbor is not valid, skip this edge.
-      if(neighborPixel[4] && centerPixel[4]) // validity channel
-        {
-        float pixelDifference = this->DifferenceFunction->ComputeDifference(centerPixel, neighborPixel);
-
-        // Compute the edge weight
-        weight = ComputeNEdgeWeight(pixelDifference);
+      // The weight is 0 if the pixel or its neighbor is not valid
+      float weight = this->NWeights[i * numberOfPixels + pixelId];
+      nWeightSums[pixelId] += weight;
+      nWeightSums[this->Image->ComputeOffset(neighborIndex)] += weight;
 
-        }// end if current and neighbor are valid
       // Add the edge to the graph
-      void* node1 = this->NodeImage->GetPixel(iterator.GetIndex());
-      void* node2 = this->NodeImage->GetPixel(iterator.GetIndex(neighbors[i]));
-      this->Graph->add_edge(node1, node2, weight, weight); // This is an undirected graph so we create a bidirectional edge with both weights set to 'weight'
+      if(this->UseGridGraph)
+        {
+        GridGraphType::direction direction = GridGraphType::offset_to_direction(neighbors[i][0], neighbors[i][1]);
+        this->GridGraph->add_edge(index[0], index[1], direction, weight, weight);
+        }
+      else
+        {
+        MaxFlowBackend::NodeId node1 = this->NodeImage->GetPixel(index);
+        MaxFlowBackend::NodeId node2 = this->NodeImage->GetPixel(neighborIndex);
+        // This is an undirected graph so we create a bidirectional edge with both weights set to 'weight'
+        if(node1 == NoNode || node2 == NoNode)
+          {
+          // The edges to fixed pixels are t-weights (see AddFixedPixelNWeights)
+          }
+        else if(UsePixelGroups())
+          {
+          if(node1 != node2 && weight > 0)
+            {
+            uint64_t key = (static_cast<uint64_t>(std::min(node1, node2)) << 32) | std::max(node1, node2);
+            groupEdges.push_back(std::make_pair(key, weight));
+            }
+          }
+        else if(this->UseIntegerCapacities)
+          {
+          int quantizedWeight = QuantizeWeight(weight);
+          this->Graph->AddEdge(node1, node2, quantizedWeight, quantizedWeight);
+          }
+        else
+          {
+          this->Graph->AddEdge(node1, node2, weight, weight);
+          }
+        }
       
       if(this->Debug)
 	{
 	vtkSmartPointer<vtkLine> line = vtkSmartPointer<vtkLine>::New();
-	line->GetPointIds()->SetId(0,this->DebugGraphPointIds->GetPixel(iterator.GetIndex()));
-	line->GetPointIds()->SetId(1,this->DebugGraphPointIds->GetPixel(iterator.GetIndex(neighbors[i])));
+	line->GetPointIds()->SetId(0,this->DebugGraphPointIds->GetPixel(index));
+	line->GetPointIds()->SetId(1,this->DebugGraphPointIds->GetPixel(neighborIndex));
 	this->DebugGraphLines->InsertNextCell(line);
       
 	this->DebugGraphEdgeWeights->InsertNextValue(weight);
 	}
-
-      //std::cout << "Set n-edge weight to " << weight << std::endl;
       } // end loop over neighbors
     } // end iteration over entire image
 
+  std::sort(groupEdges.begin(), groupEdges.end());
+  for(unsigned int edgeId = 0; edgeId < groupEdges.size(); )
+    {
+    uint64_t key = groupEdges[edgeId].first;
+    float weight = 0.0f;
+    for(; edgeId < groupEdges.size() && groupEdges[edgeId].first == key; ++edgeId)
+      {
+      weight += groupEdges[edgeId].second;
+      }
+
+    MaxFlowBackend::NodeId node1 = static_cast<MaxFlowBackend::NodeId>(key >> 32);
+    MaxFlowBackend::NodeId node2 = static_cast<MaxFlowBackend::NodeId>(key & 0xFFFFFFFF);
+    if(this->UseIntegerCapacities)
+      {
+      int quantizedWeight = QuantizeWeight(weight);
+      this->Graph->AddEdge(node1, node2, quantizedWeight, quantizedWeight);
+      }
+    else
+      {
+      this->Graph->AddEdge(node1, node2, weight, weight);
+      }
+    }
+
+  this->MaxNWeightSum = *(std::max_element(nWeightSums.begin(), nWeightSums.end()));
 }
 
-void ImageGraphCut::CreateTWeights()
+template <typename THistogram>
+void ImageGraphCut::ComputeAllTWeights(const THistogram* const foregroundHistogram,
+                                       const THistogram* const backgroundHistogram)
 {
-  std::cout << "CreateTWeights()" << std::endl;
-  ////////// Add t-edges and set t-edge weights (links from image nodes to virtual background and virtual foreground node) //////////
+  const unsigned int numberOfPixels = this->Image->GetLargestPossibleRegion().GetNumberOfPixels();
 
-  // Compute the histograms of the selected foreground and background pixels
-    
-  CreateHistograms();
-  
-  std::vector<unsigned int> channelsToUse;
-  if(this->IncludeColorInHistogram)
+  // The pixels are independent, so blocks of rows of them are computed on all cores (except when the debug arrays
+  // are filled)
+  if(this->Debug)
     {
-    channelsToUse.push_back(0);
-    channelsToUse.push_back(1);
-    channelsToUse.push_back(2);
+    ComputeTWeights(0, numberOfPixels, foregroundHistogram, backgroundHistogram);
+    return;
     }
-  if(this->IncludeDepthInHistogram)
+
+  const unsigned int width = this->Image->GetLargestPossibleRegion().GetSize()[0];
+  std::vector<int> rowBlocks = SplitRows(this->Image->GetLargestPossibleRegion().GetSize()[1]);
+  std::vector<QFuture<void> > futures;
+  for(unsigned int block = 0; block + 1 < rowBlocks.size(); ++block)
     {
-    channelsToUse.push_back(3);
+    futures.push_back(QtConcurrent::run(this, &ImageGraphCut::ComputeTWeights<THistogram>,
+                                        static_cast<unsigned int>(rowBlocks[block] * width),
+                                        static_cast<unsigned int>(rowBlocks[block + 1] * width),
+                                        foregroundHistogram, backgroundHistogram));
     }
-      
-  if(this->Debug)
+  for(unsigned int i = 0; i < futures.size(); ++i)
     {
-    std::cout << "Using channels ";
-    for(unsigned int i = 0; i < channelsToUse.size(); ++i)
-      {
-      std::cout << channelsToUse[i] << " ";
-      }
-    std::cout << " to create T-Weights." << std::endl;
-    unsigned int numberOfTuples = this->Image->GetLargestPossibleRegion().GetSize()[0] * this->Image->GetLargestPossibleRegion().GetSize()[1];
-    this->DebugGraphSinkWeights->SetNumberOfTuples(numberOfTuples);
-  
-    this->DebugGraphSourceWeights->SetNumberOfTuples(numberOfTuples);
-    
-    this->DebugGraphSourceHistogram->SetNumberOfTuples(numberOfTuples);
-    
-    this->DebugGraphSinkHistogram->SetNumberOfTuples(numberOfTuples);
-
+    futures[i].waitForFinished();
     }
-  itk::ImageRegionIterator<ImageType> imageIterator(this->Image, this->Image->GetLargestPossibleRegion());
-  itk::ImageRegionIterator<NodeImageType> nodeIterator(this->NodeImage, this->NodeImage->GetLargestPossibleRegion());
-  imageIterator.GoToBegin();
-  nodeIterator.GoToBegin();
-
-  // Since the t-weight function takes the log of the histogram value,
-  // we must handle bins with frequency = 0 specially (because log(0) = -inf)
-  // For empty histogram bins we use tinyValue instead of 0.
-  float tinyValue = 1e-10;
-  
-  // These are only for debuging/tracking
-  std::vector<float> sinkTWeights;
-  std::vector<float> sourceTWeights;
-  std::vector<float> sourceHistogramValues;
-  std::vector<float> sinkHistogramValues;
+}
 
-  std::vector<ImageType::InternalPixelType> minimumOfChannels =
-          ITKHelpers::ComputeMinOfAllChannels(this->Image.GetPointer());
-  std::vector<ImageType::InternalPixelType> maximumOfChannels =
-          ITKHelpers::ComputeMaxOfAllChannels(this->Image.GetPointer());
+template <typename THistogram>
+void ImageGraphCut::ComputeTWeights(const unsigned int firstPixel, const unsigned int endPixel,
+                                    const THistogram* const foregroundHistogram,
+                                    const THistogram* const backgroundHistogram)
+{
+  const unsigned int numberOfPixels = this->Image->GetLargestPossibleRegion().GetNumberOfPixels();
+  const float* const planes = &this->ImageChannelPlanes[0];
 
   // Use the colors only for the t-weights
-  unsigned int debugIteratorCounter = 0;
-  while(!imageIterator.IsAtEnd())
+  for(unsigned int pixelId = firstPixel; pixelId < endPixel; ++pixelId)
     {
-    PixelType pixel = imageIterator.Get();
-    //float sinkHistogramValue = 0.0;
-    //float sourceHistogramValue = 0.0;
-    float sinkHistogramValue = tinyValue;
-    float sourceHistogramValue = tinyValue;
-
-    if(pixel[4]) // Pixel is valid
+    if(!planes[4 * numberOfPixels + pixelId]) // Pixel is not valid
       {
-      //std::cout << "Pixels have size: " << pixel.Size() << std::endl;
-
-      HistogramType::MeasurementVectorType measurementVector(channelsToUse.size());
-      for(unsigned int component = 0; component < channelsToUse.size(); component++)
+      if(this->Debug)
         {
-        unsigned int channel = channelsToUse[component];
-        //measurementVector[component] = pixel[channel]; // Un-normalized
-
-        measurementVector[component] = (pixel[channel] - minimumOfChannels[channel])/(maximumOfChannels[channel] - minimumOfChannels[channel]);
+        this->DebugGraphSinkWeights->SetValue(pixelId, 0);
+        this->DebugGraphSourceWeights->SetValue(pixelId, 0);
+        this->DebugGraphSourceHistogram->SetValue(pixelId, 0);
+        this->DebugGraphSinkHistogram->SetValue(pixelId, 0);
         }
+      continue;
+      }
 
-      sinkHistogramValue = this->BackgroundHistogram->GetFrequency(this->BackgroundHistogram->GetIndex(measurementVector));
-      sourceHistogramValue = this->ForegroundHistogram->GetFrequency(this->ForegroundHistogram->GetIndex(measurementVector));
+    // Both histograms have the same bins
+    unsigned int bin = this->BinImage[pixelId];
 
-      // Convert the histogram value/frequency to make it as if it came from a normalized histogram
-      float normalizedSinkHistogramValue = sinkHistogramValue / static_cast<float>(this->BackgroundHistogram->GetTotalFrequency());
-      float normalizedSourceHistogramValue = sourceHistogramValue / static_cast<float>(this->ForegroundHistogram->GetTotalFrequency());
+    // NOTE! The sink weight t-link is set as a function of the FOREGROUND probability.
+    float sinkWeight = ComputeTEdgeWeight(foregroundHistogram->GetNegativeLogLikelihood(bin));
 
-      if(normalizedSinkHistogramValue <= 0)
-        {
-        normalizedSinkHistogramValue = tinyValue;
-        }
-      if(normalizedSourceHistogramValue <= 0)
-        {
-        normalizedSourceHistogramValue = tinyValue;
-        }
-	
-//       std::cout << "Original value: " << pixel[3] << " normalized value: " << measurementVector[0] 
-// 		<< " normalized source histogram count: " << normalizedSourceHistogramValue
-// 		<< " normalized sink histogram count: " << normalizedSinkHistogramValue << std::endl;
-// 		
-      //std::cout << "Setting background weight to: " << -this->Lambda*log(sinkHistogramValue) << std::endl;
-      //std::cout << "Setting foreground weight to: " << -this->Lambda*log(sourceHistogramValue) << std::endl;
+    // NOTE! The source weight t-link is set as a function of the BACKGROUND probability.
+    float sourceWeight = ComputeTEdgeWeight(backgroundHistogram->GetNegativeLogLikelihood(bin));
+
+    // Set the weights of the edges to the terminals
+    // See the table on p108 of "Interactive Graph Cuts for Optimal Boundary & Region Segmentation of Objects in N-D Images". 
+    this->SourceTWeights[pixelId] = sourceWeight;
+    this->SinkTWeights[pixelId] = sinkWeight;
+
+    if(this->Debug)
+      {
+      this->DebugGraphSinkWeights->SetValue(pixelId, sinkWeight);
+      this->DebugGraphSourceWeights->SetValue(pixelId, sourceWeight);
 
-      sinkHistogramValues.push_back(normalizedSinkHistogramValue);
-      sourceHistogramValues.push_back(normalizedSourceHistogramValue);
+      // The normalized histogram values
+      this->DebugGraphSourceHistogram->SetValue(pixelId, exp(-foregroundHistogram->GetNegativeLogLikelihood(bin)));
+      this->DebugGraphSinkHistogram->SetValue(pixelId, exp(-backgroundHistogram->GetNegativeLogLikelihood(bin)));
+      }
+    }
+}
 
-      //float sinkWeight = -this->Lambda*log(normalizedSinkHistogramValue);
-      // NOTE! The sink weight t-link is set as a function of the FOREGROUND probability.
-      float sinkWeight = ComputeTEdgeWeight(Helpers::NegativeLog(normalizedSourceHistogramValue));
-      sinkTWeights.push_back(sinkWeight);
+void ImageGraphCut::CreateTWeights()
+{
+  std::cout << "CreateTWeights()" << std::endl;
+  ////////// Add t-edges and set t-edge weights (links from image nodes to virtual background and virtual foreground node) //////////
 
-      //float sourceWeight = -this->Lambda*log(normalizedSourceHistogramValue);
-      // NOTE! The source weight t-link is set as a function of the BACKGROUND probability.
-      float sourceWeight = ComputeTEdgeWeight(Helpers::NegativeLog(normalizedSinkHistogramValue));
-      sourceTWeights.push_back(sourceWeight);
+  // Compute the histograms of the selected foreground and background pixels
+    
+  CreateHistograms();
+  
+  if(this->Debug)
+    {
+    unsigned int numberOfTuples = this->Image->GetLargestPossibleRegion().GetSize()[0] * this->Image->GetLargestPossibleRegion().GetSize()[1];
+    this->DebugGraphSinkWeights->SetNumberOfTuples(numberOfTuples);
+  
+    this->DebugGraphSourceWeights->SetNumberOfTuples(numberOfTuples);
+    
+    this->DebugGraphSourceHistogram->SetNumberOfTuples(numberOfTuples);
+    
+    this->DebugGraphSinkHistogram->SetNumberOfTuples(numberOfTuples);
 
-      // Add the edge to the graph and set its weight
-      // See the table on p108 of "Interactive Graph Cuts for Optimal Boundary & Region Segmentation of Objects in N-D Images". 
+    }
+  // The t-weights are stored per pixel and added to the graph later by ApplyTWeights()
+  unsigned int numberOfPixels = this->Image->GetLargestPossibleRegion().GetNumberOfPixels();
+  this->SourceTWeights.assign(numberOfPixels, 0.0f);
+  this->SinkTWeights.assign(numberOfPixels, 0.0f);
 
-      this->Graph->add_tweights(nodeIterator.Get(), sourceWeight, sinkWeight); // (node_id, source, sink)
+  if(this->UseSparseHistograms)
+    {
+    ComputeAllTWeights(&this->SparseForegroundHistogram, &this->SparseBackgroundHistogram);
+    }
+  else
+    {
+    ComputeAllTWeights(&this->ForegroundHistogram, &this->BackgroundHistogram);
+    }
 
-      if(this->Debug)
-        {
-        this->DebugGraphSinkWeights->SetValue(debugIteratorCounter, sinkWeight);
-        this->DebugGraphSourceWeights->SetValue(debugIteratorCounter, sourceWeight);
+  ComputeHardTWeight();
 
-        this->DebugGraphSourceHistogram->SetValue(debugIteratorCounter, normalizedSourceHistogramValue);
-        this->DebugGraphSinkHistogram->SetValue(debugIteratorCounter, normalizedSinkHistogramValue);
-        }
-      }
-    else
+  if(this->Debug)
+    {
+    // These are only for debuging/tracking
+    std::vector<float> sinkTWeights;
+    std::vector<float> sourceTWeights;
+    std::vector<float> sourceHistogramValues;
+    std::vector<float> sinkHistogramValues;
+    for(unsigned int pixelId = 0; pixelId < numberOfPixels; ++pixelId)
       {
-      this->Graph->add_tweights(nodeIterator.Get(), 0, 0);
-      if(this->Debug)
+      if(this->ImageChannelPlanes[4 * numberOfPixels + pixelId]) // Pixel is valid
         {
-        this->DebugGraphSinkWeights->SetValue(debugIteratorCounter, 0);
-        this->DebugGraphSourceWeights->SetValue(debugIteratorCounter, 0);
-        this->DebugGraphSourceHistogram->SetValue(debugIteratorCounter, 0);
-        this->DebugGraphSinkHistogram->SetValue(debugIteratorCounter, 0);
+        sinkTWeights.push_back(this->DebugGraphSinkWeights->GetValue(pixelId));
+        sourceTWeights.push_back(this->DebugGraphSourceWeights->GetValue(pixelId));
+        sourceHistogramValues.push_back(this->DebugGraphSourceHistogram->GetValue(pixelId));
+        sinkHistogramValues.push_back(this->DebugGraphSinkHistogram->GetValue(pixelId));
         }
       }
-    debugIteratorCounter++;
-    ++imageIterator;
-    ++nodeIterator;
-    }
 
-  if(this->Debug)
-    {
     std::cout << "Average sinkHistogramValue: " << Statistics::Average(sinkHistogramValues) << std::endl;
     std::cout << "Average sourceHistogramValue: " << Statistics::Average(sourceHistogramValues) << std::endl;
     
@@ -676,14 +2446,14 @@ void ImageGraphCut::SetHardSources(const std::vector<itk::Index<2> >& pixels)
   float valuesRange[2];
   this->DebugGraphSourceWeights->GetValueRange(valuesRange);
   
-  float highValue = std::numeric_limits<float>::max();
+  float highValue = this->HardTWeight;
   //float highValue = 2.;
   // See the table on p108 of "Interactive Graph Cuts for Optimal Boundary & Region Segmentation of Objects in N-D Images". 
   // We want to set the source link high and the sink link to zero
   for(unsigned int i = 0; i < pixels.size(); i++)
     {
     //std::cout << "Setting t-weight for node: " << this->NodeImage->GetPixel(pixels[i]) << " (pixel " << pixels[i] << ")" << std::endl;
-    this->Graph->add_tweights(this->NodeImage->GetPixel(pixels[i]), highValue, 0); // (node_id, source, sink);
+    this->SourceTWeights[this->Image->ComputeOffset(pixels[i])] += highValue;
     }
 }
 
@@ -694,7 +2464,7 @@ void ImageGraphCut::SetHardSinks(const std::vector<itk::Index<2> >& pixels)
   // See the table on p108 of "Interactive Graph Cuts for Optimal Boundary & Region Segmentation of Objects in N-D Images". 
   // We want to set the sink link high and the source link to zero. This means it is hard to cut the sink link, which is what we want.
   
-  float highValue = std::numeric_limits<float>::max();
+  float highValue = this->HardTWeight;
   //float highValue = 2.;
   
   // If we are creating the debugging PolyData, we want to use the max of the "normal" t-weights instead of the infinity value so the range for visualization is reasonable
@@ -703,8 +2473,106 @@ void ImageGraphCut::SetHardSinks(const std::vector<itk::Index<2> >& pixels)
   
   for(unsigned int i = 0; i < pixels.size(); i++)
     {
-    this->Graph->add_tweights(this->NodeImage->GetPixel(pixels[i]), 0, highValue); // (node_id, source, sink);
+    this->SinkTWeights[this->Image->ComputeOffset(pixels[i])] += highValue;
+    }
+}
+
+void ImageGraphCut::ComputeHardTWeight()
+{
+  // A pixel is forced to a terminal if its t-link to that terminal is more expensive to cut than all of its
+  // other links together. This is "K" in the table on p108 of "Interactive Graph Cuts for Optimal Boundary & Region
+  // Segmentation of Objects in N-D Images", increased by the largest t-weight because we keep the histogram
+  // t-weight of the other terminal.
+  float maxTWeight = std::max(*(std::max_element(this->SourceTWeights.begin(), this->SourceTWeights.end())),
+                              *(std::max_element(this->SinkTWeights.begin(), this->SinkTWeights.end())));
+  this->HardTWeight = 1.0f + this->MaxNWeightSum + maxTWeight;
+}
+
+void ImageGraphCut::ApplyTWeights(const bool updateExistingGraph)
+{
+  if(!updateExistingGraph)
+    {
+    this->GraphSourceTWeights.assign(this->SourceTWeights.size(), 0.0f);
+    this->GraphSinkTWeights.assign(this->SinkTWeights.size(), 0.0f);
+    }
+
+  // The N-weights to the fixed pixels belong to the t-weights in the graph
+  std::vector<float> sourceTWeights(this->SourceTWeights);
+  std::vector<float> sinkTWeights(this->SinkTWeights);
+  AddFixedPixelNWeights(&sourceTWeights, &sinkTWeights);
+
+  itk::ImageRegionConstIterator<NodeImageType> nodeIterator(this->NodeImage, this->NodeImage->GetLargestPossibleRegion());
+  nodeIterator.GoToBegin();
+
+  for(unsigned int pixelId = 0; pixelId < sourceTWeights.size(); ++pixelId, ++nodeIterator)
+    {
+    if(!this->UseGridGraph && nodeIterator.Get() == NoNode)
+      {
+      continue;
+      }
+
+    if(this->UseIntegerCapacities && !this->UseGridGraph)
+      {
+      // The old and the new weights are quantized separately, so that the deltas added to a node
+      // always sum up to exactly the quantized current weight
+      int sourceDelta = QuantizeWeight(sourceTWeights[pixelId]) - QuantizeWeight(this->GraphSourceTWeights[pixelId]);
+      int sinkDelta = QuantizeWeight(sinkTWeights[pixelId]) - QuantizeWeight(this->GraphSinkTWeights[pixelId]);
+      if(sourceDelta != 0 || sinkDelta != 0)
+        {
+        this->Graph->AddTWeights(nodeIterator.Get(), sourceDelta, sinkDelta);
+        if(updateExistingGraph)
+          {
+          this->Graph->MarkNode(nodeIterator.Get());
+          }
+        }
+      continue;
+      }
+
+    // Only the difference to the weights which are already in the graph is added
+    float sourceDelta = sourceTWeights[pixelId] - this->GraphSourceTWeights[pixelId];
+    float sinkDelta = sinkTWeights[pixelId] - this->GraphSinkTWeights[pixelId];
+    if(sourceDelta == 0 && sinkDelta == 0)
+      {
+      continue;
+      }
+
+    if(this->UseGridGraph)
+      {
+      this->GridGraph->add_tweights(GetGridNode(nodeIterator.GetIndex()), sourceDelta, sinkDelta);
+      }
+    else
+      {
+      this->Graph->AddTWeights(nodeIterator.Get(), sourceDelta, sinkDelta); // (node_id, source, sink)
+      if(updateExistingGraph)
+        {
+        this->Graph->MarkNode(nodeIterator.Get());
+        }
+      }
+    }
+
+  this->GraphSourceTWeights.swap(sourceTWeights);
+  this->GraphSinkTWeights.swap(sinkTWeights);
+}
+
+void ImageGraphCut::UpdateGraph()
+{
+  if(this->Debug)
+    {
+    std::cout << "UpdateGraph()" << std::endl;
+    }
+
+  // Only the t-weights are recomputed, and the edges if the difference function has changed (before the t-weights,
+  // which depend on the MaxNWeightSum and on the N-weights to the fixed pixels)
+  if(!this->GraphNWeights.empty())
+    {
+    UpdateGraphNWeights();
     }
+  CreateTWeights();
+
+  SetHardSinks(this->Sinks);
+  SetHardSources(this->Sources);
+
+  ApplyTWeights(true);
 }
 
 void ImageGraphCut::CreateGraph()
@@ -725,6 +2593,8 @@ void ImageGraphCut::CreateGraph()
   SetHardSinks(this->Sinks);
   SetHardSources(this->Sources);
 
+  ApplyTWeights(false);
+
   if(this->Debug)
     {
     AssembleAndWriteDebugGraph();
@@ -767,6 +2637,17 @@ Mask* ImageGraphCut::GetSegmentMask()
   return this->SegmentMask;
 }
 
+void ImageGraphCut::SetInitialSegmentation(const Mask* const mask)
+{
+  if(mask->GetLargestPossibleRegion() != this->Image->GetLargestPossibleRegion())
+    {
+    throw std::runtime_error("ImageGraphCut::SetInitialSegmentation: the mask must have the size of the image");
+    }
+
+  const Mask::PixelType* const buffer = mask->GetBufferPointer();
+  this->InitialSegmentation.assign(buffer, buffer + mask->GetLargestPossibleRegion().GetNumberOfPixels());
+}
+
 std::vector<itk::Index<2> > ImageGraphCut::GetSinks()
 {
   return this->Sinks;
@@ -856,6 +2737,82 @@ void ImageGraphCut::ConstructNeighborhoodIterator(NeighborhoodIteratorType* iter
   iterator->ActivateOffset(topRight);
 }
 
+std::vector<NeighborhoodIteratorType::OffsetType> ImageGraphCut::GetNeighborOffsets()
+{
+  std::vector<NeighborhoodIteratorType::OffsetType> neighbors;
+  NeighborhoodIteratorType iterator(ITKHelpers::Get1x1Radius(), this->Image, this->Image->GetLargestPossibleRegion());
+  ConstructNeighborhoodIterator(&iterator, neighbors);
+  return neighbors;
+}
+
+
+GridGraphType::node_id ImageGraphCut::GetGridNode(const itk::Index<2>& index)
+{
+  return this->GridGraph->node(index[0], index[1]);
+}
+
+void ImageGraphCut::ParallelGridMaxFlow()
+{
+  // Bisect the image (always across the longer side) until there are a few blocks per thread, so that blocks which
+  // take longer than others balance out, or until the blocks would get too small to be worth solving separately.
+  const unsigned int minimumBlockSize = 32;
+  const unsigned int numberOfBlocks = 4 * std::max(QThread::idealThreadCount(), 1);
+
+  std::vector<std::vector<itk::ImageRegion<2> > > levels(1,
+                  std::vector<itk::ImageRegion<2> >(1, this->Image->GetLargestPossibleRegion()));
+  while(levels.back().size() < numberOfBlocks)
+    {
+    std::vector<itk::ImageRegion<2> > blocks;
+    for(unsigned int i = 0; i < levels.back().size(); ++i)
+      {
+      const itk::ImageRegion<2>& region = levels.back()[i];
+      unsigned int dimension = (region.GetSize()[0] >= region.GetSize()[1]) ? 0 : 1;
+      if(region.GetSize()[dimension] < 2 * minimumBlockSize)
+        {
+        break;
+        }
+
+      itk::ImageRegion<2> first = region;
+      first.SetSize(dimension, region.GetSize()[dimension] / 2);
+      itk::ImageRegion<2> second = region;
+      second.SetIndex(dimension, region.GetIndex()[dimension] + first.GetSize()[dimension]);
+      second.SetSize(dimension, region.GetSize()[dimension] - first.GetSize()[dimension]);
+
+      blocks.push_back(first);
+      blocks.push_back(second);
+      }
+
+    // Every block of a level must be split, so that each block of the coarser level is the union of two blocks
+    if(blocks.size() != 2 * levels.back().size())
+      {
+      break;
+      }
+    levels.push_back(blocks);
+    }
+
+  // Solve the finest blocks first. Their flow stays in the residual capacities of the grid graph, so when two blocks
+  // are solved again as one block of the coarser level only the flow across the seam between them is left to find.
+  // The coarsest level is the whole image, so the final flow is the exact max-flow.
+  for(int level = static_cast<int>(levels.size()) - 1; level >= 0; --level)
+    {
+    std::vector<QFuture<GridGraphType::flowtype> > futures;
+    for(unsigned int i = 0; i < levels[level].size(); ++i)
+      {
+      const itk::ImageRegion<2>& block = levels[level][i];
+      futures.push_back(QtConcurrent::run(this->GridGraph, &GridGraphType::maxflow_region,
+                                          static_cast<int>(block.GetIndex()[0]),
+                                          static_cast<int>(block.GetIndex()[1]),
+                                          static_cast<int>(block.GetIndex()[0] + block.GetSize()[0]),
+                                          static_cast<int>(block.GetIndex()[1] + block.GetSize()[1])));
+      }
+
+    // Blocks of the same level are disjoint, but a coarser block needs both of its halves to be finished
+    for(unsigned int i = 0; i < futures.size(); ++i)
+      {
+      futures[i].waitForFinished();
+      }
+    }
+}
 
 float ImageGraphCut::ComputeNEdgeWeight(const float difference)
 {
@@ -865,7 +2822,7 @@ float ImageGraphCut::ComputeNEdgeWeight(const float difference)
 
   float sigma = this->Sigma;
   
-  return exp(-pow(difference,2)/(2.0*sigma*sigma));
+  return std::exp(-difference * difference / (2.0f * sigma * sigma));
 }
 
 float ImageGraphCut::ComputeTEdgeWeight(const float value)
@@ -873,6 +2830,24 @@ float ImageGraphCut::ComputeTEdgeWeight(const float value)
   return this->Lambda * value;
 }
 
+float ImageGraphCut::ComputeCapacityScale()
+{
+  // N-weights are at most 1 (see ComputeNEdgeWeight), so at most 8 of them meet at a pixel. A histogram t-weight is
+  // at most Lambda * -log(TinyHistogramValue) and the hard constraint weight at most 1 + 8 + that (see ComputeHardTWeight).
+  // A pixel can be a hard source and a hard sink at the same time, and add_tweights() adds the old residual t-capacity
+  // to the new weights, so the capacities stay below 2 * (2 * (histogram weight + hard weight)).
+  // The N-weights to fixed neighbors add at most 8 to a t-weight.
+  // A node of a pixel group adds up the weights of its pixels (hard constraints are only on single pixel nodes).
+  double maxHistogramTWeight = ComputeTEdgeWeight(-log(TinyHistogramValue));
+  double maxTWeight = maxHistogramTWeight + (1.0 + 8.0 + maxHistogramTWeight) + 8.0;
+  return static_cast<float>(std::numeric_limits<int>::max() / (4.0 * maxTWeight * this->MaxPixelsPerNode));
+}
+
+int ImageGraphCut::QuantizeWeight(const float weight)
+{
+  return static_cast<int>(floor(static_cast<double>(weight) * this->CapacityScale + 0.5));
+}
+
 float ImageGraphCut::ComputeAverageRandomDifferences(const unsigned int numberOfDifferences)
 {
   float sum = 0.0f;
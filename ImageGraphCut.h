@@ -29,42 +29,78 @@ class vtkFloatArray;
 
 // ITK
 #include "itkImage.h"
-#include "itkSampleToHistogramFilter.h"
-#include "itkHistogram.h"
-#include "itkListSample.h"
 
 // STL
+#include <string>
 #include <vector>
 
 // Custom
 #include "Types.h"
 #include "Difference.hpp"
+#include "NWeightKernels.hpp"
+#include "FlatHistogram.h"
+#include "SparseHistogram.h"
+#include "ImageStatistics.h"
 
-// Kolmogorov's code
-#include "graph.h"
-typedef Graph GraphType;
+// Max-flow solvers (Kolmogorov's graph and alternatives, selected by name)
+#include "MaxFlowBackend.h"
+
+// Superpixels for the superpixel graph mode
+#include "SLICSuperpixels.h"
+
+// Grid-specialized max-flow (implicit node ids, per-direction capacity arrays)
+#include "gridgraph.h"
+typedef GridGraph GridGraphType;
 
 // This is a special type to keep track of the graph node labels
-typedef itk::Image<void*, 2> NodeImageType;
+typedef itk::Image<MaxFlowBackend::NodeId, 2> NodeImageType;
 
-typedef itk::Statistics::Histogram< float,
-        itk::Statistics::DenseFrequencyContainer2 > HistogramType;
 
 
 class ImageGraphCut
 {
 public:
   ImageGraphCut();
+  ~ImageGraphCut();
 
-  Difference* DifferenceFunction;
+  /** Set the function used to compute the N-weights. The ImageGraphCut takes ownership of 'difference'.
+   *  If it is not equal to the current difference function, the N-weights are recomputed. A persistent pixel graph
+   *  whose edges can be updated (see MaxFlowBackend::SupportsEdgeUpdates) is kept: the next PerformSegmentation
+   *  changes its edges and continues from the residual flow, which gives the same cut as a new graph. Any other
+   *  persistent graph is discarded. */
+  void SetDifferenceFunction(Difference* const difference);
 
   /** Several initializations are done here */
   void SetImage(const ImageType* const image);
   ImageType::Pointer GetImage();
+
+  /** Get the per-channel statistics of the image (computed once by SetImage) */
+  const ImageStatistics& GetImageStatistics() const;
   
   /** Create and cut the graph (The main driver function) */
   void PerformSegmentation();
 
+  /** Compute the segmentations for all of the given lambdas and for the current Lambda on one persistent graph (only
+   *  the t-weights change between them, so every max-flow continues from the residual flow of the previous one).
+   *  The segmentation of every swept lambda is stored, so SetSegmentMaskFromLambdaSweep can show any of them without
+   *  cutting again. Lambda and the other settings are not changed, and the output segmentation is the one at Lambda. */
+  void PerformLambdaSweep(const std::vector<float>& lambdas);
+
+  /** Set the output segmentation to the one computed by PerformLambdaSweep at the swept lambda closest to 'lambda',
+   *  and return that lambda. Throws std::runtime_error if there is no lambda sweep for the current image. */
+  float SetSegmentMaskFromLambdaSweep(const float lambda);
+
+  /** Get the lambdas of the last PerformLambdaSweep in ascending order */
+  const std::vector<float>& GetSweptLambdas() const;
+
+  /** Get the lambda breakpoints computed by PerformLambdaSweep: the smallest swept lambda from which on a pixel is
+   *  in the foreground at all larger swept lambdas (infinity if it is not even at the largest one). A pixel which is
+   *  in the foreground at some lambda but not at a larger one has no such breakpoint and is NaN. */
+  FloatScalarImageType* GetLambdaBreakpointImage();
+
+  /** Get the number of pixels whose breakpoint is NaN (see GetLambdaBreakpointImage) */
+  unsigned int GetNumberOfUnnestedPixels() const;
+
   /** Get the masked output image */
   ImageType::Pointer GetMaskedOutput();
 
@@ -85,6 +121,13 @@ public:
   /** Get the output of the segmentation */
   Mask* GetSegmentMask();
 
+  /** Start the next PerformSegmentation from 'mask' (e.g. the result of a previous cut with other settings): only a
+   *  band of InitialSegmentationBandRadius pixels around its boundary (and around the seeds it contradicts) is
+   *  re-solved with a pixel graph, and the other pixels keep their segment in 'mask'. The mask is only used once.
+   *  The cut is approximate (it is not re-solved outside of the band), so this is only done if it is called, and a
+   *  persistent graph which can be reused takes precedence over it. */
+  void SetInitialSegmentation(const Mask* const mask);
+
   /** Set the weight between the regional and boundary terms */
   void SetLambda(const float);
 
@@ -97,19 +140,297 @@ public:
   bool IncludeColorInHistogram;
 
   unsigned int NumberOfHistogramComponents;
+
+  /** Above this number of bins (NumberOfHistogramBins to the power of the number of histogram channels) the
+   *  histograms only store their non-empty bins (see SparseHistogram) instead of a flat array of all bins */
+  unsigned int SparseHistogramThreshold;
   
   bool SecondStep;
   
   float BackgroundThreshold;
 
+  /** The name of the max-flow backend the graph is built with (see MaxFlowBackend::GetNames). Defaults to "BK".
+   *  Not used together with UseGridGraph. */
+  std::string MaxFlowBackendName;
+
+  /** Use the grid-specialized max-flow (GridGraph) instead of the general graph of a MaxFlowBackend.
+   *  Node ids are implicit from the pixel index, which uses several times less memory. */
+  bool UseGridGraph;
+
+  /** Keep the graph alive between calls to PerformSegmentation (dynamic graph cuts). As long as the image does not
+   *  change, only the t-weights (and after SetDifferenceFunction the edges, with the "BK" backend) are updated and
+   *  the max-flow reuses the residual flow (and with the "BK" backend the search trees) of the previous cut. Not
+   *  supported together with UseGridGraph or with backends which cannot be re-solved (see MaxFlowBackend::SupportsReuse). */
+  bool PersistentGraph;
+
+  /** Build the graph with 32-bit integer capacities instead of float capacities. The N- and T-weights
+   *  are multiplied by CapacityScale and rounded. Not used together with UseGridGraph. */
+  bool UseIntegerCapacities;
+
+  /** Map the memory of the graph with transparent huge pages (Linux only), see GraphMemory */
+  bool UseHugePages;
+
+  /** Compute the max-flow of the GridGraph on all cores: the image is split into blocks which are solved concurrently,
+   *  and neighboring blocks are merged and re-solved from the residual flow until the whole image is solved, so the
+   *  result is the exact (globally optimal) cut. Only used together with UseGridGraph. */
+  bool UseParallelMaxFlow;
+
+  /** Build the graph on SLIC superpixels (see SLICSuperpixels) instead of pixels. The N-weights between two superpixels
+   *  are the sums of the N-weights of their neighboring pixels and the t-weights of a superpixel are the sums of the
+   *  t-weights of its pixels. The pixels with hard constraints stay nodes of their own. The superpixels are computed
+   *  once per image. The graph is rebuilt for every cut (PersistentGraph is ignored). Not used together with UseGridGraph. */
+  bool UseSuperpixels;
+
+  /** The approximate number of pixels per superpixel */
+  unsigned int SuperpixelSize;
+
+  /** If it is not 0, the superpixel segmentation is refined by a pixel graph cut in a band of this radius around its
+   *  boundary (the pixels outside of the band keep their segment) */
+  unsigned int SuperpixelRefinementRadius;
+
+  /** Solve the cut on the image downsampled by CoarseToFineFactor first (the graph nodes are blocks of pixels, built like
+   *  the superpixel nodes), then re-solve a band of CoarseToFineFactor pixels around the upsampled boundary at full
+   *  resolution with all other pixels fixed. Takes precedence over UseSuperpixels. Not used together with UseGridGraph. */
+  bool UseCoarseToFine;
+
+  unsigned int CoarseToFineFactor;
+
+  /** The pixels with hard constraints are not nodes of the graph: their segment is fixed, and the N-weights between
+   *  them and their neighbors are added to the t-weights of the neighbors. A persistent graph is only reused while
+   *  its fixed pixels are still seeds of the same kind. Not used together with UseGridGraph. */
+  bool ContractHardSeeds;
+
+  /** The invalid pixels (which have no N-weights and no histogram t-weights) which are not seeds are not nodes of the
+   *  graph either; they are background in the segmentation. Not used together with UseGridGraph. */
+  bool DropInvalidPixels;
+
+  /** Split a new pixel graph into its connected components (the free pixels joined by positive N-weights, see
+   *  DropInvalidPixels) and solve each component with a graph of its own, on all cores. A component whose pixels all
+   *  have the larger t-weight to the same terminal is labelled without a max-flow. The cut is that of the whole graph.
+   *  Off by default. The components are solved once and thrown away, so it is ignored with PersistentGraph (which
+   *  LidarSegmentationWidget uses), and it is not used together with UseGridGraph, pixel groups or Debug. */
+  bool SolveComponentsSeparately;
+
+  /** Before the components are solved, fix the pixels whose t-weight difference is larger than the sum of their
+   *  N-weights to the free pixels (label persistency), fold their N-weights into the t-weights of their neighbors and
+   *  repeat for the neighbors until no more pixels can be fixed. Off by default, and only used when
+   *  SolveComponentsSeparately is used (so never with PersistentGraph).
+   *  The cut does not change with float capacities. With UseIntegerCapacities the pixels are still fixed on the float
+   *  weights, and the folded t-weights are rounded as sums instead of weight by weight, so pixels whose t-weight
+   *  difference is within the rounding of their N-weights can end up in another segment than without the reduction. */
+  bool UsePersistencyReduction;
+
+  /** The radius of the band which is re-solved around an initial segmentation (see SetInitialSegmentation) */
+  unsigned int InitialSegmentationBandRadius;
+
+  /** After the cut, keep the (4-connected) components of the foreground which contain a source seed instead of only
+   *  the largest component */
+  bool KeepSourceSeedComponents;
+
 protected:
 
+  /** The function used to compute the N-weights */
+  Difference* DifferenceFunction;
+
   float ComputeAverageRandomDifferences(const unsigned int numberOfDifferences);
   
   void CreateGraphNodes();
-  
-  /** A Kolmogorov graph object */
-  GraphType* Graph;
+
+  /** Store the node of every free pixel in the NodeImage (consecutive ids, NoNode for the fixed pixels) and return the
+   *  number of nodes */
+  unsigned int CreatePixelNodeImage();
+
+  /** The max-flow graph */
+  MaxFlowBackend* Graph;
+
+  /** The memory of the node and arc arrays of the Graph ("BK" backend only), which is kept for the next graph of the
+   *  same image. The graph of RefineSegmentationBand uses it too, so the Graph must be deleted before. */
+  GraphArena* GraphMemory;
+
+  /** Get the GraphMemory, created (again) if it does not exist or if UseHugePages has changed */
+  GraphArena* GetGraphMemory();
+
+  /** The memory of the component graphs of SolveComponents, one for every core, kept for the next cut of the image */
+  std::vector<GraphArena*> ComponentGraphMemory;
+
+  /** Delete the GraphMemory and the ComponentGraphMemory */
+  void DeleteGraphMemory();
+
+  /** The backend name and capacity type the current Graph was created with */
+  std::string GraphBackendName;
+  bool GraphHasIntegerCapacities;
+
+  /** Whether the edges of the current Graph are the pixel edges set by SetPixelEdges */
+  bool GraphHasPixelEdges;
+
+  /** The N-weights the edges of the persistent Graph were set with, if they have changed since (see
+   *  SetDifferenceFunction); empty otherwise */
+  std::vector<float> GraphNWeights;
+
+  /** Change the edges of the persistent Graph from the GraphNWeights to the NWeights and mark their nodes */
+  void UpdateGraphNWeights();
+
+  /** The factor the weights of an integer Graph are multiplied by before they are rounded */
+  float CapacityScale;
+
+  /** Compute the largest CapacityScale for which no capacity of an integer Graph can overflow with the current Lambda */
+  float ComputeCapacityScale();
+
+  /** Scale a weight by CapacityScale and round it to the integer capacity type */
+  int QuantizeWeight(const float weight);
+
+  /** Whether the graph nodes are groups of pixels (superpixels or the blocks of UseCoarseToFine) */
+  bool UsePixelGroups() const;
+
+  /** The pixel group labels of the image, their number, and the SuperpixelSize or CoarseToFineFactor they were computed with */
+  SLICSuperpixels::LabelImageType::Pointer PixelGroupLabels;
+  unsigned int NumberOfPixelGroups;
+  unsigned int PixelGroupLabelsSize;
+  bool PixelGroupLabelsAreBlocks;
+
+  /** The largest number of pixels which share a graph node (1 unless UsePixelGroups) */
+  unsigned int MaxPixelsPerNode;
+
+  /** Compute the PixelGroupLabels if the current ones were not computed with the current settings */
+  void ComputePixelGroupLabels();
+
+  /** Store the group node of every pixel in the NodeImage (the pixels with hard constraints which are not fixed get
+   *  nodes of their own) and return the number of nodes */
+  unsigned int CreatePixelGroupNodeImage();
+
+  enum FixedPixelType {FreePixel = 0, FixedSourcePixel = 1, FixedSinkPixel = 2};
+
+  /** Whether each pixel of the graph is a node (FreePixel) or fixed to a terminal without a node (FixedSourcePixel or
+   *  FixedSinkPixel, see ContractHardSeeds and DropInvalidPixels), and the ids of the valid fixed pixels (the others
+   *  have no N-weights) */
+  std::vector<unsigned char> FixedPixels;
+  std::vector<unsigned int> FixedPixelIds;
+
+  /** Get whether each pixel is a source seed (FixedSourcePixel), a sink seed (FixedSinkPixel) or neither (FreePixel,
+   *  also for a pixel which is both) */
+  std::vector<unsigned char> ComputeSeedLabels();
+
+  /** Get the FixedPixels for the current seeds and settings */
+  std::vector<unsigned char> ComputeFixedPixels();
+
+  /** Set the FixedPixels of a new graph */
+  void FixPixels();
+
+  /** Whether all FixedPixels are still fixed to the same terminal */
+  bool FixedPixelsAreCurrent();
+
+  /** Add the N-weights between the fixed pixels and their free neighbors to the t-weights of the neighbors */
+  void AddFixedPixelNWeights(std::vector<float>* const sourceTWeights, std::vector<float>* const sinkTWeights);
+
+  /** The N-weight between every pixel and each of its neighbors in the order of ConstructNeighborhoodIterator, stored as
+   *  one plane of all pixels per neighbor. It is 0 if the neighbor is outside of the image or either pixel is invalid.
+   *  Computed by CreateNWeights and also used by RefineSegmentationBand. They are cached (with the Sigma they were
+   *  computed with) until the image or the difference function change; empty if they have to be recomputed. */
+  std::vector<float> NWeights;
+
+  /** Compute the NWeights with the DifferenceKernel which matches the DifferenceFunction */
+  void ComputeNWeights();
+
+  /** Compute the Sigma and the NWeights if they are not cached */
+  void UpdateNWeights();
+
+  /** The channels of the Image as planes (all pixels of channel 0, then all of channel 1, ...), made by SetImage */
+  std::vector<float> ImageChannelPlanes;
+
+  /** The statistics of the Image, computed by SetImage */
+  ImageStatistics Statistics;
+
+  /** Compute the NWeights from the ImageChannelPlanes with the difference kernel TKernel ('weights' are passed on to
+   *  it), using the fastest row kernel of NWeightKernels.hpp the CPU supports. Blocks of rows are computed on all cores. */
+  template <typename TKernel>
+  void ComputeNWeights(const float* const weights);
+
+  /** Compute the rows y0 ... y1-1 of all NWeights planes with 'computeRow' */
+  void ComputeNWeightRows(NWeightRowFunction computeRow, const float* const weights, const int y0, const int y1);
+
+  /** Count the edges of a pixel Graph from the pixels in rows y0 ... y1-1 to their neighbors (the edges between
+   *  two nodes) */
+  unsigned int CountPixelEdges(const int y0, const int y1);
+
+  /** Set the edges of the pixels in rows y0 ... y1-1 of a pixel Graph, whose edges were all added at once, starting
+   *  with 'firstEdge' (see CreateNWeights). Returns the largest sum of the N-weights incident to one of these pixels. */
+  float SetPixelEdges(const MaxFlowBackend::EdgeId firstEdge, const int y0, const int y1);
+
+  /** Add the difference between the NWeights and the GraphNWeights to the edges of the pixels in rows y0 ... y1-1
+   *  (numbered as in SetPixelEdges) and mark their nodes. Returns the edge after the last one of these pixels. */
+  MaxFlowBackend::EdgeId UpdatePixelEdges(const MaxFlowBackend::EdgeId firstEdge, const int y0, const int y1);
+
+  /** Get the largest sum of the N-weights incident to one of the pixels in rows y0 ... y1-1 */
+  float ComputeMaxNWeightSum(const int y0, const int y1);
+
+  /** Recompute the segmentation in a band of 'bandRadius' pixels around its boundary with a pixel graph */
+  void RefineSegmentationBand(const unsigned int bandRadius);
+
+  /** Compute the NWeights (if they are not cached), the MaxNWeightSum and the t-weights of a pixel graph, including
+   *  the hard constraints */
+  void ComputePixelWeights();
+
+  /** The segmentation set by SetInitialSegmentation (in buffer order), empty if there is none */
+  std::vector<Mask::PixelType> InitialSegmentation;
+
+  /** Segment by re-solving a band around the InitialSegmentation */
+  void RefineInitialSegmentation();
+
+  /** Segment a new pixel graph component by component (see SolveComponentsSeparately) */
+  void SolveComponents();
+
+  /** Link every free pixel of rows y0 ... y1-1 in ComponentParents to its free neighbors in rows
+   *  neighborY0 ... neighborY1-1 which it has a positive N-weight to */
+  void LinkGraphComponentRows(const int y0, const int y1, const int neighborY0, const int neighborY1);
+
+  /** Build the graph of a component, compute its max-flow and write the segment of its pixels to the SegmentMask */
+  void SolveComponent(const unsigned int component, GraphArena* const memory);
+
+  /** Solve 'components' one after another, with their graphs in 'memory' */
+  void SolveComponentList(const std::vector<unsigned int>& components, GraphArena* const memory);
+
+  /** Fix the persistent pixels (see UsePersistencyReduction) and add their N-weights to the GraphSourceTWeights and
+   *  GraphSinkTWeights of their free neighbors */
+  void ReducePersistentPixels();
+
+  /** Compute the FreeNWeightSums of the free pixels in rows y0 ... y1-1 and return those which are persistent */
+  std::vector<unsigned int> FindPersistentPixelRows(const int y0, const int y1);
+
+  /** Get the terminal a free pixel is fixed to by persistency (FreePixel if it is not persistent) */
+  unsigned char GetPersistentLabel(const unsigned int pixelId) const;
+
+  /** The sum of the N-weights between every free pixel and its free neighbors, used by ReducePersistentPixels */
+  std::vector<float> FreeNWeightSums;
+
+  /** The pixels of all components of SolveComponents, sorted by component (the pixels of component c start at
+   *  ComponentFirstPixels[c]). The NodeImage holds the node of every pixel in the graph of its component. */
+  std::vector<unsigned int> ComponentPixels;
+  std::vector<unsigned int> ComponentFirstPixels;
+
+  /** Remove the components of the foreground of the SegmentMask which are not kept (see KeepSourceSeedComponents).
+   *  The components are found by a union-find over blocks of rows on all cores. */
+  void FilterSegmentComponents();
+
+  /** Link every foreground pixel of rows y0 ... y1-1 to a pixel of its component within these rows in
+   *  ComponentParents. Every pixel is linked to a smaller pixel id and the smallest one of a component to itself. */
+  void LinkComponentRows(const int y0, const int y1);
+
+  /** Only keep the foreground pixels of rows y0 ... y1-1 whose component (root in ComponentParents) is kept */
+  void KeepComponentRows(const int y0, const int y1);
+
+  /** The union-find parent of every pixel and whether the component of each root pixel is kept, used by
+   *  FilterSegmentComponents */
+  std::vector<unsigned int> ComponentParents;
+  std::vector<unsigned char> IsKeptComponent;
+
+  /** The grid graph object (used instead of Graph if UseGridGraph is set) */
+  GridGraphType* GridGraph;
+
+  /** Get the grid graph node of a pixel */
+  GridGraphType::node_id GetGridNode(const itk::Index<2>& index);
+
+  /** Compute the max-flow of the GridGraph by hierarchical block decomposition (see UseParallelMaxFlow) */
+  void ParallelGridMaxFlow();
 
   /** The output segmentation */
   Mask::Pointer SegmentMask;
@@ -129,27 +450,90 @@ protected:
   /** An image which keeps tracks of the mapping between pixel index and graph node id */
   NodeImageType::Pointer NodeImage;
 
-  /** Create the histograms from the users selections */
+  /** The lambdas of the last PerformLambdaSweep in ascending order, and the foreground of the segmentation at each of
+   *  them with one bit per pixel (in the order of the pixels in the image buffer) */
+  std::vector<float> SweptLambdas;
+  std::vector<std::vector<bool> > SweptSegmentations;
+
+  /** The smallest lambda from which on each pixel is in the foreground (see GetLambdaBreakpointImage) */
+  FloatScalarImageType::Pointer LambdaBreakpointImage;
+  unsigned int NumberOfUnnestedPixels;
+
+  /** Create the histograms from the users selections. The histograms are kept between cuts and only the seeds which
+   *  were added or removed since the last cut are counted, unless the image or the binning changed. */
   void CreateHistograms();
-  const HistogramType* CreateHistogram(std::vector<itk::Index<2> > pixels, std::vector<unsigned int> channelsToUse);
-  //void CreateHistogram(std::vector<itk::Index<2> > pixels, std::vector<unsigned int> channelsToUse, const HistogramType*);
+
+  /** Update 'histogram', which counts 'countedSeeds', to count 'seeds' instead, and set 'countedSeeds' to 'seeds' */
+  template <typename THistogram>
+  void UpdateHistogram(const std::vector<itk::Index<2> >& seeds, std::vector<itk::Index<2> >* const countedSeeds,
+                       THistogram* const histogram);
+
+  /** Add (or remove, if 'add' is false) the valid pixels first ... end-1 of 'seeds' to 'histogram' */
+  template <typename THistogram>
+  void CountSeeds(const std::vector<itk::Index<2> >& seeds, const unsigned int first, const unsigned int end,
+                  const bool add, THistogram* const histogram);
 
   /** Create a Kolmogorov graph structure from the image and selections */
   void CreateGraphManually();
   void CreateGraph();
   void CreateNWeights();
   void CreateTWeights();
-  
-  /** Perform the s-t min cut */
-  void CutGraph();
+
+  /** Compute the SourceTWeights and SinkTWeights of all pixels from the foreground and background histograms */
+  template <typename THistogram>
+  void ComputeAllTWeights(const THistogram* const foregroundHistogram, const THistogram* const backgroundHistogram);
+
+  /** Compute the SourceTWeights and SinkTWeights of the pixels firstPixel ... endPixel-1 from the histograms */
+  template <typename THistogram>
+  void ComputeTWeights(const unsigned int firstPixel, const unsigned int endPixel,
+                       const THistogram* const foregroundHistogram, const THistogram* const backgroundHistogram);
+
+  /** Recompute the t-weights (and the changed N-weights) of the persistent graph and mark the nodes whose weights
+   *  changed */
+  void UpdateGraph();
+
+  /** Add SourceTWeights and SinkTWeights to the graph. If 'updateExistingGraph' is true, only the difference
+   *  to the t-weights already in the graph is added and the changed nodes are marked for the next maxflow. */
+  void ApplyTWeights(const bool updateExistingGraph);
+
+  /** Delete the graph (if there is one) */
+  void DeleteGraph();
+
+  /** Perform the s-t min cut. If 'reuseTrees' is true, the search trees of the previous cut are reused. */
+  void CutGraph(const bool reuseTrees = false);
 
   /** Several times throughout the algorithm we will need to traverse the image, looking exactly once at each edge. This iterator
    * creation is lengthy, so we do it once in this function and call it from everywhere we need it. */
   void ConstructNeighborhoodIterator(NeighborhoodIteratorType* iterator, std::vector<NeighborhoodIteratorType::OffsetType>& neighbors);
 
-  /** The histograms of the source and sink pixels */
-  const HistogramType* ForegroundHistogram;
-  const HistogramType* BackgroundHistogram;
+  /** The offsets of the neighbors every pixel has an edge to, in the order of ConstructNeighborhoodIterator */
+  std::vector<NeighborhoodIteratorType::OffsetType> GetNeighborOffsets();
+
+  /** The bins of the histograms (over the color and/or depth channels, see IncludeColorInHistogram) */
+  HistogramBinning TWeightBinning;
+
+  /** The TWeightBinning bin of every pixel, computed with BinImageBinning. It is kept while the image and the binning
+   *  stay the same (empty if it has to be recomputed). */
+  std::vector<unsigned int> BinImage;
+  HistogramBinning BinImageBinning;
+
+  /** Compute the BinImage of TWeightBinning (blocks of rows on all cores) */
+  void ComputeBinImage();
+
+  /** Compute the BinImage of the rows y0 ... y1-1 */
+  void ComputeBinImageRows(const int y0, const int y1);
+
+  /** The histograms of the source and sink pixels. Only the flat or the sparse ones are used, depending on
+   *  UseSparseHistograms (the others are empty). */
+  FlatHistogram ForegroundHistogram;
+  FlatHistogram BackgroundHistogram;
+  SparseHistogram SparseForegroundHistogram;
+  SparseHistogram SparseBackgroundHistogram;
+  bool UseSparseHistograms;
+
+  /** The Sources and Sinks the histograms count */
+  std::vector<itk::Index<2> > HistogramSources;
+  std::vector<itk::Index<2> > HistogramSinks;
 
   /** The image to be segmented */
   ImageType::Pointer Image;
@@ -175,6 +559,28 @@ protected:
   std::vector<float> AllColorDifferences;
 
   float Sigma;
+
+  /** The t-weights of every pixel (in buffer order) for the current cut, including the hard constraints */
+  std::vector<float> SourceTWeights;
+  std::vector<float> SinkTWeights;
+
+  /** The t-weights which have been added to the persistent graph (with SolveComponents, those of the component graphs) */
+  std::vector<float> GraphSourceTWeights;
+  std::vector<float> GraphSinkTWeights;
+
+  /** The largest sum of the N-weights incident to a single pixel */
+  float MaxNWeightSum;
+
+  /** The t-weight which forces a pixel to a terminal ("K" in Boykov and Jolly, ICCV 2001).
+   *  It is finite so that hard constraints can be removed from a persistent graph again. */
+  float HardTWeight;
+
+  void ComputeHardTWeight();
+
+private:
+  // The graph is owned by this object, so it must not be copied
+  ImageGraphCut(const ImageGraphCut&);
+  void operator=(const ImageGraphCut&);
 };
 
 #endif
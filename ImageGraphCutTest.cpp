@@ -0,0 +1,152 @@
+/*
+Checks that ImageGraphCut can start from an initial segmentation while it keeps a persistent graph: the cut from the
+initial segmentation has no persistent graph to keep, and the next cut must build one and give the same segmentation
+as an ImageGraphCut which never had an initial segmentation. A lambda sweep with a pending initial segmentation is
+checked as well. Returns 0 if all checks pass.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// STL
+#include <vector>
+
+#include "ImageGraphCut.h"
+
+static unsigned int NumberOfFailures = 0;
+
+/** A noisy image with a bright square on a dark background; all pixels are valid */
+static ImageType::Pointer CreateSquareImage(const int width, const int height)
+{
+  itk::Index<2> corner = {{0, 0}};
+  itk::Size<2> size;
+  size[0] = width;
+  size[1] = height;
+  ImageType::Pointer image = ImageType::New();
+  image->SetNumberOfComponentsPerPixel(5);
+  image->SetRegions(itk::ImageRegion<2>(corner, size));
+  image->Allocate();
+
+  float* const buffer = image->GetBufferPointer();
+  for(int y = 0; y < height; ++y)
+    {
+    for(int x = 0; x < width; ++x)
+      {
+      const bool inSquare = x >= width / 4 && x < 3 * width / 4 && y >= height / 4 && y < 3 * height / 4;
+      float* const pixel = buffer + 5 * (y * width + x);
+      for(unsigned int component = 0; component < 4; ++component)
+        {
+        pixel[component] = (inSquare ? 0.7f : 0.3f) + 0.2f * (rand() / static_cast<float>(RAND_MAX) - 0.5f);
+        }
+      pixel[4] = 1.0f;
+      }
+    }
+  return image;
+}
+
+/** Set the image, the settings and the seeds (a few pixels in the middle of the square and along the border) */
+static void SetUp(ImageGraphCut& graphCut, const ImageType* const image)
+{
+  const itk::Size<2> size = image->GetLargestPossibleRegion().GetSize();
+  const int width = size[0];
+  const int height = size[1];
+
+  graphCut.SetImage(image);
+  graphCut.PersistentGraph = true;
+  graphCut.IncludeColorInHistogram = true;
+  graphCut.IncludeDepthInHistogram = false;
+  graphCut.SetDifferenceFunction(new ColorDifference);
+  graphCut.SetNumberOfHistogramBins(10);
+  graphCut.SetLambda(0.01f);
+
+  std::vector<itk::Index<2> > sources;
+  std::vector<itk::Index<2> > sinks;
+  for(int i = -2; i <= 2; ++i)
+    {
+    itk::Index<2> source = {{width / 2 + i, height / 2}};
+    sources.push_back(source);
+    }
+  for(int x = 0; x < width; ++x)
+    {
+    itk::Index<2> top = {{x, 0}};
+    itk::Index<2> bottom = {{x, height - 1}};
+    sinks.push_back(top);
+    sinks.push_back(bottom);
+    }
+  graphCut.SetSources(sources);
+  graphCut.SetSinks(sinks);
+}
+
+static std::vector<Mask::PixelType> GetSegmentation(ImageGraphCut& graphCut)
+{
+  Mask* const mask = graphCut.GetSegmentMask();
+  const Mask::PixelType* const buffer = mask->GetBufferPointer();
+  return std::vector<Mask::PixelType>(buffer, buffer + mask->GetLargestPossibleRegion().GetNumberOfPixels());
+}
+
+static void Compare(const char* const test, const std::vector<Mask::PixelType>& expected,
+                    const std::vector<Mask::PixelType>& segmentation)
+{
+  unsigned int numberOfDifferences = 0;
+  for(unsigned int pixelId = 0; pixelId < expected.size(); ++pixelId)
+    {
+    numberOfDifferences += (expected[pixelId] != 0) != (segmentation[pixelId] != 0);
+    }
+  if(numberOfDifferences > 0)
+    {
+    printf("%s: %u pixels differ\n", test, numberOfDifferences);
+    NumberOfFailures++;
+    }
+}
+
+int main(int, char*[])
+{
+  const int width = 48;
+  const int height = 32;
+  srand(1);
+  ImageType::Pointer image = CreateSquareImage(width, height);
+
+  // The Sigma of the N-weights is estimated from random pixel pairs, so every ImageGraphCut computes its N-weights
+  // from the same random numbers
+  ImageGraphCut expectedGraphCut;
+  SetUp(expectedGraphCut, image);
+  srand(2);
+  expectedGraphCut.PerformSegmentation();
+  std::vector<Mask::PixelType> expected = GetSegmentation(expectedGraphCut);
+
+  // An initial segmentation which is the left half of the image
+  Mask::Pointer initialSegmentation = Mask::New();
+  initialSegmentation->SetRegions(image->GetLargestPossibleRegion());
+  initialSegmentation->Allocate();
+  Mask::PixelType* const initialBuffer = initialSegmentation->GetBufferPointer();
+  for(int pixelId = 0; pixelId < width * height; ++pixelId)
+    {
+    initialBuffer[pixelId] = (pixelId % width < width / 2) ? 255 : 0;
+    }
+
+  ImageGraphCut graphCut;
+  SetUp(graphCut, image);
+  graphCut.SetInitialSegmentation(initialSegmentation);
+  srand(2);
+  graphCut.PerformSegmentation();
+  graphCut.PerformSegmentation();
+  Compare("Cut after the initial segmentation", expected, GetSegmentation(graphCut));
+
+  // The persistent graph of the previous cut is reused
+  graphCut.PerformSegmentation();
+  Compare("Cut on the persistent graph", expected, GetSegmentation(graphCut));
+
+  // A lambda sweep cuts its first lambda from a pending initial segmentation too, and ends with the cut at Lambda
+  ImageGraphCut sweepGraphCut;
+  SetUp(sweepGraphCut, image);
+  sweepGraphCut.SetInitialSegmentation(initialSegmentation);
+  srand(2);
+  std::vector<float> lambdas;
+  lambdas.push_back(0.02f);
+  lambdas.push_back(0.005f);
+  sweepGraphCut.PerformLambdaSweep(lambdas);
+  Compare("Lambda sweep after the initial segmentation", expected, GetSegmentation(sweepGraphCut));
+
+  printf("%u failures\n", NumberOfFailures);
+  return (NumberOfFailures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,257 @@
+/*
+Copyright (C) 2010 David Doria, daviddoria@gmail.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ImageStatistics.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Qt
+#include <QFuture>
+#include <QThread>
+#include <QtConcurrentRun>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMAGESTATISTICS_X86
+#include <emmintrin.h>
+#endif
+
+// The validity channel of the planar image
+static const unsigned int ValidityChannel = 4;
+
+// The values reduced per channel: minimum, maximum, sum, sum of squares, sum of neighbor differences
+static const unsigned int NumberOfSums = 5;
+
+/** Reduce one channel of 'count' pixels of a row into 'sums' (see NumberOfSums). A pixel and its right neighbor
+ *  are only compared if both are valid and in the row. */
+typedef void (*AccumulateRowFunction)(const float* const values, const float* const validity,
+                                      const unsigned int count, float* const sums);
+
+static void AccumulateRowScalar(const float* const values, const float* const validity, const unsigned int count,
+                                float* const sums)
+{
+  for(unsigned int x = 0; x < count; ++x)
+    {
+    sums[0] = values[x] < sums[0] ? values[x] : sums[0];
+    sums[1] = values[x] > sums[1] ? values[x] : sums[1];
+    if(!validity[x])
+      {
+      continue;
+      }
+    sums[2] += values[x];
+    sums[3] += values[x] * values[x];
+    if(x + 1 < count && validity[x + 1])
+      {
+      sums[4] += std::fabs(values[x + 1] - values[x]);
+      }
+    }
+}
+
+#ifdef IMAGESTATISTICS_X86
+__attribute__((target("sse2"))) static void AccumulateRowSSE2(const float* const values, const float* const validity,
+                                                              const unsigned int count, float* const sums)
+{
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 absoluteMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  __m128 minimum = _mm_set1_ps(sums[0]);
+  __m128 maximum = _mm_set1_ps(sums[1]);
+  __m128 sum = zero;
+  __m128 sumOfSquares = zero;
+  __m128 neighborDifferenceSum = zero;
+
+  // The right neighbors of the 4 pixels must be in the row as well
+  unsigned int x = 0;
+  for(; x + 5 <= count; x += 4)
+    {
+    __m128 value = _mm_loadu_ps(values + x);
+    __m128 valid = _mm_cmpneq_ps(_mm_loadu_ps(validity + x), zero);
+
+    // min_ps and max_ps return their second operand if one is NaN, so NaNs are skipped like in the scalar version
+    minimum = _mm_min_ps(value, minimum);
+    maximum = _mm_max_ps(value, maximum);
+
+    __m128 validValue = _mm_and_ps(value, valid);
+    sum = _mm_add_ps(sum, validValue);
+    sumOfSquares = _mm_add_ps(sumOfSquares, _mm_mul_ps(validValue, validValue));
+
+    __m128 bothValid = _mm_and_ps(valid, _mm_cmpneq_ps(_mm_loadu_ps(validity + x + 1), zero));
+    __m128 difference = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(values + x + 1), value), absoluteMask);
+    neighborDifferenceSum = _mm_add_ps(neighborDifferenceSum, _mm_and_ps(difference, bothValid));
+    }
+
+  float lanes[NumberOfSums][4];
+  _mm_storeu_ps(lanes[0], minimum);
+  _mm_storeu_ps(lanes[1], maximum);
+  _mm_storeu_ps(lanes[2], sum);
+  _mm_storeu_ps(lanes[3], sumOfSquares);
+  _mm_storeu_ps(lanes[4], neighborDifferenceSum);
+  for(unsigned int lane = 0; lane < 4; ++lane)
+    {
+    sums[0] = std::min(sums[0], lanes[0][lane]);
+    sums[1] = std::max(sums[1], lanes[1][lane]);
+    for(unsigned int i = 2; i < NumberOfSums; ++i)
+      {
+      sums[i] += lanes[i][lane];
+      }
+    }
+
+  AccumulateRowScalar(values + x, validity + x, count - x, sums);
+}
+#endif
+
+static AccumulateRowFunction GetAccumulateRowFunction()
+{
+#ifdef IMAGESTATISTICS_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("sse2"))
+    {
+    return &AccumulateRowSSE2;
+    }
+#endif
+  return &AccumulateRowScalar;
+}
+
+ImageStatistics::ImageStatistics()
+{
+  this->Planes = NULL;
+  this->NumberOfChannels = 0;
+  this->Width = 0;
+  this->Height = 0;
+  Clear();
+}
+
+void ImageStatistics::Clear()
+{
+  this->Valid = false;
+  this->Minimum.clear();
+  this->Maximum.clear();
+  this->Mean.clear();
+  this->Variance.clear();
+  this->NumberOfValidPixels = 0;
+  this->MeanNeighborDifference.clear();
+}
+
+void ImageStatistics::Compute(const float* const planes, const unsigned int numberOfChannels, const unsigned int width,
+                              const unsigned int height)
+{
+  this->Planes = planes;
+  this->NumberOfChannels = numberOfChannels;
+  this->Width = width;
+  this->Height = height;
+
+  // Split the rows into about 4 blocks per core (every block has at least one row)
+  unsigned int numberOfBlocks = std::max(1, std::min(static_cast<int>(height), 4 * QThread::idealThreadCount()));
+  std::vector<QFuture<std::vector<double> > > futures;
+  for(unsigned int block = 0; block < numberOfBlocks; ++block)
+    {
+    futures.push_back(QtConcurrent::run(this, &ImageStatistics::AccumulateRows,
+                                        block * height / numberOfBlocks, (block + 1) * height / numberOfBlocks));
+    }
+
+  std::vector<double> sums = futures[0].result();
+  for(unsigned int block = 1; block < futures.size(); ++block)
+    {
+    std::vector<double> blockSums = futures[block].result();
+    for(unsigned int channel = 0; channel < numberOfChannels; ++channel)
+      {
+      double* channelSums = &sums[NumberOfSums * channel];
+      const double* blockChannelSums = &blockSums[NumberOfSums * channel];
+      channelSums[0] = std::min(channelSums[0], blockChannelSums[0]);
+      channelSums[1] = std::max(channelSums[1], blockChannelSums[1]);
+      for(unsigned int i = 2; i < NumberOfSums; ++i)
+        {
+        channelSums[i] += blockChannelSums[i];
+        }
+      }
+    sums[NumberOfSums * numberOfChannels] += blockSums[NumberOfSums * numberOfChannels];
+    sums[NumberOfSums * numberOfChannels + 1] += blockSums[NumberOfSums * numberOfChannels + 1];
+    }
+
+  const double numberOfValidPixels = sums[NumberOfSums * numberOfChannels];
+  const double numberOfValidPairs = sums[NumberOfSums * numberOfChannels + 1];
+  this->NumberOfValidPixels = static_cast<unsigned int>(numberOfValidPixels);
+  this->Minimum.resize(numberOfChannels);
+  this->Maximum.resize(numberOfChannels);
+  this->Mean.resize(numberOfChannels);
+  this->Variance.resize(numberOfChannels);
+  this->MeanNeighborDifference.resize(numberOfChannels);
+  for(unsigned int channel = 0; channel < numberOfChannels; ++channel)
+    {
+    const double* channelSums = &sums[NumberOfSums * channel];
+    this->Minimum[channel] = static_cast<float>(channelSums[0]);
+    this->Maximum[channel] = static_cast<float>(channelSums[1]);
+    this->Mean[channel] = numberOfValidPixels > 0 ? channelSums[2] / numberOfValidPixels : 0.0;
+    this->Variance[channel] = numberOfValidPixels > 0 ?
+        std::max(0.0, channelSums[3] / numberOfValidPixels - this->Mean[channel] * this->Mean[channel]) : 0.0;
+    this->MeanNeighborDifference[channel] = numberOfValidPairs > 0 ? channelSums[4] / numberOfValidPairs : 0.0;
+    }
+
+  this->Planes = NULL;
+  this->Valid = true;
+}
+
+std::vector<double> ImageStatistics::AccumulateRows(const unsigned int y0, const unsigned int y1)
+{
+  static const AccumulateRowFunction accumulateRow = GetAccumulateRowFunction();
+
+  const unsigned int numberOfPixels = this->Width * this->Height;
+  const float* const validity = this->Planes + ValidityChannel * numberOfPixels;
+
+  std::vector<double> sums(NumberOfSums * this->NumberOfChannels + 2, 0.0);
+  for(unsigned int channel = 0; channel < this->NumberOfChannels; ++channel)
+    {
+    sums[NumberOfSums * channel] = std::numeric_limits<float>::max();
+    sums[NumberOfSums * channel + 1] = -std::numeric_limits<float>::max();
+    }
+
+  for(unsigned int y = y0; y < y1; ++y)
+    {
+    const unsigned int firstPixel = y * this->Width;
+
+    // The rows are short enough to be summed in single precision
+    for(unsigned int channel = 0; channel < this->NumberOfChannels; ++channel)
+      {
+      float rowSums[NumberOfSums] = {std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(),
+                                     0.0f, 0.0f, 0.0f};
+      accumulateRow(this->Planes + channel * numberOfPixels + firstPixel, validity + firstPixel, this->Width, rowSums);
+
+      double* channelSums = &sums[NumberOfSums * channel];
+      channelSums[0] = std::min(channelSums[0], static_cast<double>(rowSums[0]));
+      channelSums[1] = std::max(channelSums[1], static_cast<double>(rowSums[1]));
+      for(unsigned int i = 2; i < NumberOfSums; ++i)
+        {
+        channelSums[i] += rowSums[i];
+        }
+      }
+
+    for(unsigned int x = 0; x < this->Width; ++x)
+      {
+      if(validity[firstPixel + x])
+        {
+        sums[NumberOfSums * this->NumberOfChannels]++;
+        if(x + 1 < this->Width && validity[firstPixel + x + 1])
+          {
+          sums[NumberOfSums * this->NumberOfChannels + 1]++;
+          }
+        }
+      }
+    }
+
+  return sums;
+}
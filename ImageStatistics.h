@@ -0,0 +1,100 @@
+/*
+Copyright (C) 2010 David Doria, daviddoria@gmail.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Per-channel statistics of an RGBDV image stored as channel planes (all pixels of channel 0, then all of channel 1,
+ * ...; channel 4 is the validity), computed in one pass over the image. The rows are split into blocks which are
+ * reduced on all cores, and every row is reduced with SSE2 if the CPU supports it.
+ * The minimum and maximum are over all pixels (like ITKHelpers::ComputeMinOfAllChannels), the other statistics only
+ * over the valid pixels.
+*/
+
+#ifndef ImageStatistics_H
+#define ImageStatistics_H
+
+// STL
+#include <vector>
+
+class ImageStatistics
+{
+public:
+  ImageStatistics();
+
+  /** Compute the statistics of the 'numberOfChannels' (at least 5) planes of a width x height image */
+  void Compute(const float* const planes, const unsigned int numberOfChannels, const unsigned int width,
+               const unsigned int height);
+
+  /** Forget the statistics (IsValid is false until the next Compute) */
+  void Clear();
+
+  bool IsValid() const
+  {
+    return this->Valid;
+  }
+
+  /** The smallest and largest value of every channel */
+  const std::vector<float>& GetMinimum() const
+  {
+    return this->Minimum;
+  }
+  const std::vector<float>& GetMaximum() const
+  {
+    return this->Maximum;
+  }
+
+  /** The mean and the (population) variance of every channel over the valid pixels */
+  const std::vector<double>& GetMean() const
+  {
+    return this->Mean;
+  }
+  const std::vector<double>& GetVariance() const
+  {
+    return this->Variance;
+  }
+
+  unsigned int GetNumberOfValidPixels() const
+  {
+    return this->NumberOfValidPixels;
+  }
+
+  /** The mean absolute difference of every channel between horizontally neighboring valid pixels */
+  const std::vector<double>& GetMeanNeighborDifference() const
+  {
+    return this->MeanNeighborDifference;
+  }
+
+private:
+  /** Reduce the rows y0 ... y1-1. For every channel the result has its minimum, maximum, sum, sum of squares and
+   *  sum of neighbor differences, followed by the number of valid pixels and of valid neighbor pairs. */
+  std::vector<double> AccumulateRows(const unsigned int y0, const unsigned int y1);
+
+  /** The image being reduced by Compute */
+  const float* Planes;
+  unsigned int NumberOfChannels;
+  unsigned int Width;
+  unsigned int Height;
+
+  bool Valid;
+  std::vector<float> Minimum;
+  std::vector<float> Maximum;
+  std::vector<double> Mean;
+  std::vector<double> Variance;
+  unsigned int NumberOfValidPixels;
+  std::vector<double> MeanNeighborDifference;
+};
+
+#endif
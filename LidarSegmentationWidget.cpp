@@ -95,7 +95,11 @@ void LidarSegmentationWidget::SharedConstructor()
   
   // Global settings
   this->Flipped = false;
+  this->LambdaSweepMax = 0;
   this->Debug = true;
+
+  // Re-use the graph between cuts so that additional strokes only update the t-weights
+  this->GraphCut.PersistentGraph = true;
   
   // Qt connections
   // connect( this->sldHistogramBins, SIGNAL( valueChanged(int) ), this, SLOT(sldHistogramBins_valueChanged()));
@@ -409,9 +413,41 @@ void LidarSegmentationWidget::UpdateLambda()
 {
   // Compute lambda and then set the label to this value so the user can see the current setting
   double lambda = ComputeLambda();
+
+  // If the lambda sweep was computed for the current maximum lambda, selections and other settings, show its
+  // segmentation at the closest swept lambda immediately. Only the swept lambdas were cut, so the slider snaps to
+  // that lambda.
+  if(this->LambdaSweepMax > 0 && this->LambdaSweepMax == this->txtLambdaMax->text().toFloat() &&
+     this->Sources == this->GraphCut.GetSources() && this->Sinks == this->GraphCut.GetSinks() &&
+     GetCutSettings() == this->LambdaSweepSettings)
+    {
+    lambda = this->GraphCut.SetSegmentMaskFromLambdaSweep(lambda);
+    int sweptPercent = static_cast<int>(lambda / this->LambdaSweepMax * 100.0 + 0.5);
+    sweptPercent = qBound(this->sldLambda->minimum(), sweptPercent, this->sldLambda->maximum());
+    if(sweptPercent != this->sldLambda->value())
+      {
+      // This calls UpdateLambda again with the swept lambda
+      this->sldLambda->setValue(sweptPercent);
+      return;
+      }
+    DisplaySegmentationResult();
+    }
+
   this->lblLambda->setText(QString::number(lambda));
 }
 
+std::string LidarSegmentationWidget::GetCutSettings()
+{
+  // Everything SetupGraphCut passes to the GraphCut object except for lambda and the selections
+  std::stringstream ss;
+  ss << this->chkDebug->isChecked() << " " << this->chkDepthHistogram->isChecked() << " "
+     << this->chkColorHistogram->isChecked() << " " << this->txtBackgroundThreshold->text().toStdString() << " "
+     << this->chkDepthDifference->isChecked() << " " << this->chkColorDifference->isChecked() << " "
+     << this->spinRWeight->value() << " " << this->spinGWeight->value() << " " << this->spinBWeight->value() << " "
+     << this->spinDWeight->value() << " " << this->sldHistogramBins->value();
+  return ss.str();
+}
+
 void LidarSegmentationWidget::on_sldHistogramBins_valueChanged()
 {
   this->GraphCut.SetNumberOfHistogramBins(sldHistogramBins->value());
@@ -897,34 +933,18 @@ void LidarSegmentationWidget::on_action_Selections_LoadFromText_triggered()
 
 void LidarSegmentationWidget::on_btnSegmentLiDAR_clicked()
 {
-  // Normalize the image
-  ImageType::Pointer normalizedImage = ImageType::New();
-  normalizedImage->SetNumberOfComponentsPerPixel(this->Image->GetNumberOfComponentsPerPixel());
-  normalizedImage->SetRegions(this->Image->GetLargestPossibleRegion());
-  normalizedImage->Allocate();
-
-  std::cout << "Normalizing image..." << std::endl;
-  //ITKHelpers::DeepCopy(this->Image.GetPointer(), normalizedImage.GetPointer());
-  ITKHelpers::NormalizeImageChannels(this->Image.GetPointer(), normalizedImage.GetPointer());
+  // The (normalized) image was given to the GraphCut object when it was opened
 
-  std::cout << "Normalized image has " << normalizedImage->GetNumberOfComponentsPerPixel()
-            << " channels." << std::endl;
-
-  //this->GraphCut.SetImage(this->Image);
-  this->GraphCut.SetImage(normalizedImage.GetPointer());
+  // The segmentation no longer comes from the lambda sweep
+  this->LambdaSweepMax = 0;
 
   this->GraphCut.IncludeDepthInHistogram = true;
   this->GraphCut.IncludeColorInHistogram = true;
 
   this->GraphCut.BackgroundThreshold = 0.4;
 
-  if(this->GraphCut.DifferenceFunction)
-    {
-    delete this->GraphCut.DifferenceFunction;
-    }
-
   std::cout << "Using depth-only N-weights." << std::endl;
-  this->GraphCut.DifferenceFunction = new DepthDifference;
+  this->GraphCut.SetDifferenceFunction(new DepthDifference);
 
   // Get the number of bins from the slider
   this->GraphCut.SetNumberOfHistogramBins(this->sldHistogramBins->value());
@@ -936,8 +956,9 @@ void LidarSegmentationWidget::on_btnSegmentLiDAR_clicked()
   this->GraphCut.SetSources(this->Sources);
   this->GraphCut.SetSinks(this->Sinks);
 
-  // Setup and start the actual cut computation in a different thread
-  QFuture<void> future = QtConcurrent::run(this->GraphCut, &ImageGraphCut::PerformSegmentation);
+  // Setup and start the actual cut computation in a different thread.
+  // The GraphCut object is passed by pointer so that its persistent graph survives the cut.
+  QFuture<void> future = QtConcurrent::run(&this->GraphCut, &ImageGraphCut::PerformSegmentation);
   this->FutureWatcher.setFuture(future);
 
   this->ProgressDialog->exec();
@@ -957,9 +978,12 @@ void LidarSegmentationWidget::on_btnSegmentLiDAR_clicked()
 //   weights[2] = 1.0f;
 //   weights[3] = 1.0f;
 
-  this->GraphCut.DifferenceFunction = new WeightedDifference(weights);
+  this->GraphCut.SetDifferenceFunction(new WeightedDifference(weights));
+
+  // The persistent graph of step 1 is kept: step 2 changes its N-weights and t-weights and continues from the
+  // residual flow of step 1, which gives the same cut as a new graph
 
-  QFuture<void> futureStep2 = QtConcurrent::run(this->GraphCut, &ImageGraphCut::PerformSegmentation);
+  QFuture<void> futureStep2 = QtConcurrent::run(&this->GraphCut, &ImageGraphCut::PerformSegmentation);
   this->FutureWatcher.setFuture(futureStep2);
   this->ProgressDialog->exec();
 
@@ -972,24 +996,9 @@ void LidarSegmentationWidget::on_btnSegmentLiDAR_clicked()
     }
 }
 
-void LidarSegmentationWidget::on_btnCut_clicked()
+bool LidarSegmentationWidget::SetupGraphCut()
 {
-  // Normalize the image
-  ImageType::Pointer normalizedImage = ImageType::New();
-  normalizedImage->SetNumberOfComponentsPerPixel(this->Image->GetNumberOfComponentsPerPixel());
-  normalizedImage->SetRegions(this->Image->GetLargestPossibleRegion());
-  normalizedImage->Allocate();
-
-  std::cout << "Normalizing image..." << std::endl;
-  //ITKHelpers::DeepCopy(this->Image.GetPointer(), normalizedImage.GetPointer());
-  //ITKHelpers::NormalizeVectorImage(normalizedImage.GetPointer());
-  ITKHelpers::NormalizeImageChannels(this->Image.GetPointer(), normalizedImage.GetPointer());
-
-  std::cout << "Normalized image has " << normalizedImage->GetNumberOfComponentsPerPixel()
-            << " channels." << std::endl;
-  
-  //this->GraphCut.SetImage(this->Image);
-  this->GraphCut.SetImage(normalizedImage.GetPointer());
+  // The (normalized) image was given to the GraphCut object when it was opened
 
   this->GraphCut.Debug = this->chkDebug->isChecked();
   //this->GraphCut.SecondStep = this->chkSecondStep->isChecked();
@@ -999,21 +1008,16 @@ void LidarSegmentationWidget::on_btnCut_clicked()
 
   this->GraphCut.BackgroundThreshold = this->txtBackgroundThreshold->text().toDouble();
   
-  if(this->GraphCut.DifferenceFunction)
-    {
-    delete this->GraphCut.DifferenceFunction;
-    }
-
-  // Setup the Difference object
+  // Setup the Difference object. If it is the same as in the previous cut, the N-weights of the graph are reused.
   if(this->chkDepthDifference->isChecked() && !this->chkColorDifference->isChecked())
     {
     std::cout << "Using depth-only N-weights." << std::endl;
-    this->GraphCut.DifferenceFunction = new DepthDifference;
+    this->GraphCut.SetDifferenceFunction(new DepthDifference);
     }
   else if(!this->chkDepthDifference->isChecked() && this->chkColorDifference->isChecked())
     {
     std::cout << "Using color-only N-weights." << std::endl;
-    this->GraphCut.DifferenceFunction = new ColorDifference;
+    this->GraphCut.SetDifferenceFunction(new ColorDifference);
     }
   else if(this->chkDepthDifference->isChecked() && this->chkColorDifference->isChecked())
     {
@@ -1026,7 +1030,7 @@ void LidarSegmentationWidget::on_btnCut_clicked()
 
     std::cout << "Weights: " << weights[0] << " " << weights[1] << " " << weights[2] << " " << weights[3] << std::endl;
 
-    this->GraphCut.DifferenceFunction = new WeightedDifference(weights);
+    this->GraphCut.SetDifferenceFunction(new WeightedDifference(weights));
     }
   else
     {
@@ -1043,7 +1047,7 @@ void LidarSegmentationWidget::on_btnCut_clicked()
     QMessageBox msgBox;
     msgBox.setText("You must select lambda > 0!");
     msgBox.exec();
-    return;
+    return false;
     }
 
   // Setup the graph cut from the GUI and the scribble selection
@@ -1053,12 +1057,57 @@ void LidarSegmentationWidget::on_btnCut_clicked()
   //this->GraphCut.SetSources(this->LeftInteractorStyle->GetForegroundSelection());
   //this->GraphCut.SetSinks(this->LeftInteractorStyle->GetBackgroundSelection());
 
+  return true;
+}
+
+void LidarSegmentationWidget::on_btnCut_clicked()
+{
+  if(!SetupGraphCut())
+    {
+    return;
+    }
+
+  // The segmentation no longer comes from the lambda sweep
+  this->LambdaSweepMax = 0;
+
   // Setup and start the actual cut computation in a different thread
-  QFuture<void> future = QtConcurrent::run(this->GraphCut, &ImageGraphCut::PerformSegmentation);
+  QFuture<void> future = QtConcurrent::run(&this->GraphCut, &ImageGraphCut::PerformSegmentation);
+  this->FutureWatcher.setFuture(future);
+
+  this->ProgressDialog->exec();
+
+  ShowResultImageSlice();
+}
+
+void LidarSegmentationWidget::on_btnSweepLambda_clicked()
+{
+  if(!SetupGraphCut())
+    {
+    return;
+    }
+
+  // Compute the segmentations for all slider positions (in steps of 5%) at once,
+  // so that the slider can then be moved without cutting again
+  float lambdaMax = this->txtLambdaMax->text().toFloat();
+  std::vector<float> lambdas;
+  for(int percent = 5; percent <= 100; percent += 5)
+    {
+    lambdas.push_back(lambdaMax * percent / 100.0f);
+    }
+
+  QFuture<void> future = QtConcurrent::run(&this->GraphCut, &ImageGraphCut::PerformLambdaSweep, lambdas);
   this->FutureWatcher.setFuture(future);
 
   this->ProgressDialog->exec();
 
+  this->LambdaSweepMax = lambdaMax;
+  this->LambdaSweepSettings = GetCutSettings();
+
+  ShowResultImageSlice();
+}
+
+void LidarSegmentationWidget::ShowResultImageSlice()
+{
   if(!this->RightRenderer->HasViewProp(this->ResultImageSlice))
     {
     std::cout << "Added ResultImageSlice view prop." << std::endl;
@@ -1137,6 +1186,24 @@ void LidarSegmentationWidget::OpenFile(const std::string& fileName)
   // Store the region so we can access it without needing to care which image it comes from
   this->ImageRegion = reader->GetOutput()->GetLargestPossibleRegion();
 
+  // Normalize the image once and give it to the GraphCut object. Setting the image only here (instead of
+  // before every cut) lets the GraphCut object keep its graph between cuts.
+  ImageType::Pointer normalizedImage = ImageType::New();
+  normalizedImage->SetNumberOfComponentsPerPixel(this->Image->GetNumberOfComponentsPerPixel());
+  normalizedImage->SetRegions(this->Image->GetLargestPossibleRegion());
+  normalizedImage->Allocate();
+
+  std::cout << "Normalizing image..." << std::endl;
+  ITKHelpers::NormalizeImageChannels(this->Image.GetPointer(), normalizedImage.GetPointer());
+
+  std::cout << "Normalized image has " << normalizedImage->GetNumberOfComponentsPerPixel()
+            << " channels." << std::endl;
+
+  this->GraphCut.SetImage(normalizedImage.GetPointer());
+
+  // The lambda sweep belongs to the previous image
+  this->LambdaSweepMax = 0;
+
   // Clear everything
   //this->LeftRenderer->RemoveAllViewProps();
   //this->RightRenderer->RemoveAllViewProps();
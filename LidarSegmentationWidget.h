@@ -86,6 +86,7 @@ public slots:
   void on_btnClearBackground_clicked();
   void on_btnClearForeground_clicked();
   void on_btnCut_clicked();
+  void on_btnSweepLambda_clicked();
   void on_radForeground_clicked();
   void on_radBackground_clicked();
   void on_sldHistogramBins_valueChanged();
@@ -124,6 +125,22 @@ private:
   /** Compute lambda by multiplying the percentage set by the slider by the MaxLambda set in the text box. */
   float ComputeLambda();
 
+  /** Pass the settings from the GUI and the selections to the GraphCut object. Returns false if they are invalid. */
+  bool SetupGraphCut();
+
+  /** Make sure the result image is displayed after a cut */
+  void ShowResultImageSlice();
+
+  /** The maximum lambda of the last lambda sweep (0 if the current segmentation is not from a sweep).
+   *  While it is valid, moving the lambda slider updates the segmentation without cutting again. */
+  float LambdaSweepMax;
+
+  /** The cut settings of the GUI (see GetCutSettings) the last lambda sweep was computed with */
+  std::string LambdaSweepSettings;
+
+  /** Get the cut settings of the GUI other than lambda as a string, to find out whether they have changed */
+  std::string GetCutSettings();
+
   // Left pane
   vtkSmartPointer<vtkInteractorStyleScribble> LeftInteractorStyle;
   vtkSmartPointer<vtkImageSliceMapper> OriginalImageSliceMapper;
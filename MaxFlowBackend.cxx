@@ -0,0 +1,207 @@
+/*
+Copyright (C) 2010 David Doria, daviddoria@gmail.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MaxFlowBackend.h"
+
+// STL
+#include <stdexcept>
+
+// Max-flow solvers
+#include "graph.h"
+#include "forwardstargraph.h"
+#include "pushrelabelgraph.h"
+
+void MaxFlowBackend::AddEdgeCapacities(const EdgeId, const double, const double)
+{
+  throw std::runtime_error("MaxFlowBackend::AddEdgeCapacities: the edges of this backend cannot be updated");
+}
+
+/** Adapts a graph with the interface of Kolmogorov's graph (add_node, add_edge, add_tweights, maxflow, what_segment) */
+template <typename TGraph, typename TCapacity>
+class GraphBackend : public MaxFlowBackend
+{
+public:
+  GraphBackend(const unsigned int numberOfNodes, const unsigned int numberOfEdges, GraphArena* const)
+  {
+    this->GraphObject = new TGraph(numberOfNodes, numberOfEdges);
+  }
+
+  /** Take ownership of 'graph' */
+  GraphBackend(TGraph* const graph)
+  {
+    this->GraphObject = graph;
+  }
+
+  ~GraphBackend()
+  {
+    delete this->GraphObject;
+  }
+
+  NodeId AddNodes(const unsigned int numberOfNodes)
+  {
+    return this->GraphObject->add_node(numberOfNodes);
+  }
+
+  void AddEdge(const NodeId node1, const NodeId node2, const double capacity, const double reverseCapacity)
+  {
+    this->GraphObject->add_edge(node1, node2, static_cast<TCapacity>(capacity), static_cast<TCapacity>(reverseCapacity));
+  }
+
+  EdgeId AddEdges(const unsigned int numberOfEdges)
+  {
+    return this->GraphObject->add_edges(numberOfEdges);
+  }
+
+  void SetEdge(const EdgeId edge, const NodeId node1, const NodeId node2, const double capacity, const double reverseCapacity)
+  {
+    this->GraphObject->set_edge(edge, node1, node2, static_cast<TCapacity>(capacity), static_cast<TCapacity>(reverseCapacity));
+  }
+
+  void AddTWeights(const NodeId node, const double sourceCapacity, const double sinkCapacity)
+  {
+    this->GraphObject->add_tweights(node, static_cast<TCapacity>(sourceCapacity), static_cast<TCapacity>(sinkCapacity));
+  }
+
+  double ComputeMaxFlow(const bool)
+  {
+    return this->GraphObject->maxflow();
+  }
+
+  Segment GetSegment(const NodeId node)
+  {
+    return this->GraphObject->what_segment(node) == TGraph::SOURCE ? SOURCE : SINK;
+  }
+
+protected:
+  TGraph* GraphObject;
+
+private:
+  GraphBackend(const GraphBackend&);
+  void operator=(const GraphBackend&);
+};
+
+/** Kolmogorov's graph: the max-flow can be recomputed after t-weight changes, reusing the search trees */
+template <typename TCapacity, typename TFlow>
+class BKBackend : public GraphBackend<Graph<TCapacity, TCapacity, TFlow>, TCapacity>
+{
+public:
+  typedef GraphBackend<Graph<TCapacity, TCapacity, TFlow>, TCapacity> Superclass;
+  typedef typename Superclass::NodeId NodeId;
+  typedef typename Superclass::EdgeId EdgeId;
+
+  BKBackend(const unsigned int numberOfNodes, const unsigned int numberOfEdges, GraphArena* const arena) :
+    Superclass(new Graph<TCapacity, TCapacity, TFlow>(numberOfNodes, numberOfEdges, NULL, arena)) {}
+
+  bool SupportsReuse() const
+  {
+    return true;
+  }
+
+  void MarkNode(const NodeId node)
+  {
+    this->GraphObject->mark_node(node);
+  }
+
+  bool SupportsEdgeUpdates() const
+  {
+    return true;
+  }
+
+  void AddEdgeCapacities(const EdgeId edge, const double capacity, const double reverseCapacity)
+  {
+    this->GraphObject->add_to_edge(edge, static_cast<TCapacity>(capacity), static_cast<TCapacity>(reverseCapacity));
+  }
+
+  double ComputeMaxFlow(const bool reuseTrees)
+  {
+    return this->GraphObject->maxflow(reuseTrees);
+  }
+};
+
+/** The forward star graph continues from the residual flow when maxflow is called again (without reusing the trees) */
+template <typename TCapacity, typename TFlow>
+class ForwardStarBackend : public GraphBackend<ForwardStarGraph<TCapacity, TCapacity, TFlow>, TCapacity>
+{
+public:
+  typedef GraphBackend<ForwardStarGraph<TCapacity, TCapacity, TFlow>, TCapacity> Superclass;
+
+  ForwardStarBackend(const unsigned int numberOfNodes, const unsigned int numberOfEdges, GraphArena* const arena) :
+    Superclass(numberOfNodes, numberOfEdges, arena) {}
+
+  bool SupportsReuse() const
+  {
+    return true;
+  }
+};
+
+template <typename TBackend>
+static MaxFlowBackend* CreateBackend(const unsigned int numberOfNodes, const unsigned int numberOfEdges,
+                                     GraphArena* const arena)
+{
+  return new TBackend(numberOfNodes, numberOfEdges, arena);
+}
+
+typedef MaxFlowBackend* (*BackendCreator)(const unsigned int, const unsigned int, GraphArena* const);
+
+struct BackendEntry
+{
+  const char* Name;
+  BackendCreator CreateFloat;
+  BackendCreator CreateInteger;
+};
+
+// The capacity and flow types are those of ImageGraphCut's GraphType and IntegerGraphType
+static const BackendEntry Backends[] =
+{
+  { "BK",
+    &CreateBackend<BKBackend<float, double> >,
+    &CreateBackend<BKBackend<int, long long> > },
+  { "BK-ForwardStar",
+    &CreateBackend<ForwardStarBackend<float, double> >,
+    &CreateBackend<ForwardStarBackend<int, long long> > },
+  { "PushRelabel",
+    &CreateBackend<GraphBackend<PushRelabelGraph<float, float, double>, float> >,
+    &CreateBackend<GraphBackend<PushRelabelGraph<int, int, long long>, int> > }
+};
+
+static const unsigned int NumberOfBackends = sizeof(Backends) / sizeof(Backends[0]);
+
+MaxFlowBackend* MaxFlowBackend::Create(const std::string& name, const bool integerCapacities,
+                                       const unsigned int numberOfNodes, const unsigned int numberOfEdges,
+                                       GraphArena* const arena)
+{
+  for(unsigned int i = 0; i < NumberOfBackends; ++i)
+    {
+    if(name == Backends[i].Name)
+      {
+      BackendCreator create = integerCapacities ? Backends[i].CreateInteger : Backends[i].CreateFloat;
+      return create(numberOfNodes, numberOfEdges, arena);
+      }
+    }
+
+  throw std::runtime_error("MaxFlowBackend::Create: unknown max-flow backend '" + name + "'");
+}
+
+std::vector<std::string> MaxFlowBackend::GetNames()
+{
+  std::vector<std::string> names;
+  for(unsigned int i = 0; i < NumberOfBackends; ++i)
+    {
+    names.push_back(Backends[i].Name);
+    }
+  return names;
+}
@@ -0,0 +1,99 @@
+/*
+Copyright (C) 2010 David Doria, daviddoria@gmail.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MAXFLOWBACKEND_H
+#define MAXFLOWBACKEND_H
+
+// STL
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+class GraphArena;
+
+/** The interface ImageGraphCut builds its graph against, so that the max-flow solver can be chosen at runtime.
+ *  The available backends are
+ *  - "BK": Kolmogorov's graph (graph.h), the Boykov-Kolmogorov algorithm with search tree reuse
+ *  - "BK-ForwardStar": the same algorithm on the more compact forward star graph (forwardstargraph.h)
+ *  - "PushRelabel": FIFO push-relabel with global relabeling (pushrelabelgraph.h)
+ *  Every backend exists with float and with integer capacities. Capacities are passed as double; for the
+ *  integer backends they must already be integral (see ImageGraphCut::QuantizeWeight). */
+class MaxFlowBackend
+{
+public:
+  /** Nodes are numbered 0,1,2,... in the order in which they are added */
+  typedef uint32_t NodeId;
+
+  /** Edges are numbered 0,1,2,... in the order in which they are added */
+  typedef uint32_t EdgeId;
+
+  enum Segment { SOURCE = 0, SINK = 1 };
+
+  virtual ~MaxFlowBackend() {}
+
+  /** Add 'numberOfNodes' nodes and return the id of the first one */
+  virtual NodeId AddNodes(const unsigned int numberOfNodes) = 0;
+
+  /** Add an edge between 'node1' and 'node2' with the given capacities in both directions */
+  virtual void AddEdge(const NodeId node1, const NodeId node2, const double capacity, const double reverseCapacity) = 0;
+
+  /** Add 'numberOfEdges' edges and return the id of the first one (the others follow consecutively). Their nodes and
+   *  capacities must be set with SetEdge before the next ComputeMaxFlow or AddEdge(s). SetEdge can be called for
+   *  different edges from several threads at once, so a graph of known size can be filled in parallel. */
+  virtual EdgeId AddEdges(const unsigned int numberOfEdges) = 0;
+
+  virtual void SetEdge(const EdgeId edge, const NodeId node1, const NodeId node2,
+                       const double capacity, const double reverseCapacity) = 0;
+
+  /** Add capacities to the terminal edges of a node (can be called several times for the same node) */
+  virtual void AddTWeights(const NodeId node, const double sourceCapacity, const double sinkCapacity) = 0;
+
+  /** Whether t-weights can be added after ComputeMaxFlow and the max-flow computed again from the residual flow */
+  virtual bool SupportsReuse() const { return false; }
+
+  /** Tell the backend that the t-weights or edges of a node changed since the last max-flow (only used if SupportsReuse) */
+  virtual void MarkNode(const NodeId) {}
+
+  /** Whether the capacities of edges can be changed with AddEdgeCapacities after ComputeMaxFlow */
+  virtual bool SupportsEdgeUpdates() const { return false; }
+
+  /** Add 'capacity' and 'reverseCapacity' (which can be negative, as long as the capacities stay non-negative) to the
+   *  capacities of 'edge', keeping the flow of the last max-flow. Both nodes of the edge must be marked with MarkNode.
+   *  Throws std::runtime_error if the backend does not support edge updates. */
+  virtual void AddEdgeCapacities(const EdgeId edge, const double capacity, const double reverseCapacity);
+
+  /** Compute the max-flow and return its value. If 'reuseTrees' is true, the search trees of the
+   *  previous computation may be reused (backends without search trees ignore it). */
+  virtual double ComputeMaxFlow(const bool reuseTrees) = 0;
+
+  /** Get the side of the minimum cut a node is on (only valid after ComputeMaxFlow) */
+  virtual Segment GetSegment(const NodeId node) = 0;
+
+  /** Create the backend called 'name'. The numbers of nodes and edges are estimates used to preallocate memory.
+   *  If 'arena' is not NULL, a "BK" graph keeps its node and arc arrays in it, so that they are reused by the
+   *  next graph created with the same arena (see GraphArena in graph.h); the other backends ignore it.
+   *  Throws std::runtime_error if there is no backend with this name. */
+  static MaxFlowBackend* Create(const std::string& name, const bool integerCapacities,
+                                const unsigned int numberOfNodes, const unsigned int numberOfEdges,
+                                GraphArena* const arena = NULL);
+
+  /** Get the names of all backends which can be passed to Create */
+  static std::vector<std::string> GetNames();
+};
+
+#endif
@@ -1,34 +1,426 @@
+/*
+Compares the max-flow engines against Kolmogorov's Graph (the baseline solver) on random 8-connected grids.
+For every grid the flow value and the segment of every node must be exactly the same. The capacities are small
+integers, so that the float engines compute them without rounding and the minimum cut is unique up to ties, which
+every engine must break the same way (a node is in the SOURCE set only if it is in it for every minimum cut).
+Returns 0 if all engines agree with Graph.
+*/
+
 #include <stdio.h>
+#include <stdlib.h>
+
+// STL
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "graph.h"
+#include "gridgraph.h"
+#include "MaxFlowBackend.h"
+
+/** The neighbor offsets of the edges added from a pixel; the other four directions are their reverse edges */
+static const int EdgeOffsets[4][2] = { {1, 0}, {1, 1}, {0, 1}, {-1, 1} };
+
+struct RandomGrid
+{
+  int Width;
+  int Height;
+
+  /** The t-weights of each node */
+  std::vector<int> SourceWeights;
+  std::vector<int> SinkWeights;
+
+  /** The t-weights added to a few nodes after the first max-flow, to test the backends which reuse the flow */
+  std::vector<int> AddedSourceWeights;
+  std::vector<int> AddedSinkWeights;
+
+  /** The capacities of the edge from each node in the direction EdgeOffsets[d] and of its reverse edge */
+  std::vector<int> Capacities[4];
+  std::vector<int> ReverseCapacities[4];
+
+  /** The capacities that a few edges are changed to after the first max-flow (for the backends which support it) */
+  std::vector<int> ChangedCapacities[4];
+  std::vector<int> ChangedReverseCapacities[4];
+
+  bool HasNeighbor(const int node, const int d) const
+  {
+    int x = node % this->Width + EdgeOffsets[d][0];
+    int y = node / this->Width + EdgeOffsets[d][1];
+    return x >= 0 && x < this->Width && y < this->Height;
+  }
+
+  int GetNeighbor(const int node, const int d) const
+  {
+    return node + EdgeOffsets[d][1] * this->Width + EdgeOffsets[d][0];
+  }
+};
+
+/** A random capacity in [0, maximum], which is 0 with probability 'zeroProbability' */
+static int RandomCapacity(const int maximum, const double zeroProbability)
+{
+  if(rand() < zeroProbability * RAND_MAX)
+    {
+    return 0;
+    }
+  return rand() % (maximum + 1);
+}
+
+/** Zero capacities leave isolated nodes, and equal t-weights make nodes without a preference, which test the ties */
+static RandomGrid CreateRandomGrid(const int width, const int height)
+{
+  RandomGrid grid;
+  grid.Width = width;
+  grid.Height = height;
+
+  int numberOfNodes = width * height;
+  for(int i = 0; i < numberOfNodes; ++i)
+    {
+    int sourceWeight = RandomCapacity(30, 0.4);
+    int sinkWeight = RandomCapacity(30, 0.4);
+    if(rand() % 10 == 0)
+      {
+      sinkWeight = sourceWeight;
+      }
+    grid.SourceWeights.push_back(sourceWeight);
+    grid.SinkWeights.push_back(sinkWeight);
+
+    bool changed = (rand() % 10 == 0);
+    grid.AddedSourceWeights.push_back(changed ? RandomCapacity(30, 0.4) : 0);
+    grid.AddedSinkWeights.push_back(changed ? RandomCapacity(30, 0.4) : 0);
+    }
+
+  for(int d = 0; d < 4; ++d)
+    {
+    for(int i = 0; i < numberOfNodes; ++i)
+      {
+      grid.Capacities[d].push_back(RandomCapacity(20, 0.3));
+      grid.ReverseCapacities[d].push_back(RandomCapacity(20, 0.3));
+
+      bool changed = (rand() % 5 == 0);
+      grid.ChangedCapacities[d].push_back(changed ? RandomCapacity(20, 0.3) : grid.Capacities[d].back());
+      grid.ChangedReverseCapacities[d].push_back(changed ? RandomCapacity(20, 0.3) : grid.ReverseCapacities[d].back());
+      }
+    }
+
+  return grid;
+}
+
+/** Which of the changes of a RandomGrid are included */
+enum GridChanges { NoChanges, TWeightChanges, AllChanges };
+
+/** Solve the grid with Graph and get the flow and the segment (0 = SOURCE, 1 = SINK) of every node.
+ *  The 'changes' are included from the start. */
+template <typename TGraph>
+static double SolveWithGraph(const RandomGrid& grid, const GridChanges changes, std::vector<int>& segments)
+{
+  int numberOfNodes = grid.Width * grid.Height;
+  TGraph graph(numberOfNodes, 4 * numberOfNodes);
+  graph.add_node(numberOfNodes);
+
+  for(int i = 0; i < numberOfNodes; ++i)
+    {
+    graph.add_tweights(i, grid.SourceWeights[i], grid.SinkWeights[i]);
+    if(changes != NoChanges)
+      {
+      graph.add_tweights(i, grid.AddedSourceWeights[i], grid.AddedSinkWeights[i]);
+      }
+    for(int d = 0; d < 4; ++d)
+      {
+      if(grid.HasNeighbor(i, d) && changes == AllChanges)
+        {
+        graph.add_edge(i, grid.GetNeighbor(i, d), grid.ChangedCapacities[d][i], grid.ChangedReverseCapacities[d][i]);
+        }
+      else if(grid.HasNeighbor(i, d))
+        {
+        graph.add_edge(i, grid.GetNeighbor(i, d), grid.Capacities[d][i], grid.ReverseCapacities[d][i]);
+        }
+      }
+    }
+
+  double flow = graph.maxflow();
+
+  segments.resize(numberOfNodes);
+  for(int i = 0; i < numberOfNodes; ++i)
+    {
+    segments[i] = (graph.what_segment(i) == TGraph::SOURCE) ? 0 : 1;
+    }
+  return flow;
+}
+
+static void FillGridGraph(const RandomGrid& grid, GridGraph& graph)
+{
+  int numberOfNodes = grid.Width * grid.Height;
+  for(int i = 0; i < numberOfNodes; ++i)
+    {
+    graph.add_tweights(i, grid.SourceWeights[i], grid.SinkWeights[i]);
+    for(int d = 0; d < 4; ++d)
+      {
+      if(grid.HasNeighbor(i, d))
+        {
+        graph.add_edge(i % grid.Width, i / grid.Width,
+                       GridGraph::offset_to_direction(EdgeOffsets[d][0], EdgeOffsets[d][1]),
+                       grid.Capacities[d][i], grid.ReverseCapacities[d][i]);
+        }
+      }
+    }
+}
+
+static void GetGridGraphSegments(const RandomGrid& grid, GridGraph& graph, std::vector<int>& segments)
+{
+  segments.resize(grid.Width * grid.Height);
+  for(int i = 0; i < grid.Width * grid.Height; ++i)
+    {
+    segments[i] = (graph.what_segment(i) == GridGraph::SOURCE) ? 0 : 1;
+    }
+}
+
+static double SolveWithGridGraph(const RandomGrid& grid, std::vector<int>& segments)
+{
+  GridGraph graph(grid.Width, grid.Height);
+  FillGridGraph(grid, graph);
+  double flow = graph.maxflow();
+  GetGridGraphSegments(grid, graph, segments);
+  return flow;
+}
+
+struct Rectangle
+{
+  int X0, Y0, X1, Y1;
+};
+
+static void SolveRegion(GridGraph* const graph, const Rectangle rectangle, double* const flow)
+{
+  *flow = graph->maxflow_region(rectangle.X0, rectangle.Y0, rectangle.X1, rectangle.Y1);
+}
+
+/** Solve the grid by hierarchical block merging as in ImageGraphCut::ComputeGridMaxFlow: bisect the grid into blocks
+ *  of at least 'minimumBlockSize' pixels, solve the blocks of each level in their own threads, and continue from their
+ *  flow on the next coarser level. The last level is the whole grid, which maxflow() solves. */
+static double SolveWithGridGraphBlocks(const RandomGrid& grid, const int minimumBlockSize, std::vector<int>& segments)
+{
+  GridGraph graph(grid.Width, grid.Height);
+  FillGridGraph(grid, graph);
+
+  Rectangle whole = { 0, 0, grid.Width, grid.Height };
+  std::vector<std::vector<Rectangle> > levels(1, std::vector<Rectangle>(1, whole));
+  while(levels.back().size() < 16)
+    {
+    std::vector<Rectangle> blocks;
+    for(unsigned int i = 0; i < levels.back().size(); ++i)
+      {
+      Rectangle first = levels.back()[i];
+      Rectangle second = first;
+      if(first.X1 - first.X0 >= first.Y1 - first.Y0)
+        {
+        first.X1 = second.X0 = (first.X0 + first.X1) / 2;
+        }
+      else
+        {
+        first.Y1 = second.Y0 = (first.Y0 + first.Y1) / 2;
+        }
+      if((first.X1 - first.X0) * (first.Y1 - first.Y0) < minimumBlockSize || first.X0 == first.X1 || first.Y0 == first.Y1)
+        {
+        break;
+        }
+      blocks.push_back(first);
+      blocks.push_back(second);
+      }
+    if(blocks.size() != 2 * levels.back().size())
+      {
+      break;
+      }
+    levels.push_back(blocks);
+    }
+
+  // The flow pushed by maxflow_region() is not included in the value of maxflow()
+  double flow = 0;
+  for(unsigned int level = levels.size() - 1; level > 0; --level)
+    {
+    std::vector<double> blockFlows(levels[level].size());
+    std::vector<std::thread> threads;
+    for(unsigned int i = 0; i < levels[level].size(); ++i)
+      {
+      threads.push_back(std::thread(SolveRegion, &graph, levels[level][i], &blockFlows[i]));
+      }
+    for(unsigned int i = 0; i < threads.size(); ++i)
+      {
+      threads[i].join();
+      flow += blockFlows[i];
+      }
+    }
+  flow += graph.maxflow();
+
+  GetGridGraphSegments(grid, graph, segments);
+  return flow;
+}
+
+static void GetBackendSegments(const RandomGrid& grid, MaxFlowBackend* const backend, std::vector<int>& segments)
+{
+  segments.resize(grid.Width * grid.Height);
+  for(int i = 0; i < grid.Width * grid.Height; ++i)
+    {
+    segments[i] = (backend->GetSegment(i) == MaxFlowBackend::SOURCE) ? 0 : 1;
+    }
+}
+
+/** Solve the grid with a MaxFlowBackend, adding the edges with AddEdges and SetEdge as ImageGraphCut does. If the
+ *  backend supports reuse, the added t-weights (and if it supports edge updates, the changed capacities) are then
+ *  applied and the max-flow computed again from the residual flow. 'flowAfterChanges' and 'segmentsAfterChanges'
+ *  are set to the result and 'changes' to the changes which were applied. */
+static double SolveWithBackend(const RandomGrid& grid, const std::string& name, const bool integerCapacities,
+                               std::vector<int>& segments, double& flowAfterChanges,
+                               std::vector<int>& segmentsAfterChanges, GridChanges& changes)
+{
+  int numberOfNodes = grid.Width * grid.Height;
+  MaxFlowBackend* backend = MaxFlowBackend::Create(name, integerCapacities, numberOfNodes, 4 * numberOfNodes);
+  backend->AddNodes(numberOfNodes);
+
+  unsigned int numberOfEdges = 0;
+  for(int i = 0; i < numberOfNodes; ++i)
+    {
+    for(int d = 0; d < 4; ++d)
+      {
+      numberOfEdges += grid.HasNeighbor(i, d) ? 1 : 0;
+      }
+    }
+
+  MaxFlowBackend::EdgeId edge = backend->AddEdges(numberOfEdges);
+  for(int i = 0; i < numberOfNodes; ++i)
+    {
+    backend->AddTWeights(i, grid.SourceWeights[i], grid.SinkWeights[i]);
+    for(int d = 0; d < 4; ++d)
+      {
+      if(grid.HasNeighbor(i, d))
+        {
+        backend->SetEdge(edge++, i, grid.GetNeighbor(i, d), grid.Capacities[d][i], grid.ReverseCapacities[d][i]);
+        }
+      }
+    }
+
+  double flow = backend->ComputeMaxFlow(false);
+  GetBackendSegments(grid, backend, segments);
+
+  if(backend->SupportsReuse())
+    {
+    for(int i = 0; i < numberOfNodes; ++i)
+      {
+      if(grid.AddedSourceWeights[i] != 0 || grid.AddedSinkWeights[i] != 0)
+        {
+        backend->AddTWeights(i, grid.AddedSourceWeights[i], grid.AddedSinkWeights[i]);
+        backend->MarkNode(i);
+        }
+      }
+    changes = TWeightChanges;
+
+    if(backend->SupportsEdgeUpdates())
+      {
+      edge = 0;
+      for(int i = 0; i < numberOfNodes; ++i)
+        {
+        for(int d = 0; d < 4; ++d)
+          {
+          if(!grid.HasNeighbor(i, d))
+            {
+            continue;
+            }
+          int capacity = grid.ChangedCapacities[d][i] - grid.Capacities[d][i];
+          int reverseCapacity = grid.ChangedReverseCapacities[d][i] - grid.ReverseCapacities[d][i];
+          if(capacity != 0 || reverseCapacity != 0)
+            {
+            backend->AddEdgeCapacities(edge, capacity, reverseCapacity);
+            backend->MarkNode(i);
+            backend->MarkNode(grid.GetNeighbor(i, d));
+            }
+          edge++;
+          }
+        }
+      changes = AllChanges;
+      }
+
+    flowAfterChanges = backend->ComputeMaxFlow(true);
+    GetBackendSegments(grid, backend, segmentsAfterChanges);
+    }
+
+  delete backend;
+  return flow;
+}
+
+static unsigned int NumberOfFailures = 0;
+
+/** Count a failure if 'flow' and 'segments' are not those of Graph */
+static void Compare(const char* engine, const unsigned int test, const double expectedFlow,
+                    const std::vector<int>& expectedSegments, const double flow, const std::vector<int>& segments)
+{
+  if(flow != expectedFlow)
+    {
+    printf("Test %u, %s: flow %g instead of %g\n", test, engine, flow, expectedFlow);
+    NumberOfFailures++;
+    return;
+    }
+
+  for(unsigned int i = 0; i < expectedSegments.size(); ++i)
+    {
+    if(segments[i] != expectedSegments[i])
+      {
+      printf("Test %u, %s: node %u is in the %s set\n", test, engine, i, segments[i] == 0 ? "SOURCE" : "SINK");
+      NumberOfFailures++;
+      return;
+      }
+    }
+}
 
 int main()
 {
-  typedef Graph GraphType;
-  GraphType *g = new GraphType;
+  srand(1);
+
+  const unsigned int numberOfTests = 300;
+  for(unsigned int test = 0; test < numberOfTests; ++test)
+    {
+    RandomGrid grid = CreateRandomGrid(1 + rand() % 40, 1 + rand() % 40);
+
+    std::vector<int> expectedSegments;
+    double expectedFlow = SolveWithGraph<Graph<float, float, double> >(grid, NoChanges, expectedSegments);
 
-  g -> add_node();
-  g -> add_node();
+    std::vector<int> segments;
+    double flow = SolveWithGridGraph(grid, segments);
+    Compare("GridGraph", test, expectedFlow, expectedSegments, flow, segments);
 
-  int zero = 0;
-  int one = 1;
-  g -> add_tweights( &zero,   /* capacities */  1, 5 );
-  g -> add_tweights( &one,   /* capacities */  2, 6 );
-  g -> add_edge( &zero, &one,    /* capacities */  3, 4 );
+    flow = SolveWithGridGraphBlocks(grid, 1 + rand() % 40, segments);
+    Compare("GridGraph blocks", test, expectedFlow, expectedSegments, flow, segments);
 
-  int flow = g -> maxflow();
+    // Every backend, with float and with integer capacities, against Graph with the same capacity type
+    std::vector<int> expectedIntegerSegments;
+    double expectedIntegerFlow = SolveWithGraph<Graph<int, int, long long> >(grid, NoChanges, expectedIntegerSegments);
 
-  printf("Flow = %d\n", flow);
-  printf("Minimum cut:\n");
-  if (g->what_segment(&zero) == GraphType::SOURCE)
-    printf("node0 is in the SOURCE set\n");
-  else
-    printf("node0 is in the SINK set\n");
-  if (g->what_segment(&one) == GraphType::SOURCE)
-    printf("node1 is in the SOURCE set\n");
-  else
-    printf("node1 is in the SINK set\n");
+    // The changes are integral, so the expected results after them are the same for both capacity types
+    std::vector<int> expectedChangedSegments[3];
+    double expectedChangedFlows[3];
+    expectedChangedFlows[TWeightChanges] = SolveWithGraph<Graph<float, float, double> >(grid, TWeightChanges,
+                                                           expectedChangedSegments[TWeightChanges]);
+    expectedChangedFlows[AllChanges] = SolveWithGraph<Graph<float, float, double> >(grid, AllChanges,
+                                                       expectedChangedSegments[AllChanges]);
 
-  delete g;
+    std::vector<std::string> names = MaxFlowBackend::GetNames();
+    for(unsigned int i = 0; i < names.size(); ++i)
+      {
+      for(int integerCapacities = 0; integerCapacities < 2; ++integerCapacities)
+        {
+        std::string engine = names[i] + (integerCapacities ? " (int)" : " (float)");
+        double changedFlow = 0;
+        std::vector<int> changedSegments;
+        GridChanges changes = NoChanges;
+        flow = SolveWithBackend(grid, names[i], integerCapacities, segments, changedFlow, changedSegments, changes);
+        Compare(engine.c_str(), test, integerCapacities ? expectedIntegerFlow : expectedFlow,
+                integerCapacities ? expectedIntegerSegments : expectedSegments, flow, segments);
+        if(changes != NoChanges)
+          {
+          Compare((engine + (changes == AllChanges ? " with new t-weights and edges" : " with new t-weights")).c_str(),
+                  test, expectedChangedFlows[changes], expectedChangedSegments[changes], changedFlow, changedSegments);
+          }
+        }
+      }
+    }
 
-  return 0;
-}
\ No newline at end of file
+  printf("%u failures in %u tests\n", NumberOfFailures, numberOfTests);
+  return (NumberOfFailures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
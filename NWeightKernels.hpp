@@ -0,0 +1,219 @@
+/*
+Copyright (C) 2010 David Doria, daviddoria@gmail.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Row kernels for the N-weights exp(-d^2 / (2 sigma^2)) of an image stored as channel planes (all values of channel c
+ * at c * channelStride, channel 4 is the validity). A row kernel computes the weights between 'count' consecutive
+ * pixels and the same number of consecutive neighbors (the pixels shifted by one neighbor offset), 0 where either pixel
+ * is invalid. The difference d is that of a DifferenceKernel. Besides the scalar kernel there are SSE2 (4 pixels at a
+ * time) and AVX2 (8 pixels at a time) kernels on x86 with GCC compatible compilers; GetNWeightRowFunction selects the
+ * best one the CPU supports at runtime. The vector kernels compute the exponential with a polynomial approximation
+ * (Cephes' expf) and flush results below the smallest normal float to 0, so their weights can differ from the scalar
+ * ones in the last bits.
+*/
+
+#ifndef NWeightKernels_HPP
+#define NWeightKernels_HPP
+
+#include "Difference.hpp"
+
+// STL
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NWEIGHTKERNELS_X86
+#include <immintrin.h>
+#endif
+
+/** Compute 'count' N-weights. 'scale' is -1 / (2 sigma^2). */
+typedef void (*NWeightRowFunction)(const float* const pixels, const float* const neighbors,
+                                   const unsigned int channelStride, const float* const weights,
+                                   const float scale, const unsigned int count, float* const output);
+
+/** The validity channel of the planar image */
+static const unsigned int NWeightValidityChannel = 4;
+
+template <typename TKernel>
+void ComputeNWeightRowScalar(const float* const pixels, const float* const neighbors,
+                             const unsigned int channelStride, const float* const weights,
+                             const float scale, const unsigned int count, float* const output)
+{
+  const float* const validity = pixels + NWeightValidityChannel * channelStride;
+  const float* const neighborValidity = neighbors + NWeightValidityChannel * channelStride;
+  for(unsigned int i = 0; i < count; ++i)
+    {
+    if(validity[i] && neighborValidity[i])
+      {
+      float difference = TKernel::Compute(pixels + i, neighbors + i, weights, channelStride);
+      output[i] = std::exp(scale * difference * difference);
+      }
+    else
+      {
+      output[i] = 0.0f;
+      }
+    }
+}
+
+#ifdef NWEIGHTKERNELS_X86
+
+/** exp(x) of 4 floats (Cephes' expf as in sse_mathfun), 0 below the smallest normal result. 'x' must not be positive
+ *  enough to overflow. */
+__attribute__((target("sse2"))) inline __m128 ExpSSE2(__m128 x)
+{
+  const __m128 underflow = _mm_cmplt_ps(x, _mm_set1_ps(-87.3365447504f));
+  x = _mm_max_ps(x, _mm_set1_ps(-87.3365447504f));
+
+  // exp(x) = 2^n * exp(r) with n = round(x / log(2)), r = x - n log(2)
+  __m128 fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(0.5f));
+  __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+  __m128 n = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, fx), _mm_set1_ps(1.0f))); // floor(fx)
+  x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(0.693359375f)));
+  x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(-2.12194440e-4f)));
+
+  __m128 y = _mm_set1_ps(1.9875691500e-4f);
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507e-3f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073e-3f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894e-2f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201e-1f));
+  y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, _mm_mul_ps(x, x)), x), _mm_set1_ps(1.0f));
+
+  __m128i exponent = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23);
+  return _mm_andnot_ps(underflow, _mm_mul_ps(y, _mm_castsi128_ps(exponent)));
+}
+
+template <typename TKernel>
+__attribute__((target("sse2"))) void ComputeNWeightRowSSE2(const float* const pixels, const float* const neighbors,
+                                                           const unsigned int channelStride, const float* const weights,
+                                                           const float scale, const unsigned int count,
+                                                           float* const output)
+{
+  const float* const validity = pixels + NWeightValidityChannel * channelStride;
+  const float* const neighborValidity = neighbors + NWeightValidityChannel * channelStride;
+  const __m128 zero = _mm_setzero_ps();
+
+  unsigned int i = 0;
+  for(; i + 4 <= count; i += 4)
+    {
+    __m128 sum = zero;
+    for(unsigned int component = 0; component < TKernel::NumberOfChannels; ++component)
+      {
+      if(TKernel::ChannelMask & (1u << component))
+        {
+        __m128 difference = _mm_sub_ps(_mm_loadu_ps(pixels + component * channelStride + i),
+                                       _mm_loadu_ps(neighbors + component * channelStride + i));
+        __m128 squared = _mm_mul_ps(difference, difference);
+        if(TKernel::Weighted)
+          {
+          squared = _mm_mul_ps(squared, _mm_set1_ps(weights[component]));
+          }
+        sum = _mm_add_ps(sum, squared);
+        }
+      }
+
+    __m128 weight = ExpSSE2(_mm_mul_ps(_mm_set1_ps(scale), _mm_mul_ps(sum, sum)));
+    __m128 valid = _mm_and_ps(_mm_cmpneq_ps(_mm_loadu_ps(validity + i), zero),
+                              _mm_cmpneq_ps(_mm_loadu_ps(neighborValidity + i), zero));
+    _mm_storeu_ps(output + i, _mm_and_ps(weight, valid));
+    }
+
+  ComputeNWeightRowScalar<TKernel>(pixels + i, neighbors + i, channelStride, weights, scale, count - i, output + i);
+}
+
+/** exp(x) of 8 floats, see ExpSSE2 */
+__attribute__((target("avx2,fma"))) inline __m256 ExpAVX2(__m256 x)
+{
+  const __m256 underflow = _mm256_cmp_ps(x, _mm256_set1_ps(-87.3365447504f), _CMP_LT_OQ);
+  x = _mm256_max_ps(x, _mm256_set1_ps(-87.3365447504f));
+
+  __m256 n = _mm256_floor_ps(_mm256_fmadd_ps(x, _mm256_set1_ps(1.44269504088896341f), _mm256_set1_ps(0.5f)));
+  x = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+  x = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), x);
+
+  __m256 y = _mm256_set1_ps(1.9875691500e-4f);
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.3981999507e-3f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(8.3334519073e-3f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(4.1665795894e-2f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.6666665459e-1f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(5.0000001201e-1f));
+  y = _mm256_add_ps(_mm256_fmadd_ps(y, _mm256_mul_ps(x, x), x), _mm256_set1_ps(1.0f));
+
+  __m256i exponent = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(n), _mm256_set1_epi32(127)), 23);
+  return _mm256_andnot_ps(underflow, _mm256_mul_ps(y, _mm256_castsi256_ps(exponent)));
+}
+
+template <typename TKernel>
+__attribute__((target("avx2,fma"))) void ComputeNWeightRowAVX2(const float* const pixels, const float* const neighbors,
+                                                               const unsigned int channelStride, const float* const weights,
+                                                               const float scale, const unsigned int count,
+                                                               float* const output)
+{
+  const float* const validity = pixels + NWeightValidityChannel * channelStride;
+  const float* const neighborValidity = neighbors + NWeightValidityChannel * channelStride;
+  const __m256 zero = _mm256_setzero_ps();
+
+  unsigned int i = 0;
+  for(; i + 8 <= count; i += 8)
+    {
+    __m256 sum = zero;
+    for(unsigned int component = 0; component < TKernel::NumberOfChannels; ++component)
+      {
+      if(TKernel::ChannelMask & (1u << component))
+        {
+        __m256 difference = _mm256_sub_ps(_mm256_loadu_ps(pixels + component * channelStride + i),
+                                          _mm256_loadu_ps(neighbors + component * channelStride + i));
+        if(TKernel::Weighted)
+          {
+          sum = _mm256_fmadd_ps(_mm256_mul_ps(difference, difference), _mm256_set1_ps(weights[component]), sum);
+          }
+        else
+          {
+          sum = _mm256_fmadd_ps(difference, difference, sum);
+          }
+        }
+      }
+
+    __m256 weight = ExpAVX2(_mm256_mul_ps(_mm256_set1_ps(scale), _mm256_mul_ps(sum, sum)));
+    __m256 valid = _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(validity + i), zero, _CMP_NEQ_UQ),
+                                 _mm256_cmp_ps(_mm256_loadu_ps(neighborValidity + i), zero, _CMP_NEQ_UQ));
+    _mm256_storeu_ps(output + i, _mm256_and_ps(weight, valid));
+    }
+
+  ComputeNWeightRowSSE2<TKernel>(pixels + i, neighbors + i, channelStride, weights, scale, count - i, output + i);
+}
+
+#endif
+
+/** Get the fastest row kernel for TKernel which the CPU supports */
+template <typename TKernel>
+NWeightRowFunction GetNWeightRowFunction()
+{
+#ifdef NWEIGHTKERNELS_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+    return &ComputeNWeightRowAVX2<TKernel>;
+    }
+  if(__builtin_cpu_supports("sse2"))
+    {
+    return &ComputeNWeightRowSSE2<TKernel>;
+    }
+#endif
+  return &ComputeNWeightRowScalar<TKernel>;
+}
+
+#endif
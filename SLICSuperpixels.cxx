@@ -0,0 +1,292 @@
+/*
+Copyright (C) 2010 David Doria, daviddoria@gmail.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SLICSuperpixels.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Qt
+#include <QFuture>
+#include <QThread>
+#include <QtConcurrentRun>
+
+// Added to the distance to a center of the other validity, so that such a center is only chosen if there is no other
+static const float ValidityMismatchDistance = 1e10f;
+
+// The number of values accumulated per center: 4 features, validity, x, y, count
+static const unsigned int NumberOfSums = 8;
+
+SLICSuperpixels::SLICSuperpixels()
+{
+  this->SuperpixelSize = 100;
+  this->Compactness = 0.2f;
+  this->NumberOfIterations = 5;
+}
+
+unsigned int SLICSuperpixels::Compute(const ImageType* const image, LabelImageType* const labels)
+{
+  itk::ImageRegion<2> region = image->GetLargestPossibleRegion();
+  this->Width = region.GetSize()[0];
+  this->Height = region.GetSize()[1];
+  unsigned int numberOfPixels = this->Width * this->Height;
+
+  this->Step = std::max(1, static_cast<int>(sqrt(static_cast<float>(this->SuperpixelSize)) + 0.5f));
+  this->GridWidth = (this->Width + this->Step - 1) / this->Step;
+  this->GridHeight = (this->Height + this->Step - 1) / this->Step;
+  this->SpatialWeight = (this->Compactness / this->Step) * (this->Compactness / this->Step);
+
+  // Normalize the color and depth channels to [0,1]
+  const float* buffer = image->GetBufferPointer();
+  const unsigned int numberOfComponents = image->GetNumberOfComponentsPerPixel();
+
+  float minimum[4];
+  float maximum[4];
+  for(unsigned int channel = 0; channel < 4; ++channel)
+    {
+    minimum[channel] = std::numeric_limits<float>::max();
+    maximum[channel] = -std::numeric_limits<float>::max();
+    }
+  for(unsigned int pixelId = 0; pixelId < numberOfPixels; ++pixelId)
+    {
+    for(unsigned int channel = 0; channel < 4; ++channel)
+      {
+      minimum[channel] = std::min(minimum[channel], buffer[pixelId * numberOfComponents + channel]);
+      maximum[channel] = std::max(maximum[channel], buffer[pixelId * numberOfComponents + channel]);
+      }
+    }
+
+  this->Features.resize(4 * numberOfPixels);
+  this->Validity.resize(numberOfPixels);
+  for(unsigned int pixelId = 0; pixelId < numberOfPixels; ++pixelId)
+    {
+    for(unsigned int channel = 0; channel < 4; ++channel)
+      {
+      float range = maximum[channel] - minimum[channel];
+      this->Features[4 * pixelId + channel] =
+          range > 0 ? (buffer[pixelId * numberOfComponents + channel] - minimum[channel]) / range : 0.0f;
+      }
+    this->Validity[pixelId] = buffer[pixelId * numberOfComponents + 4] != 0;
+    }
+
+  // Start with one center in the middle of every grid cell
+  this->Centers.resize(this->GridWidth * this->GridHeight);
+  for(unsigned int gridY = 0; gridY < this->GridHeight; ++gridY)
+    {
+    for(unsigned int gridX = 0; gridX < this->GridWidth; ++gridX)
+      {
+      Center& center = this->Centers[gridY * this->GridWidth + gridX];
+      unsigned int x = std::min(gridX * this->Step + this->Step / 2, this->Width - 1);
+      unsigned int y = std::min(gridY * this->Step + this->Step / 2, this->Height - 1);
+      unsigned int pixelId = y * this->Width + x;
+      for(unsigned int channel = 0; channel < 4; ++channel)
+        {
+        center.Features[channel] = this->Features[4 * pixelId + channel];
+        }
+      center.Validity = this->Validity[pixelId];
+      center.X = x;
+      center.Y = y;
+      center.Count = 1;
+      }
+    }
+
+  // Split the rows into about 4 blocks per core (every block has at least one row)
+  unsigned int numberOfBlocks = std::max(1, std::min(static_cast<int>(this->Height), 4 * QThread::idealThreadCount()));
+  this->RowBlocks.resize(numberOfBlocks + 1);
+  for(unsigned int block = 0; block <= numberOfBlocks; ++block)
+    {
+    this->RowBlocks[block] = block * this->Height / numberOfBlocks;
+    }
+
+  // At least one iteration is needed to assign the pixels
+  this->Labels.resize(numberOfPixels);
+  for(unsigned int iteration = 0; iteration < std::max(1u, this->NumberOfIterations); ++iteration)
+    {
+    AssignAllRows();
+    UpdateCenters();
+    }
+
+  // Number the centers which have pixels consecutively
+  std::vector<unsigned int> newLabels(this->Centers.size());
+  unsigned int numberOfSuperpixels = 0;
+  for(unsigned int centerId = 0; centerId < this->Centers.size(); ++centerId)
+    {
+    newLabels[centerId] = numberOfSuperpixels;
+    if(this->Centers[centerId].Count > 0)
+      {
+      numberOfSuperpixels++;
+      }
+    }
+
+  labels->SetRegions(region);
+  labels->Allocate();
+  unsigned int* labelBuffer = labels->GetBufferPointer();
+  for(unsigned int pixelId = 0; pixelId < numberOfPixels; ++pixelId)
+    {
+    labelBuffer[pixelId] = newLabels[this->Labels[pixelId]];
+    }
+
+  // Release the memory
+  std::vector<float>().swap(this->Features);
+  std::vector<unsigned char>().swap(this->Validity);
+  std::vector<unsigned int>().swap(this->Labels);
+  std::vector<Center>().swap(this->Centers);
+
+  return numberOfSuperpixels;
+}
+
+void SLICSuperpixels::AssignAllRows()
+{
+  std::vector<QFuture<void> > futures;
+  for(unsigned int block = 0; block + 1 < this->RowBlocks.size(); ++block)
+    {
+    futures.push_back(QtConcurrent::run(this, &SLICSuperpixels::AssignRows,
+                                        this->RowBlocks[block], this->RowBlocks[block + 1]));
+    }
+  for(unsigned int i = 0; i < futures.size(); ++i)
+    {
+    futures[i].waitForFinished();
+    }
+}
+
+void SLICSuperpixels::AssignRows(const unsigned int y0, const unsigned int y1)
+{
+  for(unsigned int y = y0; y < y1; ++y)
+    {
+    unsigned int gridY = std::min(y / this->Step, this->GridHeight - 1);
+    for(unsigned int x = 0; x < this->Width; ++x)
+      {
+      unsigned int gridX = std::min(x / this->Step, this->GridWidth - 1);
+      unsigned int pixelId = y * this->Width + x;
+      const float* features = &this->Features[4 * pixelId];
+
+      float minimumDistance = std::numeric_limits<float>::max();
+      unsigned int label = gridY * this->GridWidth + gridX;
+
+      // Only the centers of the neighboring grid cells are considered
+      for(unsigned int neighborY = (gridY > 0 ? gridY - 1 : 0);
+          neighborY <= std::min(gridY + 1, this->GridHeight - 1); ++neighborY)
+        {
+        for(unsigned int neighborX = (gridX > 0 ? gridX - 1 : 0);
+            neighborX <= std::min(gridX + 1, this->GridWidth - 1); ++neighborX)
+          {
+          unsigned int centerId = neighborY * this->GridWidth + neighborX;
+          const Center& center = this->Centers[centerId];
+          if(center.Count == 0)
+            {
+            continue;
+            }
+
+          float distance = 0.0f;
+          for(unsigned int channel = 0; channel < 4; ++channel)
+            {
+            float difference = features[channel] - center.Features[channel];
+            distance += difference * difference;
+            }
+          float dx = x - center.X;
+          float dy = y - center.Y;
+          distance += this->SpatialWeight * (dx * dx + dy * dy);
+          if(this->Validity[pixelId] != (center.Validity >= 0.5f))
+            {
+            distance += ValidityMismatchDistance;
+            }
+
+          if(distance < minimumDistance)
+            {
+            minimumDistance = distance;
+            label = centerId;
+            }
+          }
+        }
+
+      this->Labels[pixelId] = label;
+      }
+    }
+}
+
+std::vector<double> SLICSuperpixels::AccumulateRows(const unsigned int y0, const unsigned int y1)
+{
+  // The pixels of these rows can only belong to the centers of the grid rows around them
+  unsigned int firstGridY = std::min(y0 / this->Step, this->GridHeight - 1);
+  firstGridY = firstGridY > 0 ? firstGridY - 1 : 0;
+  unsigned int firstCenter = firstGridY * this->GridWidth;
+  unsigned int lastGridY = std::min((y1 - 1) / this->Step + 1, this->GridHeight - 1);
+  unsigned int numberOfCenters = (lastGridY + 1) * this->GridWidth - firstCenter;
+
+  std::vector<double> sums(NumberOfSums * numberOfCenters, 0.0);
+  for(unsigned int y = y0; y < y1; ++y)
+    {
+    for(unsigned int x = 0; x < this->Width; ++x)
+      {
+      unsigned int pixelId = y * this->Width + x;
+      double* centerSums = &sums[NumberOfSums * (this->Labels[pixelId] - firstCenter)];
+      for(unsigned int channel = 0; channel < 4; ++channel)
+        {
+        centerSums[channel] += this->Features[4 * pixelId + channel];
+        }
+      centerSums[4] += this->Validity[pixelId];
+      centerSums[5] += x;
+      centerSums[6] += y;
+      centerSums[7] += 1.0;
+      }
+    }
+  return sums;
+}
+
+void SLICSuperpixels::UpdateCenters()
+{
+  std::vector<QFuture<std::vector<double> > > futures;
+  for(unsigned int block = 0; block + 1 < this->RowBlocks.size(); ++block)
+    {
+    futures.push_back(QtConcurrent::run(this, &SLICSuperpixels::AccumulateRows,
+                                        this->RowBlocks[block], this->RowBlocks[block + 1]));
+    }
+
+  std::vector<double> sums(NumberOfSums * this->Centers.size(), 0.0);
+  for(unsigned int block = 0; block < futures.size(); ++block)
+    {
+    std::vector<double> blockSums = futures[block].result();
+
+    unsigned int firstGridY = std::min(this->RowBlocks[block] / this->Step, this->GridHeight - 1);
+    firstGridY = firstGridY > 0 ? firstGridY - 1 : 0;
+    unsigned int offset = NumberOfSums * firstGridY * this->GridWidth;
+    for(unsigned int i = 0; i < blockSums.size(); ++i)
+      {
+      sums[offset + i] += blockSums[i];
+      }
+    }
+
+  for(unsigned int centerId = 0; centerId < this->Centers.size(); ++centerId)
+    {
+    Center& center = this->Centers[centerId];
+    const double* centerSums = &sums[NumberOfSums * centerId];
+    center.Count = static_cast<unsigned int>(centerSums[7]);
+    if(center.Count == 0)
+      {
+      continue;
+      }
+    for(unsigned int channel = 0; channel < 4; ++channel)
+      {
+      center.Features[channel] = centerSums[channel] / center.Count;
+      }
+    center.Validity = centerSums[4] / center.Count;
+    center.X = centerSums[5] / center.Count;
+    center.Y = centerSums[6] / center.Count;
+    }
+}
@@ -0,0 +1,102 @@
+/*
+Copyright (C) 2010 David Doria, daviddoria@gmail.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * SLIC superpixels (Achanta et al., "SLIC Superpixels Compared to State-of-the-Art Superpixel Methods",
+ * PAMI 2012) of an RGBDV image. The distance between a pixel and a cluster center combines the color and depth
+ * channels (normalized to [0,1]) with the spatial distance. Valid and invalid pixels (channel 4) are never put into
+ * the same superpixel unless there is no other choice. Each pixel is compared to the centers of the 3x3 initial
+ * grid cells around it, so the rows of the image can be assigned in parallel.
+ * The superpixels are not made connected; a superpixel can consist of several pieces.
+*/
+
+#ifndef SLICSuperpixels_H
+#define SLICSuperpixels_H
+
+// ITK
+#include "itkImage.h"
+
+// STL
+#include <vector>
+
+// Custom
+#include "Types.h"
+
+class SLICSuperpixels
+{
+public:
+  typedef itk::Image<unsigned int, 2> LabelImageType;
+
+  SLICSuperpixels();
+
+  /** The approximate number of pixels per superpixel */
+  unsigned int SuperpixelSize;
+
+  /** The weight of the spatial distance relative to the color and depth distance */
+  float Compactness;
+
+  unsigned int NumberOfIterations;
+
+  /** Compute the superpixels of 'image' and store their labels in 'labels' (which is allocated here).
+   *  The labels are consecutive, starting at 0. Returns the number of superpixels. */
+  unsigned int Compute(const ImageType* const image, LabelImageType* const labels);
+
+private:
+  struct Center
+  {
+    float Features[4];
+    float Validity;
+    float X;
+    float Y;
+    unsigned int Count;
+  };
+
+  /** Assign the pixels of rows y0 ... y1-1 to their nearest center */
+  void AssignRows(const unsigned int y0, const unsigned int y1);
+
+  /** Sum the features, validity and positions of the pixels of rows y0 ... y1-1 per center */
+  std::vector<double> AccumulateRows(const unsigned int y0, const unsigned int y1);
+
+  /** Assign all pixels and move every center to the mean of its pixels. Both run on blocks of rows on all cores. */
+  void AssignAllRows();
+  void UpdateCenters();
+
+  unsigned int Width;
+  unsigned int Height;
+
+  /** The side of a grid cell (the initial distance between centers) */
+  unsigned int Step;
+  unsigned int GridWidth;
+  unsigned int GridHeight;
+
+  /** (Compactness / Step)^2 */
+  float SpatialWeight;
+
+  /** The normalized color and depth of every pixel (4 per pixel) and its validity */
+  std::vector<float> Features;
+  std::vector<unsigned char> Validity;
+
+  std::vector<Center> Centers;
+
+  /** The center index of every pixel */
+  std::vector<unsigned int> Labels;
+
+  /** The first row of every block of rows which is processed by one thread (and the end of the last block) */
+  std::vector<unsigned int> RowBlocks;
+};
+
+#endif
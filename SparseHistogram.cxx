@@ -0,0 +1,138 @@
+/*
+Copyright (C) 2010 David Doria, daviddoria@gmail.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SparseHistogram.h"
+
+// STL
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+const unsigned int SparseHistogram::EmptySlot;
+
+// The number of slots of an empty histogram (a power of 2)
+static const unsigned int MinimumNumberOfSlots = 16;
+
+SparseHistogram::SparseHistogram()
+{
+  Initialize(0);
+}
+
+void SparseHistogram::Initialize(const unsigned int numberOfBins)
+{
+  if(numberOfBins >= EmptySlot)
+    {
+    throw std::runtime_error("SparseHistogram::Initialize: too many bins");
+    }
+
+  this->Bins.assign(MinimumNumberOfSlots, EmptySlot);
+  this->Counts.assign(MinimumNumberOfSlots, 0);
+  this->NegativeLogCounts.assign(MinimumNumberOfSlots, std::numeric_limits<float>::infinity());
+  this->SlotMask = MinimumNumberOfSlots - 1;
+  this->HashShift = 28; // 32 - log2(MinimumNumberOfSlots)
+  this->NumberOfStoredBins = 0;
+  this->TotalCount = 0;
+  this->ChangedBins.clear();
+  this->LogTotalCount = std::numeric_limits<float>::infinity();
+  this->MaximumNegativeLogLikelihood = 0.0f;
+}
+
+void SparseHistogram::AddSample(const unsigned int bin)
+{
+  this->TotalCount++;
+  this->ChangedBins.push_back(bin);
+
+  unsigned int slot = GetFirstSlot(bin);
+  while(this->Bins[slot] != bin && this->Bins[slot] != EmptySlot)
+    {
+    slot = (slot + 1) & this->SlotMask;
+    }
+  if(this->Bins[slot] == bin)
+    {
+    this->Counts[slot]++;
+    return;
+    }
+
+  // A new bin
+  this->Bins[slot] = bin;
+  this->Counts[slot] = 1;
+  this->NumberOfStoredBins++;
+  if(2 * this->NumberOfStoredBins > this->Bins.size())
+    {
+    Grow();
+    }
+}
+
+void SparseHistogram::RemoveSample(const unsigned int bin)
+{
+  this->TotalCount--;
+  this->ChangedBins.push_back(bin);
+  this->Counts[FindSlot(bin)]--;
+}
+
+unsigned int SparseHistogram::FindSlot(const unsigned int bin) const
+{
+  unsigned int slot = GetFirstSlot(bin);
+  while(this->Bins[slot] != bin)
+    {
+    slot = (slot + 1) & this->SlotMask;
+    }
+  return slot;
+}
+
+void SparseHistogram::Grow()
+{
+  std::vector<unsigned int> bins(2 * this->Bins.size(), EmptySlot);
+  std::vector<unsigned int> counts(2 * this->Bins.size(), 0);
+  std::vector<float> negativeLogCounts(2 * this->Bins.size(), std::numeric_limits<float>::infinity());
+  bins.swap(this->Bins);
+  counts.swap(this->Counts);
+  negativeLogCounts.swap(this->NegativeLogCounts);
+  this->SlotMask = this->Bins.size() - 1;
+  this->HashShift--;
+
+  for(unsigned int oldSlot = 0; oldSlot < bins.size(); ++oldSlot)
+    {
+    if(bins[oldSlot] == EmptySlot)
+      {
+      continue;
+      }
+    unsigned int slot = GetFirstSlot(bins[oldSlot]);
+    while(this->Bins[slot] != EmptySlot)
+      {
+      slot = (slot + 1) & this->SlotMask;
+      }
+    this->Bins[slot] = bins[oldSlot];
+    this->Counts[slot] = counts[oldSlot];
+    this->NegativeLogCounts[slot] = negativeLogCounts[oldSlot];
+    }
+}
+
+void SparseHistogram::ComputeNegativeLogLikelihoods(const float minimumProbability)
+{
+  for(unsigned int i = 0; i < this->ChangedBins.size(); ++i)
+    {
+    const unsigned int slot = FindSlot(this->ChangedBins[i]);
+    this->NegativeLogCounts[slot] = this->Counts[slot] > 0 ? -log(static_cast<float>(this->Counts[slot])) :
+                                                             std::numeric_limits<float>::infinity();
+    }
+  this->ChangedBins.clear();
+
+  this->LogTotalCount = this->TotalCount > 0 ? log(static_cast<float>(this->TotalCount)) :
+                                               std::numeric_limits<float>::infinity();
+  this->MaximumNegativeLogLikelihood = -log(minimumProbability);
+}
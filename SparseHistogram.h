@@ -0,0 +1,103 @@
+/*
+Copyright (C) 2010 David Doria, daviddoria@gmail.com
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * A histogram with the interface of FlatHistogram which only stores the bins that have pixels, in an open addressing
+ * hash table (linear probing). The seeds usually fall into a tiny fraction of the bins of a fine 4 channel binning,
+ * so its memory depends on the number of seed pixels instead of the number of bins.
+*/
+
+#ifndef SparseHistogram_H
+#define SparseHistogram_H
+
+// STL
+#include <algorithm>
+#include <vector>
+
+class SparseHistogram
+{
+public:
+  SparseHistogram();
+
+  /** Make an empty histogram of 'numberOfBins' bins (which must be less than 2^32 - 1) */
+  void Initialize(const unsigned int numberOfBins);
+
+  /** Count a pixel in 'bin' */
+  void AddSample(const unsigned int bin);
+
+  /** Remove a pixel which was counted in 'bin'. The bin keeps its slot (with a count of 0). */
+  void RemoveSample(const unsigned int bin);
+
+  unsigned int GetTotalCount() const
+  {
+    return this->TotalCount;
+  }
+
+  /** See FlatHistogram */
+  void ComputeNegativeLogLikelihoods(const float minimumProbability);
+
+  /** See FlatHistogram. The bins which are not stored get -log(minimumProbability). */
+  float GetNegativeLogLikelihood(const unsigned int bin) const
+  {
+    for(unsigned int slot = GetFirstSlot(bin); ; slot = (slot + 1) & this->SlotMask)
+      {
+      if(this->Bins[slot] == bin)
+        {
+        return std::min(this->NegativeLogCounts[slot] + this->LogTotalCount, this->MaximumNegativeLogLikelihood);
+        }
+      if(this->Bins[slot] == EmptySlot)
+        {
+        return this->MaximumNegativeLogLikelihood;
+        }
+      }
+  }
+
+private:
+  /** Marks a free slot; no bin can have this id */
+  static const unsigned int EmptySlot = 0xFFFFFFFF;
+
+  /** The slot the search for a bin starts at. Fibonacci hashing (the top bits of the bin times 2^32 / golden ratio),
+   *  so that the bins of neighboring colors spread over the table. */
+  unsigned int GetFirstSlot(const unsigned int bin) const
+  {
+    return (bin * 2654435769u) >> this->HashShift;
+  }
+
+  /** Double the number of slots */
+  void Grow();
+
+  /** Get the slot of a stored bin */
+  unsigned int FindSlot(const unsigned int bin) const;
+
+  /** The bin of every slot (EmptySlot if it is free), its count and its -log(count) (infinity if the count is 0).
+   *  There are always at least twice as many slots as stored bins, a power of 2. */
+  std::vector<unsigned int> Bins;
+  std::vector<unsigned int> Counts;
+  std::vector<float> NegativeLogCounts;
+  unsigned int SlotMask;
+  unsigned int HashShift;
+  unsigned int NumberOfStoredBins;
+
+  unsigned int TotalCount;
+
+  /** See FlatHistogram */
+  std::vector<unsigned int> ChangedBins;
+  float LogTotalCount;
+  float MaximumNegativeLogLikelihood;
+};
+
+#endif
@@ -36,12 +36,12 @@ class vtkPolyData;
 
 // Kolmogorov
 #include "graph.h"
-typedef Graph GraphType;
+typedef Graph<float, float, double> GraphType;
 
 // Typedefs
 
 // This is a special type to keep track of the graph node labels
-typedef itk::Image<void*, 2> NodeImageType;
+typedef itk::Image<GraphType::node_id, 2> NodeImageType;
 
 typedef itk::Statistics::Histogram< float,
         itk::Statistics::DenseFrequencyContainer2 > HistogramType;
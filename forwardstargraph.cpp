@@ -0,0 +1,689 @@
+/* forwardstargraph.cpp */
+/*
+	Forward star version of the maxflow algorithm in maxflow.cpp.
+	The algorithm is identical; only the graph representation differs
+	(see forwardstargraph.h).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "forwardstargraph.h"
+
+/*
+	special constants for node->parent
+	(NONE means that the node has no parent)
+*/
+#define TERMINAL ( (arc_id) 0xFFFFFFFE )		/* to terminal */
+#define ORPHAN   ( (arc_id) 0xFFFFFFFD )		/* orphan */
+
+#define INFINITE_D 1000000000		/* infinite distance to the terminal */
+
+/*
+	Loops over all arcs a leaving node i: first the arcs of the edges
+	added from i, then the reverse arcs of the edges added to i.
+	k is a scratch variable. After a 'break', a is the current arc.
+*/
+#define FOR_ALL_ARCS(i, k, a) \
+	for (k=out_first[id(i)]; \
+	     k < out_first[id(i)+1] + (in_first[id(i)+1] - in_first[id(i)]) && \
+	     ((a = (k < out_first[id(i)+1]) ? (k << 1) : ((in_edge[in_first[id(i)] + k - out_first[id(i)+1]] << 1) | 1)), 1); \
+	     k++)
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	ForwardStarGraph<captype,tcaptype,flowtype>::ForwardStarGraph(int node_num_max, int edge_num_max, void (*err_function)(const char *))
+	: node_num(0), edge_num(0),
+	  out_first(NULL), in_first(NULL), in_edge(NULL), ends(NULL), r_cap(NULL),
+	  error_function(err_function),
+	  orphans(NULL)
+{
+	if (node_num_max < 16) node_num_max = 16;
+	if (edge_num_max < 16) edge_num_max = 16;
+
+	node_max = (node_id) node_num_max;
+	edge_max = (uint32_t) edge_num_max;
+
+	nodes = (node*) malloc(node_max*sizeof(node));
+	edges = (edge*) malloc(edge_max*sizeof(edge));
+	if (!nodes || !edges) error("Not enough memory!");
+
+	flow = 0;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	ForwardStarGraph<captype,tcaptype,flowtype>::~ForwardStarGraph()
+{
+	free(nodes);
+	free(edges);
+	free(out_first);
+	free(in_first);
+	free(in_edge);
+	free(ends);
+	free(r_cap);
+	free(orphans);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void ForwardStarGraph<captype,tcaptype,flowtype>::error(const char *msg)
+{
+	if (error_function) (*error_function)(msg);
+	exit(1);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	typename ForwardStarGraph<captype,tcaptype,flowtype>::node_id ForwardStarGraph<captype,tcaptype,flowtype>::add_node(int num)
+{
+	if (!edges) error("Nodes cannot be added after maxflow()!");
+	if ((uint64_t) node_num + num > node_max)
+	{
+		uint64_t new_max = (uint64_t) node_max + node_max / 2;
+		if (new_max < (uint64_t) node_num + num) new_max = (uint64_t) node_num + num;
+		if (new_max >= NONE / 2) error("Too many nodes!");
+		node_max = (node_id) new_max;
+		nodes = (node*) realloc(nodes, node_max*sizeof(node));
+		if (!nodes) error("Not enough memory!");
+	}
+
+	node_id first = node_num;
+	for (node *i=nodes+node_num; i<nodes+node_num+num; i++)
+	{
+		i -> parent = NONE;
+		i -> next = NONE;
+		i -> TS = 0;
+		i -> DIST = 0;
+		i -> is_sink = 0;
+		i -> tr_cap = 0;
+	}
+	node_num += num;
+
+	return first;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void ForwardStarGraph<captype,tcaptype,flowtype>::reallocate_edges(int num)
+{
+	uint64_t new_max = (uint64_t) edge_max + edge_max / 2;
+	if (new_max < (uint64_t) edge_num + num) new_max = (uint64_t) edge_num + num;
+	/* arc ids 2*e+1 must stay below the special values for node->parent */
+	if (new_max > 0x7FFFFFFE) new_max = 0x7FFFFFFE;
+	if (new_max < (uint64_t) edge_num + num) error("Too many edges!");
+	edge_max = (uint32_t) new_max;
+	edges = (edge*) realloc(edges, edge_max*sizeof(edge));
+	if (!edges) error("Not enough memory!");
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void ForwardStarGraph<captype,tcaptype,flowtype>::add_edge(node_id from, node_id to, captype cap, captype rev_cap)
+{
+	if (!edges) error("Edges cannot be added after maxflow()!");
+	if (edge_num == edge_max) reallocate_edges(1);
+
+	set_edge(edge_num ++, from, to, cap, rev_cap);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	typename ForwardStarGraph<captype,tcaptype,flowtype>::edge_id ForwardStarGraph<captype,tcaptype,flowtype>::add_edges(int num)
+{
+	if (!edges) error("Edges cannot be added after maxflow()!");
+	if ((uint64_t) edge_num + num > edge_max) reallocate_edges(num);
+
+	edge_id first = edge_num;
+	edge_num += num;
+
+	return first;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void ForwardStarGraph<captype,tcaptype,flowtype>::set_edge(edge_id e, node_id from, node_id to, captype cap, captype rev_cap)
+{
+	edge *ed = edges + e;
+	ed -> from = from;
+	ed -> to = to;
+	ed -> cap = cap;
+	ed -> rev_cap = rev_cap;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void ForwardStarGraph<captype,tcaptype,flowtype>::set_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink)
+{
+	flow += (cap_source < cap_sink) ? cap_source : cap_sink;
+	nodes[i].tr_cap = cap_source - cap_sink;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void ForwardStarGraph<captype,tcaptype,flowtype>::add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink)
+{
+	tcaptype delta = nodes[i].tr_cap;
+	if (delta > 0) cap_source += delta;
+	else           cap_sink   -= delta;
+	flow += (cap_source < cap_sink) ? cap_source : cap_sink;
+	nodes[i].tr_cap = cap_source - cap_sink;
+}
+
+/***********************************************************************/
+
+/*
+	Sorts the edges by their first node (counting sort) and builds
+	the lists of the incoming edges of every node
+*/
+template <typename captype, typename tcaptype, typename flowtype>
+	void ForwardStarGraph<captype,tcaptype,flowtype>::prepare_graph()
+{
+	node_id i;
+	uint32_t e, k;
+
+	out_first = (uint32_t*) malloc((node_num+1)*sizeof(uint32_t));
+	in_first  = (uint32_t*) malloc((node_num+1)*sizeof(uint32_t));
+	in_edge   = (uint32_t*) malloc(edge_num*sizeof(uint32_t) + 1);
+	ends      = (node_id*) malloc(edge_num*sizeof(node_id) + 1);
+	r_cap     = (captype*) malloc(2*edge_num*sizeof(captype) + 1);
+	orphans   = (node_id*) malloc((node_num+1)*sizeof(node_id));
+	if (!out_first || !in_first || !in_edge || !ends || !r_cap || !orphans) error("Not enough memory!");
+
+	/* count the outgoing and incoming edges of every node */
+	for (i=0; i<=node_num; i++) out_first[i] = in_first[i] = 0;
+	for (e=0; e<edge_num; e++)
+	{
+		out_first[edges[e].from + 1] ++;
+		in_first[edges[e].to + 1] ++;
+	}
+	for (i=0; i<node_num; i++)
+	{
+		out_first[i+1] += out_first[i];
+		in_first[i+1] += in_first[i];
+	}
+
+	/* place the edges; out_first[i] and in_first[i] are used as insertion positions
+	   and are shifted back by one node afterwards */
+	for (e=0; e<edge_num; e++)
+	{
+		edge *ed = edges + e;
+		k = out_first[ed->from] ++;
+		ends[k] = ed->from ^ ed->to;
+		r_cap[2*k] = ed->cap;
+		r_cap[2*k+1] = ed->rev_cap;
+		in_edge[in_first[ed->to] ++] = k;
+	}
+	for (i=node_num; i>0; i--)
+	{
+		out_first[i] = out_first[i-1];
+		in_first[i] = in_first[i-1];
+	}
+	out_first[0] = in_first[0] = 0;
+
+	free(edges);
+	edges = NULL;
+}
+
+/***********************************************************************/
+
+/*
+	Functions for processing active list.
+	See maxflow.cpp for a description of the two queues.
+*/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void ForwardStarGraph<captype,tcaptype,flowtype>::set_active(node *i)
+{
+	if (i->next == NONE)
+	{
+		/* it's not in the list yet */
+		if (queue_last[1] != NONE) nodes[queue_last[1]].next = id(i);
+		else                       queue_first[1]            = id(i);
+		queue_last[1] = id(i);
+		i -> next = id(i);
+	}
+}
+
+/*
+	Returns the next active node.
+	If it is connected to the sink, it stays in the list,
+	otherwise it is removed from the list
+*/
+template <typename captype, typename tcaptype, typename flowtype>
+	inline typename ForwardStarGraph<captype,tcaptype,flowtype>::node * ForwardStarGraph<captype,tcaptype,flowtype>::next_active()
+{
+	node *i;
+
+	while ( 1 )
+	{
+		if (queue_first[0] == NONE)
+		{
+			queue_first[0] = queue_first[1];
+			queue_last[0]  = queue_last[1];
+			queue_first[1] = NONE;
+			queue_last[1]  = NONE;
+			if (queue_first[0] == NONE) return NULL;
+		}
+		i = nodes + queue_first[0];
+
+		/* remove it from the active list */
+		if (i->next == id(i)) queue_first[0] = queue_last[0] = NONE;
+		else                  queue_first[0] = i -> next;
+		i -> next = NONE;
+
+		/* a node in the list is active iff it has a parent */
+		if (i->parent != NONE) return i;
+	}
+}
+
+/*
+	A node is never in the orphan list twice, so
+	a ring buffer of node_num+1 entries is sufficient
+*/
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void ForwardStarGraph<captype,tcaptype,flowtype>::add_orphan(node *i)
+{
+	i -> parent = ORPHAN;
+	orphans[orphan_last] = id(i);
+	if (++orphan_last == node_num+1) orphan_last = 0;
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void ForwardStarGraph<captype,tcaptype,flowtype>::maxflow_init()
+{
+	node *i;
+
+	queue_first[0] = queue_last[0] = NONE;
+	queue_first[1] = queue_last[1] = NONE;
+	orphan_first = orphan_last = 0;
+
+	for (i=nodes; i<nodes+node_num; i++)
+	{
+		i -> next = NONE;
+		i -> TS = 0;
+		if (i->tr_cap > 0)
+		{
+			/* i is connected to the source */
+			i -> is_sink = 0;
+			i -> parent = TERMINAL;
+			set_active(i);
+			i -> DIST = 1;
+		}
+		else if (i->tr_cap < 0)
+		{
+			/* i is connected to the sink */
+			i -> is_sink = 1;
+			i -> parent = TERMINAL;
+			set_active(i);
+			i -> DIST = 1;
+		}
+		else
+		{
+			i -> is_sink = 0;
+			i -> parent = NONE;
+		}
+	}
+	TIME = 0;
+}
+
+/***********************************************************************/
+
+/*
+	The middle arc goes from node 'middle_from' (in the source tree)
+	to a node in the sink tree
+*/
+template <typename captype, typename tcaptype, typename flowtype>
+	void ForwardStarGraph<captype,tcaptype,flowtype>::augment(node *middle_from, arc_id middle_arc)
+{
+	node *i, *p;
+	arc_id a;
+	captype bottleneck;
+	node *middle_to = head(middle_from, middle_arc);
+
+
+	/* 1. Finding bottleneck capacity */
+	/* 1a - the source tree */
+	bottleneck = r_cap[middle_arc];
+	for (i=middle_from; ; i=p)
+	{
+		a = i -> parent;
+		if (a == TERMINAL) break;
+		p = head(i, a);
+		if (bottleneck > r_cap[a^1]) bottleneck = r_cap[a^1];
+	}
+	if (bottleneck > i->tr_cap) bottleneck = i -> tr_cap;
+	/* 1b - the sink tree */
+	for (i=middle_to; ; i=p)
+	{
+		a = i -> parent;
+		if (a == TERMINAL) break;
+		p = head(i, a);
+		if (bottleneck > r_cap[a]) bottleneck = r_cap[a];
+	}
+	if (bottleneck > - i->tr_cap) bottleneck = - i -> tr_cap;
+
+
+	/* 2. Augmenting */
+	/* 2a - the source tree */
+	r_cap[middle_arc^1] += bottleneck;
+	r_cap[middle_arc] -= bottleneck;
+	for (i=middle_from; ; i=p)
+	{
+		a = i -> parent;
+		if (a == TERMINAL) break;
+		p = head(i, a);
+		r_cap[a] += bottleneck;
+		r_cap[a^1] -= bottleneck;
+		if (!r_cap[a^1])
+		{
+			/* add i to the adoption list */
+			add_orphan(i);
+		}
+	}
+	i -> tr_cap -= bottleneck;
+	if (!i->tr_cap)
+	{
+		/* add i to the adoption list */
+		add_orphan(i);
+	}
+	/* 2b - the sink tree */
+	for (i=middle_to; ; i=p)
+	{
+		a = i -> parent;
+		if (a == TERMINAL) break;
+		p = head(i, a);
+		r_cap[a^1] += bottleneck;
+		r_cap[a] -= bottleneck;
+		if (!r_cap[a])
+		{
+			/* add i to the adoption list */
+			add_orphan(i);
+		}
+	}
+	i -> tr_cap += bottleneck;
+	if (!i->tr_cap)
+	{
+		/* add i to the adoption list */
+		add_orphan(i);
+	}
+
+
+	flow += bottleneck;
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void ForwardStarGraph<captype,tcaptype,flowtype>::process_source_orphan(node *i)
+{
+	node *j;
+	arc_id a0, a0_min = NONE, a;
+	uint32_t k;
+	int d, d_min = INFINITE_D;
+
+	/* trying to find a new parent */
+	FOR_ALL_ARCS(i, k, a0)
+	if (r_cap[a0^1])
+	{
+		j = head(i, a0);
+		if (!j->is_sink && (a=j->parent) != NONE)
+		{
+			/* checking the origin of j */
+			d = 0;
+			while ( 1 )
+			{
+				if (j->TS == TIME)
+				{
+					d += j -> DIST;
+					break;
+				}
+				a = j -> parent;
+				d ++;
+				if (a==TERMINAL)
+				{
+					j -> TS = TIME;
+					j -> DIST = 1;
+					break;
+				}
+				if (a==ORPHAN) { d = INFINITE_D; break; }
+				j = head(j, a);
+			}
+			if (d<INFINITE_D) /* j originates from the source - done */
+			{
+				if (d<d_min)
+				{
+					a0_min = a0;
+					d_min = d;
+				}
+				/* set marks along the path */
+				for (j=head(i, a0); j->TS!=TIME; j=head(j, j->parent))
+				{
+					j -> TS = TIME;
+					j -> DIST = d --;
+				}
+			}
+		}
+	}
+
+	if ((i->parent = a0_min) != NONE)
+	{
+		i -> TS = TIME;
+		i -> DIST = d_min + 1;
+	}
+	else
+	{
+		/* no parent is found */
+		i -> TS = 0;
+
+		/* process neighbors */
+		FOR_ALL_ARCS(i, k, a0)
+		{
+			j = head(i, a0);
+			if (!j->is_sink && (a=j->parent) != NONE)
+			{
+				if (r_cap[a0^1]) set_active(j);
+				if (a!=TERMINAL && a!=ORPHAN && head(j, a)==i)
+				{
+					/* add j to the adoption list */
+					add_orphan(j);
+				}
+			}
+		}
+	}
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void ForwardStarGraph<captype,tcaptype,flowtype>::process_sink_orphan(node *i)
+{
+	node *j;
+	arc_id a0, a0_min = NONE, a;
+	uint32_t k;
+	int d, d_min = INFINITE_D;
+
+	/* trying to find a new parent */
+	FOR_ALL_ARCS(i, k, a0)
+	if (r_cap[a0])
+	{
+		j = head(i, a0);
+		if (j->is_sink && (a=j->parent) != NONE)
+		{
+			/* checking the origin of j */
+			d = 0;
+			while ( 1 )
+			{
+				if (j->TS == TIME)
+				{
+					d += j -> DIST;
+					break;
+				}
+				a = j -> parent;
+				d ++;
+				if (a==TERMINAL)
+				{
+					j -> TS = TIME;
+					j -> DIST = 1;
+					break;
+				}
+				if (a==ORPHAN) { d = INFINITE_D; break; }
+				j = head(j, a);
+			}
+			if (d<INFINITE_D) /* j originates from the sink - done */
+			{
+				if (d<d_min)
+				{
+					a0_min = a0;
+					d_min = d;
+				}
+				/* set marks along the path */
+				for (j=head(i, a0); j->TS!=TIME; j=head(j, j->parent))
+				{
+					j -> TS = TIME;
+					j -> DIST = d --;
+				}
+			}
+		}
+	}
+
+	if ((i->parent = a0_min) != NONE)
+	{
+		i -> TS = TIME;
+		i -> DIST = d_min + 1;
+	}
+	else
+	{
+		/* no parent is found */
+		i -> TS = 0;
+
+		/* process neighbors */
+		FOR_ALL_ARCS(i, k, a0)
+		{
+			j = head(i, a0);
+			if (j->is_sink && (a=j->parent) != NONE)
+			{
+				if (r_cap[a0]) set_active(j);
+				if (a!=TERMINAL && a!=ORPHAN && head(j, a)==i)
+				{
+					/* add j to the adoption list */
+					add_orphan(j);
+				}
+			}
+		}
+	}
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	flowtype ForwardStarGraph<captype,tcaptype,flowtype>::maxflow()
+{
+	node *i, *j, *current_node = NULL, *middle_from;
+	arc_id a, middle_arc = NONE;
+	uint32_t k;
+
+	if (edges) prepare_graph();
+
+	maxflow_init();
+
+	while ( 1 )
+	{
+		if ((i=current_node))
+		{
+			i -> next = NONE; /* remove active flag */
+			if (i->parent == NONE) i = NULL;
+		}
+		if (!i)
+		{
+			if (!(i = next_active())) break;
+		}
+
+		middle_from = NULL;
+
+		/* growth */
+		if (!i->is_sink)
+		{
+			/* grow source tree */
+			FOR_ALL_ARCS(i, k, a)
+			if (r_cap[a])
+			{
+				j = head(i, a);
+				if (j->parent == NONE)
+				{
+					j -> is_sink = 0;
+					j -> parent = a^1;
+					j -> TS = i -> TS;
+					j -> DIST = i -> DIST + 1;
+					set_active(j);
+				}
+				else if (j->is_sink) { middle_from = i; middle_arc = a; break; }
+				else if (j->TS <= i->TS &&
+				         j->DIST > i->DIST)
+				{
+					/* heuristic - trying to make the distance from j to the source shorter */
+					j -> parent = a^1;
+					j -> TS = i -> TS;
+					j -> DIST = i -> DIST + 1;
+				}
+			}
+		}
+		else
+		{
+			/* grow sink tree */
+			FOR_ALL_ARCS(i, k, a)
+			if (r_cap[a^1])
+			{
+				j = head(i, a);
+				if (j->parent == NONE)
+				{
+					j -> is_sink = 1;
+					j -> parent = a^1;
+					j -> TS = i -> TS;
+					j -> DIST = i -> DIST + 1;
+					set_active(j);
+				}
+				else if (!j->is_sink) { middle_from = j; middle_arc = a^1; break; }
+				else if (j->TS <= i->TS &&
+				         j->DIST > i->DIST)
+				{
+					/* heuristic - trying to make the distance from j to the sink shorter */
+					j -> parent = a^1;
+					j -> TS = i -> TS;
+					j -> DIST = i -> DIST + 1;
+				}
+			}
+		}
+
+		TIME ++;
+
+		if (middle_from)
+		{
+			i -> next = id(i); /* set active flag */
+			current_node = i;
+
+			/* augmentation */
+			augment(middle_from, middle_arc);
+			/* augmentation end */
+
+			/* adoption */
+			while (orphan_first != orphan_last)
+			{
+				j = nodes + orphans[orphan_first];
+				if (++orphan_first == node_num+1) orphan_first = 0;
+				if (j->is_sink) process_sink_orphan(j);
+				else            process_source_orphan(j);
+			}
+			/* adoption end */
+		}
+		else current_node = NULL;
+	}
+
+	return flow;
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	typename ForwardStarGraph<captype,tcaptype,flowtype>::termtype ForwardStarGraph<captype,tcaptype,flowtype>::what_segment(node_id i)
+{
+	if (nodes[i].parent != NONE && !nodes[i].is_sink) return SOURCE;
+	return SINK;
+}
+
+/***********************************************************************/
+
+/* Instantiations: <captype, tcaptype, flowtype> (see instances.inc) */
+template class ForwardStarGraph<float,float,double>;
+template class ForwardStarGraph<int,int,long long>;
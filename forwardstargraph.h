@@ -0,0 +1,173 @@
+/* forwardstargraph.h */
+/*
+	The maxflow algorithm of graph.h with the forward star graph
+	representation of maxflow-v2.21.src/forward_star, rewritten
+	with 32-bit indices instead of pointer arithmetic (the original
+	casts pointers to int and does not work on 64-bit systems).
+
+	Edges are collected by add_edge() and sorted by their first node
+	before the first call to maxflow(). After that:
+	  - the edges leaving node i are out_first[i] ... out_first[i+1]-1
+	    (edge e goes from node i to some other node),
+	  - the edges entering node i are in_edge[in_first[i]] ...
+	    in_edge[in_first[i+1]-1].
+	An edge is stored only once, together with the residual capacities
+	of both of its arcs. Instead of the head of each arc the edge keeps
+	the XOR of its two end nodes, so the node at the other end of an
+	arc is found from the node it is traversed from. With float
+	capacities an edge takes 16 bytes (24 bytes in Graph).
+
+	The interface is that of Graph, without tree reuse. maxflow() can
+	be called again after the t-weights are changed; it continues
+	from the residual flow, but the search trees are grown from scratch.
+*/
+
+#ifndef __FORWARDSTARGRAPH_H__
+#define __FORWARDSTARGRAPH_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+template <typename captype, typename tcaptype, typename flowtype> class ForwardStarGraph
+{
+public:
+	typedef enum
+	{
+		SOURCE	= 0,
+		SINK	= 1
+	} termtype; /* terminals */
+
+	/* Nodes are numbered 0,1,2,... in the order in which they are added */
+	typedef uint32_t node_id;
+
+	/* interface functions */
+
+	/* Constructor. The first two arguments are estimates of the number
+	   of nodes and edges that will be added (see graph.h).
+	   Optional argument is the pointer to the function which
+	   will be called if an error occurs; an error message is passed
+	   to this function. If this argument is omitted, exit(1) will be called. */
+	ForwardStarGraph(int node_num_max = 0, int edge_num_max = 0, void (*err_function)(const char *) = NULL);
+
+	/* Destructor */
+	~ForwardStarGraph();
+
+	/* Adds 'num' nodes to the graph and returns the id of the first one.
+	   Can only be called before the first call to maxflow(). */
+	node_id add_node(int num = 1);
+
+	/* Adds a bidirectional edge between 'from' and 'to'
+	   with the weights 'cap' and 'rev_cap'.
+	   Can only be called before the first call to maxflow(). */
+	void add_edge(node_id from, node_id to, captype cap, captype rev_cap);
+
+	/* Edges are numbered 0,1,2,... in the order in which they are added */
+	typedef uint32_t edge_id;
+
+	/* Adds 'num' edges and returns the id of the first one. The ids of the
+	   others follow consecutively. Their ends and weights must be set by
+	   set_edge() before maxflow(); set_edge() can be called for different
+	   edges from several threads at once.
+	   Can only be called before the first call to maxflow(). */
+	edge_id add_edges(int num);
+	void set_edge(edge_id e, node_id from, node_id to, captype cap, captype rev_cap);
+
+	/* Sets the weights of the edges 'SOURCE->i' and 'i->SINK'
+	   Can be called at most once for each node before any call to 'add_tweights'.
+	   Weights can be negative */
+	void set_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink);
+
+	/* Adds new edges 'SOURCE->i' and 'i->SINK' with corresponding weights
+	   Can be called multiple times for each node.
+	   Weights can be negative */
+	void add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink);
+
+	/* After the maxflow is computed, this function returns to which
+	   segment the node 'i' belongs (SOURCE or SINK) */
+	termtype what_segment(node_id i);
+
+	/* Computes the maxflow. Can be called several times (see above). */
+	flowtype maxflow();
+
+/***********************************************************************/
+/***********************************************************************/
+/***********************************************************************/
+
+private:
+	/* internal variables and functions */
+
+	/* An arc is 2*e for the arc of edge e in the direction in which the
+	   edge was added and 2*e+1 for the reverse arc; the sister of arc a is a^1 */
+	typedef uint32_t arc_id;
+
+	static const uint32_t NONE = 0xFFFFFFFF;
+
+	/* node structure */
+	typedef struct node_st
+	{
+		arc_id			parent;		/* node's parent (or one of the special values in forwardstargraph.cpp) */
+		node_id			next;		/* next active node
+									   (or the node itself if it is the last node in the list) */
+		int				TS;			/* timestamp showing when DIST was computed */
+		int				DIST;		/* distance to the terminal */
+		int				is_sink;	/* flag showing whether the node is in the source or in the sink tree */
+
+		tcaptype		tr_cap;		/* if tr_cap > 0 then tr_cap is residual capacity of the arc SOURCE->node
+									   otherwise         -tr_cap is residual capacity of the arc node->SINK */
+	} node;
+
+	/* edge structure (before the graph is prepared) */
+	typedef struct edge_st
+	{
+		node_id			from, to;
+		captype			cap, rev_cap;
+	} edge;
+
+	node				*nodes;
+	node_id				node_num, node_max;
+
+	edge				*edges;			/* edges as they were added, freed by prepare_graph() */
+	uint32_t			edge_num, edge_max;
+
+	uint32_t			*out_first;		/* node_num+1 entries, see above */
+	uint32_t			*in_first;		/* node_num+1 entries */
+	uint32_t			*in_edge;		/* edge_num entries */
+	node_id				*ends;			/* ends[e] is the XOR of the two end nodes of edge e */
+	captype				*r_cap;			/* r_cap[a] is the residual capacity of arc a */
+
+	void	(*error_function)(const char *);	/* this function is called if a error occurs,
+										   with a corresponding error message
+										   (or exit(1) is called if it's NULL) */
+
+	flowtype			flow;		/* total flow */
+
+/***********************************************************************/
+
+	node_id				queue_first[2], queue_last[2];	/* list of active nodes */
+	node_id				*orphans;						/* FIFO of orphans */
+	node_id				orphan_first, orphan_last;
+	int					TIME;							/* monotonically increasing global counter */
+
+/***********************************************************************/
+
+	/* the node at the other end of arc a, which is traversed from node i */
+	node *head(node *i, arc_id a) { return nodes + ((node_id) (i - nodes) ^ ends[a >> 1]); }
+	node_id id(node *i) { return (node_id) (i - nodes); }
+
+	void error(const char *msg);
+	void reallocate_edges(int num);
+	void prepare_graph();
+
+	/* functions for processing active list */
+	void set_active(node *i);
+	node *next_active();
+
+	void add_orphan(node *i);
+
+	void maxflow_init();
+	void augment(node *middle_from, arc_id middle_arc);
+	void process_source_orphan(node *i);
+	void process_sink_orphan(node *i);
+};
+
+#endif
@@ -20,62 +20,294 @@ rporate the software in your program and distribute under any licence of your ch
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include "graph.h"
 
-Graph::Graph(void (*err_function)(const char *))
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#define HUGE_PAGE_SIZE ((size_t) 2 * 1024 * 1024)
+
+GraphArena::GraphArena(bool _huge_pages)
+	: huge_pages(_huge_pages)
+{
+	for (int b=0; b<3; b++)
+	{
+		buffers[b] = NULL;
+		sizes[b] = 0;
+	}
+}
+
+GraphArena::~GraphArena()
+{
+	release();
+}
+
+void GraphArena::release()
+{
+	for (int b=0; b<3; b++)
+	{
+		if (!buffers[b]) continue;
+#ifdef __linux__
+		if (huge_pages) munmap(buffers[b], sizes[b]);
+		else
+#endif
+		free(buffers[b]);
+		buffers[b] = NULL;
+		sizes[b] = 0;
+	}
+}
+
+void *GraphArena::get_buffer(int b, size_t size)
 {
-	error_function = err_function;
-	node_block = new Block<node>(NODE_BLOCK_SIZE, error_function);
-	arc_block  = new Block<arc>(NODE_BLOCK_SIZE, error_function);
+	if (size <= sizes[b]) return buffers[b];
+
+	size_t new_size = sizes[b] + sizes[b] / 2;
+	if (new_size < size) new_size = size;
+
+	void *p;
+#ifdef __linux__
+	if (huge_pages)
+	{
+		new_size = (new_size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+		if (buffers[b]) p = mremap(buffers[b], sizes[b], new_size, MREMAP_MAYMOVE);
+		else            p = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+		madvise(p, new_size, MADV_HUGEPAGE);
+#endif
+	}
+	else
+#endif
+	{
+		p = realloc(buffers[b], new_size);
+		if (!p) return NULL;
+	}
+
+	buffers[b] = p;
+	sizes[b] = new_size;
+	return p;
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	Graph<captype,tcaptype,flowtype>::Graph(int node_num_max, int edge_num_max, void (*err_function)(const char *),
+											GraphArena *_arena)
+	: node_num(0),
+	  nodeptr_block(NULL),
+	  arena(_arena),
+	  error_function(err_function)
+{
+	if (node_num_max < 16) node_num_max = 16;
+	if (edge_num_max < 16) edge_num_max = 16;
+
+	node_max = (node_id) node_num_max;
+	arc_max = 2 * (arc_id) edge_num_max;
+	arc_num = 0;
+	arc_linked = 0;
+
+	nodes = (node*) reallocate_buffer(0, NULL, node_max*sizeof(node));
+	arcs = (arc*) reallocate_buffer(1, NULL, arc_max*sizeof(arc));
+#ifdef GRAPH_SOA_CAPACITIES
+	arc_r_cap = (captype*) reallocate_buffer(2, NULL, arc_max*sizeof(captype));
+	if (!arc_r_cap) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
+#endif
+	if (!nodes || !arcs) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
+
 	flow = 0;
+	maxflow_iteration = 0;
+	changed_list = NULL;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	Graph<captype,tcaptype,flowtype>::~Graph()
+{
+	if (nodeptr_block)
+	{
+		delete nodeptr_block;
+		nodeptr_block = NULL;
+	}
+	if (arena) return; /* the arrays stay in the arena */
+	free(nodes);
+	free(arcs);
+#ifdef GRAPH_SOA_CAPACITIES
+	free(arc_r_cap);
+#endif
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void *Graph<captype,tcaptype,flowtype>::reallocate_buffer(int buffer, void *p, size_t size)
+{
+	if (arena) return arena->get_buffer(buffer, size);
+	return realloc(p, size);
 }
 
-Graph::~Graph()
+template <typename captype, typename tcaptype, typename flowtype>
+	void Graph<captype,tcaptype,flowtype>::reallocate_nodes(int num)
 {
-	delete node_block;
-	delete arc_block;
+	/* a distance to the terminal is bounded by the number of nodes and must fit into the DIST bits */
+	if ((uint64_t) node_num + num >= DIST_MASK) { if (error_function) (*error_function)("Too many nodes!"); exit(1); }
+
+	uint64_t new_max = (uint64_t) node_max + node_max / 2;
+	if (new_max < (uint64_t) node_num + num) new_max = (uint64_t) node_num + num;
+	if (new_max > DIST_MASK) new_max = DIST_MASK;
+	node_max = (node_id) new_max;
+
+	nodes = (node*) reallocate_buffer(0, nodes, node_max*sizeof(node));
+	if (!nodes) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void Graph<captype,tcaptype,flowtype>::reallocate_arcs(int num)
+{
+	/* the top three arc ids are NONE and the special values for node::parent */
+	const uint64_t max_arc_num = 0xFFFFFFFC;
+	if ((uint64_t) arc_num + num > max_arc_num) { if (error_function) (*error_function)("Too many edges!"); exit(1); }
+
+	uint64_t new_max = (uint64_t) arc_max + arc_max / 2;
+	if (new_max < (uint64_t) arc_num + num) new_max = (uint64_t) arc_num + num;
+	if (new_max > max_arc_num) new_max = max_arc_num;
+	arc_max = (arc_id) (new_max & ~(uint64_t) 1);
+
+	arcs = (arc*) reallocate_buffer(1, arcs, arc_max*sizeof(arc));
+	if (!arcs) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
+#ifdef GRAPH_SOA_CAPACITIES
+	arc_r_cap = (captype*) reallocate_buffer(2, arc_r_cap, arc_max*sizeof(captype));
+	if (!arc_r_cap) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
+#endif
 }
 
-Graph::node_id Graph::add_node()
+template <typename captype, typename tcaptype, typename flowtype>
+	typename Graph<captype,tcaptype,flowtype>::node_id Graph<captype,tcaptype,flowtype>::add_node(int num)
 {
-	node *i = node_block -> New();
+	if ((uint64_t) node_num + num > node_max) reallocate_nodes(num);
 
-	i -> first = NULL;
-	i -> tr_cap = 0;
+	node_id first = node_num;
+	for (node *i=nodes+node_num; i<nodes+node_num+num; i++)
+	{
+		i -> first = NONE;
+		i -> parent = NONE;
+		i -> next = NONE;
+		i -> TS = 0;
+		i -> flags = 0;
+		i -> tr_cap = 0;
+	}
+	node_num += num;
 
-	return (node_id) i;
+	return first;
 }
 
-void Graph::add_edge(node_id from, node_id to, captype cap, captype rev_cap)
+template <typename captype, typename tcaptype, typename flowtype>
+	void Graph<captype,tcaptype,flowtype>::add_edge(node_id from, node_id to, captype cap, captype rev_cap)
 {
-	arc *a, *a_rev;
+	if (arc_linked < arc_num) link_arcs();
+	if (arc_num + 2 > arc_max) reallocate_arcs(2);
 
-	a = arc_block -> New(2);
-	a_rev = a + 1;
+	arc_id a = arc_num, a_rev = arc_num + 1;
+	arc_num += 2;
+	arc_linked = arc_num;
 
-	a -> sister = a_rev;
-	a_rev -> sister = a;
-	a -> next = ((node*)from) -> first;
-	((node*)from) -> first = a;
-	a_rev -> next = ((node*)to) -> first;
-	((node*)to) -> first = a_rev;
-	a -> head = (node*)to;
-	a_rev -> head = (node*)from;
-	a -> r_cap = cap;
-	a_rev -> r_cap = rev_cap;
+	arcs[a].next = nodes[from].first;
+	nodes[from].first = a;
+	arcs[a_rev].next = nodes[to].first;
+	nodes[to].first = a_rev;
+	arcs[a].head = to;
+	arcs[a_rev].head = from;
+	r_cap(a) = cap;
+	r_cap(a_rev) = rev_cap;
 }
 
-void Graph::set_tweights(node_id i, captype cap_source, captype cap_sink)
+template <typename captype, typename tcaptype, typename flowtype>
+	typename Graph<captype,tcaptype,flowtype>::edge_id Graph<captype,tcaptype,flowtype>::add_edges(int num)
+{
+	if (arc_linked < arc_num) link_arcs();
+	if ((uint64_t) arc_num + 2 * (uint64_t) num > arc_max) reallocate_arcs(2 * num);
+
+	edge_id first = arc_num / 2;
+	arc_num += 2 * num;
+
+	return first;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void Graph<captype,tcaptype,flowtype>::set_edge(edge_id e, node_id from, node_id to, captype cap, captype rev_cap)
+{
+	arc_id a = 2 * e, a_rev = 2 * e + 1;
+
+	arcs[a].head = to;
+	arcs[a_rev].head = from;
+	r_cap(a) = cap;
+	r_cap(a_rev) = rev_cap;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void Graph<captype,tcaptype,flowtype>::link_arcs()
+{
+	for (arc_id a=arc_linked; a<arc_num; a++)
+	{
+		node *i = head(sister(a));
+		arcs[a].next = i -> first;
+		i -> first = a;
+	}
+	arc_linked = arc_num;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void Graph<captype,tcaptype,flowtype>::set_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink)
 {
 	flow += (cap_source < cap_sink) ? cap_source : cap_sink;
-	((node*)i) -> tr_cap = cap_source - cap_sink;
+	nodes[i].tr_cap = cap_source - cap_sink;
 }
 
-void Graph::add_tweights(node_id i, captype cap_source, captype cap_sink)
+template <typename captype, typename tcaptype, typename flowtype>
+	void Graph<captype,tcaptype,flowtype>::add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink)
 {
-	register captype delta = ((node*)i) -> tr_cap;
+	register tcaptype delta = nodes[i].tr_cap;
 	if (delta > 0) cap_source += delta;
 	else           cap_sink   -= delta;
 	flow += (cap_source < cap_sink) ? cap_source : cap_sink;
-	((node*)i) -> tr_cap = cap_source - cap_sink;
+	nodes[i].tr_cap = cap_source - cap_sink;
 }
+
+/*
+	If the flow f on arc i->j is larger than its new weight c, the flow is
+	reduced to c, so i has d = f - c more inflow than outflow and j has
+	d more outflow than inflow. Let d flow from i to the sink and from
+	the source to j, and add the t-weights (d,0) to i and (0,d) to j: the
+	new edges add d to the energy of every cut of i and of j, and they carry
+	d more flow. The flow that is reported is that of the graph without
+	them, i.e. it changes by d - 2d.
+*/
+template <typename captype, typename tcaptype, typename flowtype>
+	void Graph<captype,tcaptype,flowtype>::add_to_edge(edge_id e, captype cap, captype rev_cap)
+{
+	arc_id a = 2 * e, a_rev = 2 * e + 1;
+	node_id i = arcs[a_rev].head, j = arcs[a].head;
+	captype r = r_cap(a) + cap, r_rev = r_cap(a_rev) + rev_cap;
+
+	if (r < 0)
+	{
+		/* the flow i->j is -r more than the new weight */
+		r_rev += r;
+		flow += r;
+		add_tweights(i, (tcaptype) -r, 0);
+		add_tweights(j, 0, (tcaptype) -r);
+		r = 0;
+	}
+	else if (r_rev < 0)
+	{
+		/* the flow j->i is -r_rev more than the new weight */
+		r += r_rev;
+		flow += r_rev;
+		add_tweights(j, (tcaptype) -r_rev, 0);
+		add_tweights(i, 0, (tcaptype) -r_rev);
+		r_rev = 0;
+	}
+
+	r_cap(a) = r;
+	r_cap(a_rev) = r_rev;
+}
+
+#include "instances.inc"
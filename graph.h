@@ -45,18 +45,83 @@ rporate the software in your program and distribute under any licence of your ch
 #ifndef __GRAPH_H__
 #define __GRAPH_H__
 
+#include <stddef.h>
+#include <stdint.h>
 #include "block.h"
 
 /*
-	Nodes, arcs and pointers to nodes are
-	added in blocks for memory and time efficiency.
-	Below are numbers of items in blocks
+	Nodes and arcs are stored in two contiguous arrays and referenced
+	by 32-bit indices instead of pointers. The arrays grow by 50% when
+	they are full; the constructor takes hints for their initial size,
+	so that a graph of known size is allocated only once.
+
+	Arc 2k and arc 2k+1 are created together by add_edge() and are
+	sisters of each other, so the reverse arc of 'a' is 'a^1' and does
+	not have to be stored. With float capacities a node takes 24 bytes
+	and an arc 12 bytes (with double capacities 32 and 16 bytes).
+
+	Pointers to orphans are added in blocks. Below is the number of items in a block.
 */
-#define NODE_BLOCK_SIZE 512
-#define ARC_BLOCK_SIZE 1024
 #define NODEPTR_BLOCK_SIZE 128
 
-class Graph
+/*
+	If GRAPH_SOA_CAPACITIES is defined then the residual capacities of
+	the arcs are kept in an array of their own (structure of arrays)
+	rather than next to the head and next indices of each arc. Tree
+	growth then reads 8 bytes of topology per arc and touches the
+	capacity array only for the arcs that are actually scanned.
+*/
+//#define GRAPH_SOA_CAPACITIES
+
+/*
+	Memory for the node and arc arrays of graphs, which outlives them.
+	A graph constructed with an arena takes its arrays from the arena
+	(which grows them if they are too small) and leaves them there when
+	it is destroyed, so that the next graph built on the arena reuses
+	memory which is already allocated and paged in instead of getting
+	fresh memory from the system. An arena must not be used by two
+	graphs at the same time.
+
+	If huge_pages is true, the arrays are mapped with transparent huge
+	pages on Linux (elsewhere it is ignored).
+*/
+class GraphArena
+{
+public:
+	GraphArena(bool huge_pages = false);
+
+	/* Destructor (no graph may be using the arena any more) */
+	~GraphArena();
+
+	/* Frees the memory (no graph may be using the arena) */
+	void release();
+
+	bool get_huge_pages() { return huge_pages; }
+
+	/* Returns the number of bytes held by the arena */
+	size_t get_size() { return sizes[0] + sizes[1] + sizes[2]; }
+
+	/* Returns array 'buffer' (0, 1 or 2) grown to at least 'size' bytes
+	   (keeping its contents), or NULL if there is not enough memory */
+	void *get_buffer(int buffer, size_t size);
+
+private:
+	void	*buffers[3];
+	size_t	sizes[3];
+	bool	huge_pages;
+
+	GraphArena(const GraphArena&);
+	void operator=(const GraphArena&);
+};
+
+/*
+	Graph is templated on the type of the edge weights (captype), the type
+	of the terminal weights (tcaptype) and the type of the total flow (flowtype).
+	They can be char, short, int, float, double, ... ; flowtype should be able
+	to hold the sum of all terminal weights. The instantiations which are
+	compiled into the library are listed in instances.inc, add new ones there.
+*/
+template <typename captype, typename tcaptype, typename flowtype> class Graph
 {
 public:
 	typedef enum
@@ -65,49 +130,107 @@ public:
 		SINK	= 1
 	} termtype; /* terminals */
 
-	/* Type of edge weights.
-	   Can be changed to char, int, float, double, ... */
-	typedef double captype;
-	/* Type of total flow */
-	typedef double flowtype;
-
-	typedef void * node_id;
-  //typedef unsigned int node_id;
+	/* Nodes are numbered 0,1,2,... in the order in which they are added */
+	typedef uint32_t node_id;
 
 	/* interface functions */
 
-	/* Constructor. Optional argument is the pointer to the
+	/* Constructor.
+	   The first two arguments are estimates of the number of nodes and
+	   edges that will be added; memory is reserved for them up front,
+	   and the arrays are grown if the estimates are exceeded.
+	   Optional argument is the pointer to the
 	   function which will be called if an error occurs;
 	   an error message is passed to this function. If this
-	   argument is omitted, exit(1) will be called. */
-	Graph(void (*err_function)(const char *) = NULL);
+	   argument is omitted, exit(1) will be called.
+	   If 'arena' is not NULL, the node and arc arrays are kept in it
+	   (see GraphArena). */
+	Graph(int node_num_max = 0, int edge_num_max = 0, void (*err_function)(const char *) = NULL,
+		  GraphArena *arena = NULL);
 
 	/* Destructor */
 	~Graph();
 
-	/* Adds a node to the graph */
-	node_id add_node();
+	/* Adds 'num' nodes to the graph and returns the id of the first one.
+	   The ids of the others follow consecutively. */
+	node_id add_node(int num = 1);
+
+	/* Returns the number of nodes and of edges added so far */
+	int get_node_num() { return (int) node_num; }
+	int get_edge_num() { return (int) (arc_num / 2); }
 
 	/* Adds a bidirectional edge between 'from' and 'to'
 	   with the weights 'cap' and 'rev_cap' */
 	void add_edge(node_id from, node_id to, captype cap, captype rev_cap);
 
+	/* Edges are numbered 0,1,2,... in the order in which they are added */
+	typedef uint32_t edge_id;
+
+	/* Adds 'num' edges and returns the id of the first one. The ids of the
+	   others follow consecutively. Their ends and weights must be set by
+	   set_edge() before the next call to add_edge(), add_edges() or maxflow().
+	   set_edge() can be called for different edges from several threads at
+	   once (the edges are linked to their nodes later). */
+	edge_id add_edges(int num);
+	void set_edge(edge_id e, node_id from, node_id to, captype cap, captype rev_cap);
+
 	/* Sets the weights of the edges 'SOURCE->i' and 'i->SINK'
 	   Can be called at most once for each node before any call to 'add_tweights'.
 	   Weights can be negative */
-	void set_tweights(node_id i, captype cap_source, captype cap_sink);
+	void set_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink);
 
 	/* Adds new edges 'SOURCE->i' and 'i->SINK' with corresponding weights
 	   Can be called multiple times for each node.
 	   Weights can be negative */
-	void add_tweights(node_id i, captype cap_source, captype cap_sink);
+	void add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink);
+
+	/* Adds 'cap' and 'rev_cap' to the weights of edge 'e' (the weights can
+	   decrease, but must not become negative). Can be called after maxflow():
+	   the flow of the previous computation is kept. If it is larger than the
+	   new weight of an arc, the arc keeps as much flow as it can take and
+	   the rest is moved to the t-weights of the two nodes, which changes
+	   the energy only by a constant (Kohli and Torr, ICCV 2005). */
+	void add_to_edge(edge_id e, captype cap, captype rev_cap);
 
 	/* After the maxflow is computed, this function returns to which
 	   segment the node 'i' belongs (Graph::SOURCE or Graph::SINK) */
 	termtype what_segment(node_id i);
 
-	/* Computes the maxflow. Can be called only once. */
-	flowtype maxflow();
+	/* Computes the maxflow. Can be called several times.
+	   For a description of reuse_trees see mark_node(),
+	   for a description of changed_list see remove_from_changed_list(). */
+	flowtype maxflow(bool reuse_trees = false, Block<node_id>* changed_list = NULL);
+
+	/* If flag reuse_trees is true while calling maxflow(), then the residual
+	   flow and the search trees are reused from the previous maxflow computation
+	   (dynamic graph cuts, Kohli and Torr, ICCV 2005).
+	   In this case before calling maxflow() the user must specify which
+	   nodes have changed by calling mark_node():
+	     add_tweights(i) or set_tweights(i) => call mark_node(i)
+	     add_edge(i,j) or add_to_edge(e)    => call mark_node(i); mark_node(j)
+
+	   This option makes sense only if a small part of the graph is changed.
+	   The initialization procedure goes only through marked nodes then.
+
+	   mark_node(i) can either be called before or after graph modification.
+	   Can be called more than once per node, but calls after the first one
+	   do not have any effect.
+
+	   NOTE:
+	     - This option cannot be used in the first call to maxflow().
+	     - It is not necessary to call mark_node() if the change is "not essential",
+	       i.e. sign(tr_cap) is preserved for a node and zero/nonzero status is preserved for an arc.
+	     - To check that all necessary nodes were marked, maxflow(false) can be called after maxflow(true).
+	       If everything is correct, the two calls must return the same value of flow. */
+	void mark_node(node_id i);
+
+	/* If changed_list is not NULL while calling maxflow(), then the algorithm
+	   keeps a list of nodes which could potentially have changed their segmentation label.
+	   Nodes which are not in the list are guaranteed to keep their old segmentation label.
+	   After reading the list the user should call remove_from_changed_list(i) for every
+	   node i in it and then changed_list->Reset().
+	   changed_list can only be used together with reuse_trees. */
+	void remove_from_changed_list(node_id i) { nodes[i].flags &= ~IN_CHANGED_LIST; }
 
 /***********************************************************************/
 /***********************************************************************/
@@ -116,44 +239,62 @@ public:
 private:
 	/* internal variables and functions */
 
-	struct arc_st;
+	/* index of an arc in 'arcs' */
+	typedef uint32_t arc_id;
+
+	/* "no node" / "no arc"; also ends the list of outgoing arcs of a node */
+	static const uint32_t NONE = 0xFFFFFFFF;
+
+	/* bits of node::flags. The lower 29 bits hold DIST */
+	static const uint32_t DIST_MASK			= 0x1FFFFFFF;
+	static const uint32_t IN_CHANGED_LIST	= 0x20000000;	/* set by maxflow() if the node is added to changed_list */
+	static const uint32_t IS_MARKED			= 0x40000000;	/* set by mark_node() */
+	static const uint32_t IS_SINK			= 0x80000000;	/* the node is in the sink tree (otherwise in the source tree) */
 
 	/* node structure */
 	typedef struct node_st
 	{
-		arc_st			*first;		/* first outcoming arc */
+		arc_id			first;		/* first outcoming arc */
 
-		arc_st			*parent;	/* node's parent */
-		node_st			*next;		/* pointer to the next active node
-									   (or to itself if it is the last node in the list) */
+		arc_id			parent;		/* node's parent (or one of the special values in maxflow.cpp) */
+		node_id			next;		/* next active node
+									   (or the node itself if it is the last node in the list) */
 		int				TS;			/* timestamp showing when DIST was computed */
-		int				DIST;		/* distance to the terminal */
-		short			is_sink;	/* flag showing whether the node is in the source or in the sink tree */
+		uint32_t		flags;		/* distance to the terminal and the IS_SINK, IS_MARKED
+									   and IN_CHANGED_LIST flags */
 
-		captype			tr_cap;		/* if tr_cap > 0 then tr_cap is residual capacity of the arc SOURCE->node
+		tcaptype		tr_cap;		/* if tr_cap > 0 then tr_cap is residual capacity of the arc SOURCE->node
 									   otherwise         -tr_cap is residual capacity of the arc node->SINK */
 	} node;
 
 	/* arc structure */
 	typedef struct arc_st
 	{
-		node_st			*head;		/* node the arc points to */
-		arc_st			*next;		/* next arc with the same originating node */
-		arc_st			*sister;	/* reverse arc */
-
+		node_id			head;		/* node the arc points to */
+		arc_id			next;		/* next arc with the same originating node */
+#ifndef GRAPH_SOA_CAPACITIES
 		captype			r_cap;		/* residual capacity */
+#endif
 	} arc;
 
 	/* 'pointer to node' structure */
 	typedef struct nodeptr_st
 	{
-		node_st			*ptr;
+		node_id			ptr;
 		nodeptr_st		*next;
 	} nodeptr;
 
-	Block<node>			*node_block;
-	Block<arc>			*arc_block;
+	node				*nodes;
+	node_id				node_num, node_max;
+	arc					*arcs;
+	arc_id				arc_num, arc_max;
+	arc_id				arc_linked;		/* the arcs below it are in the lists of their nodes,
+										   the others were added by add_edges() */
+#ifdef GRAPH_SOA_CAPACITIES
+	captype				*arc_r_cap;		/* arc_r_cap[a] is the residual capacity of arc a */
+#endif
 	DBlock<nodeptr>		*nodeptr_block;
+	GraphArena			*arena;			/* holds nodes, arcs (and arc_r_cap) if it is not NULL */
 
 	void	(*error_function)(const char *);	/* this function is called if a error occurs,
 										   with a corresponding error message
@@ -163,18 +304,48 @@ private:
 
 /***********************************************************************/
 
-	node				*queue_first[2], *queue_last[2];	/* list of active nodes */
+	node_id				queue_first[2], queue_last[2];		/* list of active nodes */
 	nodeptr				*orphan_first, *orphan_last;		/* list of pointers to orphans */
 	int					TIME;								/* monotonically increasing global counter */
 
+	int					maxflow_iteration;	/* number of times maxflow() has been called */
+	Block<node_id>		*changed_list;		/* see remove_from_changed_list() */
+
 /***********************************************************************/
 
+	void reallocate_nodes(int num);
+	void reallocate_arcs(int num);
+	void *reallocate_buffer(int buffer, void *p, size_t size); /* from the arena if there is one */
+	void link_arcs();				/* add the arcs from arc_linked on to the lists of their nodes */
+
+	/* accessors for the arc fields and the packed node flags */
+	static arc_id sister(arc_id a) { return a ^ 1; }
+#ifdef GRAPH_SOA_CAPACITIES
+	captype& r_cap(arc_id a) { return arc_r_cap[a]; }
+#else
+	captype& r_cap(arc_id a) { return arcs[a].r_cap; }
+#endif
+	node *head(arc_id a) { return nodes + arcs[a].head; }
+	node_id id(node *i) { return (node_id) (i - nodes); }
+
+	static int get_dist(node *i) { return (int) (i->flags & DIST_MASK); }
+	static void set_dist(node *i, int d) { i->flags = (i->flags & ~DIST_MASK) | (uint32_t) d; }
+	static bool is_sink(node *i) { return (i->flags & IS_SINK) != 0; }
+	static void set_sink(node *i, bool sink) { if (sink) i->flags |= IS_SINK; else i->flags &= ~IS_SINK; }
+
 	/* functions for processing active list */
 	void set_active(node *i);
 	node *next_active();
 
-	void maxflow_init();
-	void augment(arc *middle_arc);
+	/* functions for processing orphans list */
+	void set_orphan_front(node *i); /* add to the beginning of the list */
+	void set_orphan_rear(node *i);  /* add to the end of the list */
+
+	void add_to_changed_list(node *i);
+
+	void maxflow_init();             /* called if reuse_trees == false */
+	void maxflow_reuse_trees_init(); /* called if reuse_trees == true */
+	void augment(arc_id middle_arc);
 	void process_source_orphan(node *i);
 	void process_sink_orphan(node *i);
 };
@@ -0,0 +1,610 @@
+/* gridgraph.cpp */
+/*
+	Grid-specialized version of the maxflow algorithm in maxflow.cpp.
+	The algorithm is identical; only the graph representation differs
+	(see gridgraph.h).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gridgraph.h"
+
+/*
+	special constants for parent[i]
+*/
+#define TERMINAL	8		/* to terminal */
+#define ORPHAN		9		/* orphan */
+#define NO_PARENT	10		/* node is free */
+
+#define INFINITE_D 1000000000		/* infinite distance to the terminal */
+
+#define OPPOSITE(d) (((d) + 4) & 7)
+
+static const int DX[8] = { 1, 1, 0, -1, -1, -1,  0,  1 };
+static const int DY[8] = { 0, 1, 1,  1,  0, -1, -1, -1 };
+
+/***********************************************************************/
+
+template <class T> static T *allocate(int num, void (*error_function)(const char *))
+{
+	T *p = (T *) malloc(num*sizeof(T));
+	if (!p) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
+	return p;
+}
+
+GridGraph::GridGraph(int _width, int _height, void (*err_function)(const char *))
+	: width(_width), height(_height), node_num(_width*_height)
+{
+	int d;
+
+	error_function = err_function;
+
+	for (d=0; d<8; d++) offset[d] = DY[d]*width + DX[d];
+
+	r_cap[0] = allocate<captype>(8*node_num, error_function);
+	memset(r_cap[0], 0, 8*node_num*sizeof(captype));
+	for (d=1; d<8; d++) r_cap[d] = r_cap[0] + d*node_num;
+
+	tr_cap  = allocate<captype>(node_num, error_function);
+	memset(tr_cap, 0, node_num*sizeof(captype));
+
+	next    = allocate<node_id>(node_num, error_function);
+	TS      = allocate<int>(node_num, error_function);
+	DIST    = allocate<int>(node_num, error_function);
+	parent  = allocate<unsigned char>(node_num, error_function);
+	is_sink = allocate<unsigned char>(node_num, error_function);
+
+	flow = 0;
+}
+
+GridGraph::~GridGraph()
+{
+	free(r_cap[0]);
+	free(tr_cap);
+	free(next);
+	free(TS);
+	free(DIST);
+	free(parent);
+	free(is_sink);
+}
+
+GridGraph::direction GridGraph::offset_to_direction(int dx, int dy)
+{
+	int d;
+
+	for (d=0; d<8; d++)
+	{
+		if (DX[d] == dx && DY[d] == dy) break;
+	}
+	return (direction) d;
+}
+
+void GridGraph::add_edge(int x, int y, direction d, captype cap, captype rev_cap)
+{
+	int nx = x + DX[d], ny = y + DY[d];
+
+	if (x < 0 || x >= width || y < 0 || y >= height ||
+	    nx < 0 || nx >= width || ny < 0 || ny >= height)
+	{
+		if (error_function) (*error_function)("Edge leaves the grid!");
+		exit(1);
+	}
+
+	node_id i = node(x, y);
+	r_cap[d][i] += cap;
+	r_cap[OPPOSITE(d)][i + offset[d]] += rev_cap;
+}
+
+void GridGraph::set_tweights(node_id i, captype cap_source, captype cap_sink)
+{
+	flow += (cap_source < cap_sink) ? cap_source : cap_sink;
+	tr_cap[i] = cap_source - cap_sink;
+}
+
+void GridGraph::add_tweights(node_id i, captype cap_source, captype cap_sink)
+{
+	captype delta = tr_cap[i];
+	if (delta > 0) cap_source += delta;
+	else           cap_sink   -= delta;
+	flow += (cap_source < cap_sink) ? cap_source : cap_sink;
+	tr_cap[i] = cap_source - cap_sink;
+}
+
+/***********************************************************************/
+
+inline unsigned char GridGraph::neighbor_mask(region &r, node_id i)
+{
+	int x = i % width, y = i / width;
+	unsigned char mask = 0xFF;
+
+	if (x == r.x0)   mask &= ~((1<<LEFT)  | (1<<TOP_LEFT)    | (1<<BOTTOM_LEFT));
+	if (x == r.x1-1) mask &= ~((1<<RIGHT) | (1<<TOP_RIGHT)   | (1<<BOTTOM_RIGHT));
+	if (y == r.y0)   mask &= ~((1<<TOP)   | (1<<TOP_LEFT)    | (1<<TOP_RIGHT));
+	if (y == r.y1-1) mask &= ~((1<<BOTTOM)| (1<<BOTTOM_LEFT) | (1<<BOTTOM_RIGHT));
+
+	return mask;
+}
+
+/*
+	Functions for processing active list.
+	next[i] is the next node in the list
+	(or i, if i is the last node in the list).
+	next[i] is -1 iff i is not in the list.
+
+	See maxflow.cpp for a description of the two queues.
+*/
+
+inline void GridGraph::set_active(region &r, node_id i)
+{
+	if (next[i] < 0)
+	{
+		/* it's not in the list yet */
+		if (r.queue_last[1] >= 0) next[r.queue_last[1]] = i;
+		else                      r.queue_first[1]      = i;
+		r.queue_last[1] = i;
+		next[i] = i;
+	}
+}
+
+/*
+	Returns the next active node (or -1 if there are none).
+	If it is connected to the sink, it stays in the list,
+	otherwise it is removed from the list
+*/
+inline GridGraph::node_id GridGraph::next_active(region &r)
+{
+	node_id i;
+
+	while ( 1 )
+	{
+		if ((i=r.queue_first[0]) < 0)
+		{
+			r.queue_first[0] = i = r.queue_first[1];
+			r.queue_last[0]  = r.queue_last[1];
+			r.queue_first[1] = -1;
+			r.queue_last[1]  = -1;
+			if (i < 0) return -1;
+		}
+
+		/* remove it from the active list */
+		if (next[i] == i) r.queue_first[0] = r.queue_last[0] = -1;
+		else              r.queue_first[0] = next[i];
+		next[i] = -1;
+
+		/* a node in the list is active iff it has a parent */
+		if (parent[i] != NO_PARENT) return i;
+	}
+}
+
+/*
+	A node is never in the orphan list twice, so a ring buffer
+	with one entry more than the region has nodes is sufficient
+*/
+inline void GridGraph::add_orphan(region &r, node_id i)
+{
+	parent[i] = ORPHAN;
+	r.orphans[r.orphan_last] = i;
+	if (++r.orphan_last == r.orphan_size) r.orphan_last = 0;
+}
+
+/***********************************************************************/
+
+void GridGraph::maxflow_init(region &r)
+{
+	node_id i;
+	int x, y;
+
+	r.queue_first[0] = r.queue_last[0] = -1;
+	r.queue_first[1] = r.queue_last[1] = -1;
+	r.orphan_first = r.orphan_last = 0;
+
+	for (y=r.y0; y<r.y1; y++)
+	for (x=r.x0; x<r.x1; x++)
+	{
+		i = node(x, y);
+		next[i] = -1;
+		TS[i] = 0;
+		if (tr_cap[i] > 0)
+		{
+			/* i is connected to the source */
+			is_sink[i] = 0;
+			parent[i] = TERMINAL;
+			set_active(r, i);
+			DIST[i] = 1;
+		}
+		else if (tr_cap[i] < 0)
+		{
+			/* i is connected to the sink */
+			is_sink[i] = 1;
+			parent[i] = TERMINAL;
+			set_active(r, i);
+			DIST[i] = 1;
+		}
+		else
+		{
+			is_sink[i] = 0;
+			parent[i] = NO_PARENT;
+		}
+	}
+	r.TIME = 0;
+}
+
+/***********************************************************************/
+
+/*
+	The middle arc goes from node 'middle_from' (in the source tree)
+	in direction 'middle_dir' to a node in the sink tree
+*/
+void GridGraph::augment(region &r, node_id middle_from, int middle_dir)
+{
+	node_id i, p;
+	int d;
+	captype bottleneck;
+	node_id middle_to = middle_from + offset[middle_dir];
+
+	/* 1. Finding bottleneck capacity */
+	/* 1a - the source tree */
+	bottleneck = r_cap[middle_dir][middle_from];
+	for (i=middle_from; ; i=p)
+	{
+		d = parent[i];
+		if (d == TERMINAL) break;
+		p = i + offset[d];
+		if (bottleneck > r_cap[OPPOSITE(d)][p]) bottleneck = r_cap[OPPOSITE(d)][p];
+	}
+	if (bottleneck > tr_cap[i]) bottleneck = tr_cap[i];
+	/* 1b - the sink tree */
+	for (i=middle_to; ; i=p)
+	{
+		d = parent[i];
+		if (d == TERMINAL) break;
+		p = i + offset[d];
+		if (bottleneck > r_cap[d][i]) bottleneck = r_cap[d][i];
+	}
+	if (bottleneck > - tr_cap[i]) bottleneck = - tr_cap[i];
+
+
+	/* 2. Augmenting */
+	/* 2a - the source tree */
+	r_cap[OPPOSITE(middle_dir)][middle_to] += bottleneck;
+	r_cap[middle_dir][middle_from] -= bottleneck;
+	for (i=middle_from; ; i=p)
+	{
+		d = parent[i];
+		if (d == TERMINAL) break;
+		p = i + offset[d];
+		r_cap[d][i] += bottleneck;
+		r_cap[OPPOSITE(d)][p] -= bottleneck;
+		if (!r_cap[OPPOSITE(d)][p])
+		{
+			/* add i to the adoption list */
+			add_orphan(r, i);
+		}
+	}
+	tr_cap[i] -= bottleneck;
+	if (!tr_cap[i])
+	{
+		/* add i to the adoption list */
+		add_orphan(r, i);
+	}
+	/* 2b - the sink tree */
+	for (i=middle_to; ; i=p)
+	{
+		d = parent[i];
+		if (d == TERMINAL) break;
+		p = i + offset[d];
+		r_cap[OPPOSITE(d)][p] += bottleneck;
+		r_cap[d][i] -= bottleneck;
+		if (!r_cap[d][i])
+		{
+			/* add i to the adoption list */
+			add_orphan(r, i);
+		}
+	}
+	tr_cap[i] += bottleneck;
+	if (!tr_cap[i])
+	{
+		/* add i to the adoption list */
+		add_orphan(r, i);
+	}
+
+
+	r.flow += bottleneck;
+}
+
+/***********************************************************************/
+
+void GridGraph::process_source_orphan(region &r, node_id i)
+{
+	node_id j;
+	int a, d0, d0_min = NO_PARENT;
+	int d, d_min = INFINITE_D;
+	unsigned char mask = neighbor_mask(r, i);
+
+	/* trying to find a new parent */
+	for (d0=0; d0<8; d0++)
+	if ((mask & (1<<d0)) && r_cap[OPPOSITE(d0)][i + offset[d0]])
+	{
+		j = i + offset[d0];
+		if (!is_sink[j] && (a=parent[j]) != NO_PARENT)
+		{
+			/* checking the origin of j */
+			d = 0;
+			while ( 1 )
+			{
+				if (TS[j] == r.TIME)
+				{
+					d += DIST[j];
+					break;
+				}
+				a = parent[j];
+				d ++;
+				if (a==TERMINAL)
+				{
+					TS[j] = r.TIME;
+					DIST[j] = 1;
+					break;
+				}
+				if (a==ORPHAN) { d = INFINITE_D; break; }
+				j += offset[a];
+			}
+			if (d<INFINITE_D) /* j originates from the source - done */
+			{
+				if (d<d_min)
+				{
+					d0_min = d0;
+					d_min = d;
+				}
+				/* set marks along the path */
+				for (j=i+offset[d0]; TS[j]!=r.TIME; j+=offset[parent[j]])
+				{
+					TS[j] = r.TIME;
+					DIST[j] = d --;
+				}
+			}
+		}
+	}
+
+	if ((parent[i] = d0_min) != NO_PARENT)
+	{
+		TS[i] = r.TIME;
+		DIST[i] = d_min + 1;
+	}
+	else
+	{
+		/* no parent is found */
+		TS[i] = 0;
+
+		/* process neighbors */
+		for (d0=0; d0<8; d0++)
+		if (mask & (1<<d0))
+		{
+			j = i + offset[d0];
+			if (!is_sink[j] && (a=parent[j]) != NO_PARENT)
+			{
+				if (r_cap[OPPOSITE(d0)][j]) set_active(r, j);
+				if (a == OPPOSITE(d0))
+				{
+					/* add j to the adoption list */
+					add_orphan(r, j);
+				}
+			}
+		}
+	}
+}
+
+void GridGraph::process_sink_orphan(region &r, node_id i)
+{
+	node_id j;
+	int a, d0, d0_min = NO_PARENT;
+	int d, d_min = INFINITE_D;
+	unsigned char mask = neighbor_mask(r, i);
+
+	/* trying to find a new parent */
+	for (d0=0; d0<8; d0++)
+	if ((mask & (1<<d0)) && r_cap[d0][i])
+	{
+		j = i + offset[d0];
+		if (is_sink[j] && (a=parent[j]) != NO_PARENT)
+		{
+			/* checking the origin of j */
+			d = 0;
+			while ( 1 )
+			{
+				if (TS[j] == r.TIME)
+				{
+					d += DIST[j];
+					break;
+				}
+				a = parent[j];
+				d ++;
+				if (a==TERMINAL)
+				{
+					TS[j] = r.TIME;
+					DIST[j] = 1;
+					break;
+				}
+				if (a==ORPHAN) { d = INFINITE_D; break; }
+				j += offset[a];
+			}
+			if (d<INFINITE_D) /* j originates from the sink - done */
+			{
+				if (d<d_min)
+				{
+					d0_min = d0;
+					d_min = d;
+				}
+				/* set marks along the path */
+				for (j=i+offset[d0]; TS[j]!=r.TIME; j+=offset[parent[j]])
+				{
+					TS[j] = r.TIME;
+					DIST[j] = d --;
+				}
+			}
+		}
+	}
+
+	if ((parent[i] = d0_min) != NO_PARENT)
+	{
+		TS[i] = r.TIME;
+		DIST[i] = d_min + 1;
+	}
+	else
+	{
+		/* no parent is found */
+		TS[i] = 0;
+
+		/* process neighbors */
+		for (d0=0; d0<8; d0++)
+		if (mask & (1<<d0))
+		{
+			j = i + offset[d0];
+			if (is_sink[j] && (a=parent[j]) != NO_PARENT)
+			{
+				if (r_cap[d0][i]) set_active(r, j);
+				if (a == OPPOSITE(d0))
+				{
+					/* add j to the adoption list */
+					add_orphan(r, j);
+				}
+			}
+		}
+	}
+}
+
+/***********************************************************************/
+
+GridGraph::flowtype GridGraph::maxflow()
+{
+	flow += maxflow_region(0, 0, width, height);
+	return flow;
+}
+
+GridGraph::flowtype GridGraph::maxflow_region(int x0, int y0, int x1, int y1)
+{
+	node_id i, j, current_node = -1;
+	node_id middle_from;
+	int d, middle_dir = 0;
+	unsigned char mask;
+	region r;
+
+	if (x0 < 0 || y0 < 0 || x1 > width || y1 > height || x0 >= x1 || y0 >= y1)
+	{
+		if (error_function) (*error_function)("Invalid region!");
+		exit(1);
+	}
+
+	r.x0 = x0; r.y0 = y0;
+	r.x1 = x1; r.y1 = y1;
+	r.orphan_size = (x1-x0)*(y1-y0) + 1;
+	r.orphans = allocate<node_id>(r.orphan_size, error_function);
+	r.flow = 0;
+
+	maxflow_init(r);
+
+	while ( 1 )
+	{
+		if ((i=current_node) >= 0)
+		{
+			next[i] = -1; /* remove active flag */
+			if (parent[i] == NO_PARENT) i = -1;
+		}
+		if (i < 0)
+		{
+			if ((i = next_active(r)) < 0) break;
+		}
+
+		middle_from = -1;
+		mask = neighbor_mask(r, i);
+
+		/* growth */
+		if (!is_sink[i])
+		{
+			/* grow source tree */
+			for (d=0; d<8; d++)
+			if ((mask & (1<<d)) && r_cap[d][i])
+			{
+				j = i + offset[d];
+				if (parent[j] == NO_PARENT)
+				{
+					is_sink[j] = 0;
+					parent[j] = OPPOSITE(d);
+					TS[j] = TS[i];
+					DIST[j] = DIST[i] + 1;
+					set_active(r, j);
+				}
+				else if (is_sink[j]) { middle_from = i; middle_dir = d; break; }
+				else if (TS[j] <= TS[i] &&
+				         DIST[j] > DIST[i])
+				{
+					/* heuristic - trying to make the distance from j to the source shorter */
+					parent[j] = OPPOSITE(d);
+					TS[j] = TS[i];
+					DIST[j] = DIST[i] + 1;
+				}
+			}
+		}
+		else
+		{
+			/* grow sink tree */
+			for (d=0; d<8; d++)
+			if ((mask & (1<<d)) && r_cap[OPPOSITE(d)][i + offset[d]])
+			{
+				j = i + offset[d];
+				if (parent[j] == NO_PARENT)
+				{
+					is_sink[j] = 1;
+					parent[j] = OPPOSITE(d);
+					TS[j] = TS[i];
+					DIST[j] = DIST[i] + 1;
+					set_active(r, j);
+				}
+				else if (!is_sink[j]) { middle_from = j; middle_dir = OPPOSITE(d); break; }
+				else if (TS[j] <= TS[i] &&
+				         DIST[j] > DIST[i])
+				{
+					/* heuristic - trying to make the distance from j to the sink shorter */
+					parent[j] = OPPOSITE(d);
+					TS[j] = TS[i];
+					DIST[j] = DIST[i] + 1;
+				}
+			}
+		}
+
+		r.TIME ++;
+
+		if (middle_from >= 0)
+		{
+			next[i] = i; /* set active flag */
+			current_node = i;
+
+			/* augmentation */
+			augment(r, middle_from, middle_dir);
+			/* augmentation end */
+
+			/* adoption */
+			while (r.orphan_first != r.orphan_last)
+			{
+				j = r.orphans[r.orphan_first];
+				if (++r.orphan_first == r.orphan_size) r.orphan_first = 0;
+				if (is_sink[j]) process_sink_orphan(r, j);
+				else            process_source_orphan(r, j);
+			}
+			/* adoption end */
+		}
+		else current_node = -1;
+	}
+
+	free(r.orphans);
+
+	return r.flow;
+}
+
+/***********************************************************************/
+
+GridGraph::termtype GridGraph::what_segment(node_id i)
+{
+	if (parent[i] != NO_PARENT && !is_sink[i]) return SOURCE;
+	return SINK;
+}
@@ -0,0 +1,171 @@
+/* gridgraph.h */
+/*
+	A variant of the Boykov-Kolmogorov maxflow algorithm (see graph.h)
+	specialized for regular 2D grids with 8-connectivity.
+
+	Node ids are implicit: the node of pixel (x,y) is y*width + x,
+	so no per-node handles have to be stored by the caller. Arcs are
+	not allocated individually either. The residual capacity of the
+	arc from node i to its neighbour in direction d is stored in the
+	flat array r_cap[d][i], and the reverse (sister) arc is found in
+	r_cap[(d+4)%8][neighbour]. A node therefore needs about 50 bytes
+	in total, compared to ~32 bytes per node plus ~16 bytes per arc
+	for the general Graph.
+
+	The interface mirrors Graph: add_edge, set_tweights, add_tweights,
+	maxflow and what_segment have the same semantics.
+*/
+
+#ifndef __GRIDGRAPH_H__
+#define __GRIDGRAPH_H__
+
+#include <stdlib.h>
+
+class GridGraph
+{
+public:
+	typedef enum
+	{
+		SOURCE	= 0,
+		SINK	= 1
+	} termtype; /* terminals */
+
+	/* Neighbour directions. Direction d and direction (d+4)%8 are opposite */
+	typedef enum
+	{
+		RIGHT			= 0,
+		BOTTOM_RIGHT	= 1,
+		BOTTOM			= 2,
+		BOTTOM_LEFT		= 3,
+		LEFT			= 4,
+		TOP_LEFT		= 5,
+		TOP				= 6,
+		TOP_RIGHT		= 7
+	} direction;
+
+	/* Type of edge weights */
+	typedef float captype;
+	/* Type of total flow */
+	typedef double flowtype;
+
+	typedef int node_id;
+
+	/* interface functions */
+
+	/* Constructor. Allocates width*height nodes with no edges.
+	   Optional argument is the pointer to the function which
+	   will be called if an error occurs; an error message is passed
+	   to this function. If this argument is omitted, exit(1) will be called. */
+	GridGraph(int width, int height, void (*err_function)(const char *) = NULL);
+
+	/* Destructor */
+	~GridGraph();
+
+	int get_width() { return width; }
+	int get_height() { return height; }
+
+	/* Returns the id of the node of pixel (x,y) */
+	node_id node(int x, int y) { return y*width + x; }
+
+	/* Returns the direction of the neighbour at offset (dx,dy),
+	   where dx and dy are -1, 0 or 1 and not both 0 */
+	static direction offset_to_direction(int dx, int dy);
+
+	/* Adds a bidirectional edge between the node of pixel (x,y) and
+	   its neighbour in direction 'd' with the weights 'cap' and 'rev_cap' */
+	void add_edge(int x, int y, direction d, captype cap, captype rev_cap);
+
+	/* Sets the weights of the edges 'SOURCE->i' and 'i->SINK'
+	   Can be called at most once for each node before any call to 'add_tweights'.
+	   Weights can be negative */
+	void set_tweights(node_id i, captype cap_source, captype cap_sink);
+
+	/* Adds new edges 'SOURCE->i' and 'i->SINK' with corresponding weights
+	   Can be called multiple times for each node.
+	   Weights can be negative */
+	void add_tweights(node_id i, captype cap_source, captype cap_sink);
+
+	/* After the maxflow is computed, this function returns to which
+	   segment the node 'i' belongs (GridGraph::SOURCE or GridGraph::SINK) */
+	termtype what_segment(node_id i);
+
+	/* Computes the maxflow of the whole grid, starting from the flow
+	   of previous calls to maxflow_region() (if any). */
+	flowtype maxflow();
+
+	/* Computes the maxflow in the subgraph of the nodes (x,y) with
+	   x0 <= x < x1 and y0 <= y < y1; edges which leave the rectangle
+	   are treated as if they were not there. Returns the flow that was
+	   pushed, which is not included in the value returned by maxflow().
+
+	   The flow stays in the residual capacities, so it is a valid flow
+	   of the whole graph. A later call on a rectangle that contains
+	   this one (or maxflow()) continues from it and only has to find
+	   the flow across the edges that were ignored; the final result
+	   is the exact maxflow. The segmentation (what_segment) is only
+	   meaningful for the rectangle of the last call.
+
+	   Calls on disjoint rectangles touch disjoint data, so they may
+	   run concurrently in different threads. */
+	flowtype maxflow_region(int x0, int y0, int x1, int y1);
+
+/***********************************************************************/
+/***********************************************************************/
+/***********************************************************************/
+
+private:
+	/* internal variables and functions */
+
+	int					width, height;
+	int					node_num;
+	int					offset[8];		/* node id difference to the neighbour in each direction */
+
+	captype				*r_cap[8];		/* r_cap[d][i] is the residual capacity of the arc
+										   from node i to its neighbour in direction d */
+	captype				*tr_cap;		/* if tr_cap[i] > 0 then tr_cap[i] is residual capacity of the arc SOURCE->i
+										   otherwise         -tr_cap[i] is residual capacity of the arc i->SINK */
+	node_id				*next;			/* next active node (or the node itself if it is the last node
+										   in the list), -1 if the node is not in the list */
+	int					*TS;			/* timestamp showing when DIST was computed */
+	int					*DIST;			/* distance to the terminal */
+	unsigned char		*parent;		/* direction of the arc to the node's parent
+										   (or one of the special values in gridgraph.cpp) */
+	unsigned char		*is_sink;		/* flag showing whether the node is in the source or in the sink tree */
+
+	void	(*error_function)(const char *);	/* this function is called if a error occurs,
+										   with a corresponding error message
+										   (or exit(1) is called if it's NULL) */
+
+	flowtype			flow;		/* total flow */
+
+/***********************************************************************/
+
+	/* state of one run of the algorithm on a rectangle of the grid */
+	struct region
+	{
+		int				x0, y0, x1, y1;					/* the rectangle (see maxflow_region()) */
+		node_id			queue_first[2], queue_last[2];	/* list of active nodes */
+		node_id			*orphans;						/* FIFO of orphans */
+		int				orphan_size, orphan_first, orphan_last;
+		int				TIME;							/* monotonically increasing counter */
+		flowtype		flow;							/* flow pushed in the rectangle */
+	};
+
+/***********************************************************************/
+
+	/* returns a bit mask of the directions in which node i has a neighbour inside the region */
+	unsigned char neighbor_mask(region &r, node_id i);
+
+	/* functions for processing active list */
+	void set_active(region &r, node_id i);
+	node_id next_active(region &r);
+
+	void add_orphan(region &r, node_id i);
+
+	void maxflow_init(region &r);
+	void augment(region &r, node_id middle_from, int middle_dir);
+	void process_source_orphan(region &r, node_id i);
+	void process_sink_orphan(region &r, node_id i);
+};
+
+#endif
@@ -23,9 +23,10 @@ rporate the software in your program and distribute under any licence of your ch
 
 /*
 	special constants for node->parent
+	(NONE means that the node has no parent)
 */
-#define TERMINAL ( (arc *) 1 )		/* to terminal */
-#define ORPHAN   ( (arc *) 2 )		/* orphan */
+#define TERMINAL ( (arc_id) 0xFFFFFFFE )		/* to terminal */
+#define ORPHAN   ( (arc_id) 0xFFFFFFFD )		/* orphan */
 
 #define INFINITE_D 1000000000		/* infinite distance to the terminal */
 
@@ -33,9 +34,9 @@ rporate the software in your program and distribute under any licence of your ch
 
 /*
 	Functions for processing active list.
-	i->next points to the next node in the list
-	(or to i, if i is the last node in the list).
-	If i->next is NULL iff i is not in the list.
+	i->next is the id of the next node in the list
+	(or the id of i, if i is the last node in the list).
+	i->next is NONE iff i is not in the list.
 
 	There are two queues. Active nodes are added
 	to the end of the second queue and read from
@@ -44,15 +45,16 @@ rporate the software in your program and distribute under any licence of your ch
 	(and the second queue becomes empty).
 */
 
-inline void Graph::set_active(node *i)
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void Graph<captype,tcaptype,flowtype>::set_active(node *i)
 {
-	if (!i->next)
+	if (i->next == NONE)
 	{
 		/* it's not in the list yet */
-		if (queue_last[1]) queue_last[1] -> next = i;
-		else               queue_first[1]        = i;
-		queue_last[1] = i;
-		i -> next = i;
+		if (queue_last[1] != NONE) nodes[queue_last[1]].next = id(i);
+		else                       queue_first[1]            = id(i);
+		queue_last[1] = id(i);
+		i -> next = id(i);
 	}
 }
 
@@ -61,157 +63,288 @@ inline void Graph::set_active(node *i)
 	If it is connected to the sink, it stays in the list,
 	otherwise it is removed from the list
 */
-inline Graph::node * Graph::next_active()
+template <typename captype, typename tcaptype, typename flowtype>
+	inline typename Graph<captype,tcaptype,flowtype>::node * Graph<captype,tcaptype,flowtype>::next_active()
 {
 	node *i;
 
 	while ( 1 )
 	{
-		if (!(i=queue_first[0]))
+		if (queue_first[0] == NONE)
 		{
-			queue_first[0] = i = queue_first[1];
+			queue_first[0] = queue_first[1];
 			queue_last[0]  = queue_last[1];
-			queue_first[1] = NULL;
-			queue_last[1]  = NULL;
-			if (!i) return NULL;
+			queue_first[1] = NONE;
+			queue_last[1]  = NONE;
+			if (queue_first[0] == NONE) return NULL;
 		}
+		i = nodes + queue_first[0];
 
 		/* remove it from the active list */
-		if (i->next == i) queue_first[0] = queue_last[0] = NULL;
-		else              queue_first[0] = i -> next;
-		i -> next = NULL;
+		if (i->next == id(i)) queue_first[0] = queue_last[0] = NONE;
+		else                  queue_first[0] = i -> next;
+		i -> next = NONE;
 
 		/* a node in the list is active iff it has a parent */
-		if (i->parent) return i;
+		if (i->parent != NONE) return i;
 	}
 }
 
 /***********************************************************************/
 
-void Graph::maxflow_init()
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void Graph<captype,tcaptype,flowtype>::set_orphan_front(node *i)
+{
+	nodeptr *np;
+	i -> parent = ORPHAN;
+	np = nodeptr_block -> New();
+	np -> ptr = id(i);
+	np -> next = orphan_first;
+	orphan_first = np;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void Graph<captype,tcaptype,flowtype>::set_orphan_rear(node *i)
+{
+	nodeptr *np;
+	i -> parent = ORPHAN;
+	np = nodeptr_block -> New();
+	np -> ptr = id(i);
+	if (orphan_last) orphan_last -> next = np;
+	else             orphan_first        = np;
+	orphan_last = np;
+	np -> next = NULL;
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void Graph<captype,tcaptype,flowtype>::add_to_changed_list(node *i)
+{
+	if (changed_list && !(i->flags & IN_CHANGED_LIST))
+	{
+		node_id* ptr = changed_list -> New();
+		*ptr = id(i);
+		i -> flags |= IN_CHANGED_LIST;
+	}
+}
+
+/*
+	Marked nodes are kept in the second active queue,
+	which is always empty between calls to maxflow()
+*/
+template <typename captype, typename tcaptype, typename flowtype>
+	void Graph<captype,tcaptype,flowtype>::mark_node(node_id _i)
+{
+	node *i = nodes + _i;
+
+	if (i->next == NONE)
+	{
+		/* it's not in the list yet */
+		if (queue_last[1] != NONE) nodes[queue_last[1]].next = _i;
+		else                       queue_first[1]            = _i;
+		queue_last[1] = _i;
+		i -> next = _i;
+	}
+	i -> flags |= IS_MARKED;
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void Graph<captype,tcaptype,flowtype>::maxflow_init()
 {
 	node *i;
 
-	queue_first[0] = queue_last[0] = NULL;
-	queue_first[1] = queue_last[1] = NULL;
+	queue_first[0] = queue_last[0] = NONE;
+	queue_first[1] = queue_last[1] = NONE;
 	orphan_first = NULL;
 
-	for (i=node_block->ScanFirst(); i; i=node_block->ScanNext())
+	for (i=nodes; i<nodes+node_num; i++)
 	{
-		i -> next = NULL;
+		i -> next = NONE;
+		i -> flags = 0;
 		i -> TS = 0;
 		if (i->tr_cap > 0)
 		{
 			/* i is connected to the source */
-			i -> is_sink = 0;
+			set_sink(i, false);
 			i -> parent = TERMINAL;
 			set_active(i);
 			i -> TS = 0;
-			i -> DIST = 1;
+			set_dist(i, 1);
 		}
 		else if (i->tr_cap < 0)
 		{
 			/* i is connected to the sink */
-			i -> is_sink = 1;
+			set_sink(i, true);
 			i -> parent = TERMINAL;
 			set_active(i);
 			i -> TS = 0;
-			i -> DIST = 1;
+			set_dist(i, 1);
 		}
 		else
 		{
-			i -> parent = NULL;
+			i -> parent = NONE;
 		}
 	}
 	TIME = 0;
 }
 
+template <typename captype, typename tcaptype, typename flowtype>
+	void Graph<captype,tcaptype,flowtype>::maxflow_reuse_trees_init()
+{
+	node *i, *j;
+	node_id queue = queue_first[1];
+	arc_id a;
+	nodeptr *np;
+
+	queue_first[0] = queue_last[0] = NONE;
+	queue_first[1] = queue_last[1] = NONE;
+	orphan_first = orphan_last = NULL;
+
+	TIME ++;
+
+	/* the marked nodes are in 'queue' (see mark_node()) */
+	while (queue != NONE)
+	{
+		i = nodes + queue;
+		queue = i -> next;
+		if (queue == id(i)) queue = NONE;
+		i -> next = NONE;
+		i -> flags &= ~IS_MARKED;
+		set_active(i);
+
+		if (i->tr_cap == 0)
+		{
+			if (i->parent != NONE) set_orphan_rear(i);
+			continue;
+		}
+
+		if (i->tr_cap > 0)
+		{
+			if (i->parent == NONE || is_sink(i))
+			{
+				/* i moves to the source tree */
+				set_sink(i, false);
+				for (a=i->first; a!=NONE; a=arcs[a].next)
+				{
+					j = head(a);
+					if (!(j->flags & IS_MARKED))
+					{
+						if (j->parent == sister(a)) set_orphan_rear(j);
+						if (j->parent != NONE && is_sink(j) && r_cap(a) > 0) set_active(j);
+					}
+				}
+				add_to_changed_list(i);
+			}
+		}
+		else
+		{
+			if (i->parent == NONE || !is_sink(i))
+			{
+				/* i moves to the sink tree */
+				set_sink(i, true);
+				for (a=i->first; a!=NONE; a=arcs[a].next)
+				{
+					j = head(a);
+					if (!(j->flags & IS_MARKED))
+					{
+						if (j->parent == sister(a)) set_orphan_rear(j);
+						if (j->parent != NONE && !is_sink(j) && r_cap(sister(a)) > 0) set_active(j);
+					}
+				}
+				add_to_changed_list(i);
+			}
+		}
+		i -> parent = TERMINAL;
+		i -> TS = TIME;
+		set_dist(i, 1);
+	}
+
+	/* adoption */
+	while ((np=orphan_first))
+	{
+		orphan_first = np -> next;
+		i = nodes + np -> ptr;
+		nodeptr_block -> Delete(np);
+		if (!orphan_first) orphan_last = NULL;
+		if (is_sink(i)) process_sink_orphan(i);
+		else            process_source_orphan(i);
+	}
+	/* adoption end */
+}
+
 /***********************************************************************/
 
-void Graph::augment(arc *middle_arc)
+template <typename captype, typename tcaptype, typename flowtype>
+	void Graph<captype,tcaptype,flowtype>::augment(arc_id middle_arc)
 {
 	node *i;
-	arc *a;
+	arc_id a;
 	captype bottleneck;
-	nodeptr *np;
 
 
 	/* 1. Finding bottleneck capacity */
 	/* 1a - the source tree */
-	bottleneck = middle_arc -> r_cap;
-	for (i=middle_arc->sister->head; ; i=a->head)
+	bottleneck = r_cap(middle_arc);
+	for (i=head(sister(middle_arc)); ; i=head(a))
 	{
 		a = i -> parent;
 		if (a == TERMINAL) break;
-		if (bottleneck > a->sister->r_cap) bottleneck = a -> sister -> r_cap;
+		if (bottleneck > r_cap(sister(a))) bottleneck = r_cap(sister(a));
 	}
 	if (bottleneck > i->tr_cap) bottleneck = i -> tr_cap;
 	/* 1b - the sink tree */
-	for (i=middle_arc->head; ; i=a->head)
+	for (i=head(middle_arc); ; i=head(a))
 	{
 		a = i -> parent;
 		if (a == TERMINAL) break;
-		if (bottleneck > a->r_cap) bottleneck = a -> r_cap;
+		if (bottleneck > r_cap(a)) bottleneck = r_cap(a);
 	}
 	if (bottleneck > - i->tr_cap) bottleneck = - i -> tr_cap;
 
 
 	/* 2. Augmenting */
 	/* 2a - the source tree */
-	middle_arc -> sister -> r_cap += bottleneck;
-	middle_arc -> r_cap -= bottleneck;
-	for (i=middle_arc->sister->head; ; i=a->head)
+	r_cap(sister(middle_arc)) += bottleneck;
+	r_cap(middle_arc) -= bottleneck;
+	for (i=head(sister(middle_arc)); ; i=head(a))
 	{
 		a = i -> parent;
 		if (a == TERMINAL) break;
-		a -> r_cap += bottleneck;
-		a -> sister -> r_cap -= bottleneck;
-		if (!a->sister->r_cap)
+		r_cap(a) += bottleneck;
+		r_cap(sister(a)) -= bottleneck;
+		if (!r_cap(sister(a)))
 		{
 			/* add i to the adoption list */
-			i -> parent = ORPHAN;
-			np = nodeptr_block -> New();
-			np -> ptr = i;
-			np -> next = orphan_first;
-			orphan_first = np;
+			set_orphan_front(i);
 		}
 	}
 	i -> tr_cap -= bottleneck;
 	if (!i->tr_cap)
 	{
 		/* add i to the adoption list */
-		i -> parent = ORPHAN;
-		np = nodeptr_block -> New();
-		np -> ptr = i;
-		np -> next = orphan_first;
-		orphan_first = np;
+		set_orphan_front(i);
 	}
 	/* 2b - the sink tree */
-	for (i=middle_arc->head; ; i=a->head)
+	for (i=head(middle_arc); ; i=head(a))
 	{
 		a = i -> parent;
 		if (a == TERMINAL) break;
-		a -> sister -> r_cap += bottleneck;
-		a -> r_cap -= bottleneck;
-		if (!a->r_cap)
+		r_cap(sister(a)) += bottleneck;
+		r_cap(a) -= bottleneck;
+		if (!r_cap(a))
 		{
 			/* add i to the adoption list */
-			i -> parent = ORPHAN;
-			np = nodeptr_block -> New();
-			np -> ptr = i;
-			np -> next = orphan_first;
-			orphan_first = np;
+			set_orphan_front(i);
 		}
 	}
 	i -> tr_cap += bottleneck;
 	if (!i->tr_cap)
 	{
 		/* add i to the adoption list */
-		i -> parent = ORPHAN;
-		np = nodeptr_block -> New();
-		np -> ptr = i;
-		np -> next = orphan_first;
-		orphan_first = np;
+		set_orphan_front(i);
 	}
 
 
@@ -220,19 +353,19 @@ void Graph::augment(arc *middle_arc)
 
 /***********************************************************************/
 
-void Graph::process_source_orphan(node *i)
+template <typename captype, typename tcaptype, typename flowtype>
+	void Graph<captype,tcaptype,flowtype>::process_source_orphan(node *i)
 {
 	node *j;
-	arc *a0, *a0_min = NULL, *a;
-	nodeptr *np;
+	arc_id a0, a0_min = NONE, a;
 	int d, d_min = INFINITE_D;
 
 	/* trying to find a new parent */
-	for (a0=i->first; a0; a0=a0->next)
-	if (a0->sister->r_cap)
+	for (a0=i->first; a0!=NONE; a0=arcs[a0].next)
+	if (r_cap(sister(a0)))
 	{
-		j = a0 -> head;
-		if (!j->is_sink && (a=j->parent))
+		j = head(a0);
+		if (!is_sink(j) && (a=j->parent) != NONE)
 		{
 			/* checking the origin of j */
 			d = 0;
@@ -240,7 +373,7 @@ void Graph::process_source_orphan(node *i)
 			{
 				if (j->TS == TIME)
 				{
-					d += j -> DIST;
+					d += get_dist(j);
 					break;
 				}
 				a = j -> parent;
@@ -248,11 +381,11 @@ void Graph::process_source_orphan(node *i)
 				if (a==TERMINAL)
 				{
 					j -> TS = TIME;
-					j -> DIST = 1;
+					set_dist(j, 1);
 					break;
 				}
 				if (a==ORPHAN) { d = INFINITE_D; break; }
-				j = a -> head;
+				j = head(a);
 			}
 			if (d<INFINITE_D) /* j originates from the source - done */
 			{
@@ -262,61 +395,56 @@ void Graph::process_source_orphan(node *i)
 					d_min = d;
 				}
 				/* set marks along the path */
-				for (j=a0->head; j->TS!=TIME; j=j->parent->head)
+				for (j=head(a0); j->TS!=TIME; j=head(j->parent))
 				{
 					j -> TS = TIME;
-					j -> DIST = d --;
+					set_dist(j, d --);
 				}
 			}
 		}
 	}
 
-	if ((i->parent = a0_min))
+	if ((i->parent = a0_min) != NONE)
 	{
 		i -> TS = TIME;
-		i -> DIST = d_min + 1;
+		set_dist(i, d_min + 1);
 	}
 	else
 	{
 		/* no parent is found */
+		add_to_changed_list(i);
 		i -> TS = 0;
 
 		/* process neighbors */
-		for (a0=i->first; a0; a0=a0->next)
+		for (a0=i->first; a0!=NONE; a0=arcs[a0].next)
 		{
-			j = a0 -> head;
-			if (!j->is_sink && (a=j->parent))
+			j = head(a0);
+			if (!is_sink(j) && (a=j->parent) != NONE)
 			{
-				if (a0->sister->r_cap) set_active(j);
-				if (a!=TERMINAL && a!=ORPHAN && a->head==i)
+				if (r_cap(sister(a0))) set_active(j);
+				if (a!=TERMINAL && a!=ORPHAN && head(a)==i)
 				{
 					/* add j to the adoption list */
-					j -> parent = ORPHAN;
-					np = nodeptr_block -> New();
-					np -> ptr = j;
-					if (orphan_last) orphan_last -> next = np;
-					else             orphan_first        = np;
-					orphan_last = np;
-					np -> next = NULL;
+					set_orphan_rear(j);
 				}
 			}
 		}
 	}
 }
 
-void Graph::process_sink_orphan(node *i)
+template <typename captype, typename tcaptype, typename flowtype>
+	void Graph<captype,tcaptype,flowtype>::process_sink_orphan(node *i)
 {
 	node *j;
-	arc *a0, *a0_min = NULL, *a;
-	nodeptr *np;
+	arc_id a0, a0_min = NONE, a;
 	int d, d_min = INFINITE_D;
 
 	/* trying to find a new parent */
-	for (a0=i->first; a0; a0=a0->next)
-	if (a0->r_cap)
+	for (a0=i->first; a0!=NONE; a0=arcs[a0].next)
+	if (r_cap(a0))
 	{
-		j = a0 -> head;
-		if (j->is_sink && (a=j->parent))
+		j = head(a0);
+		if (is_sink(j) && (a=j->parent) != NONE)
 		{
 			/* checking the origin of j */
 			d = 0;
@@ -324,7 +452,7 @@ void Graph::process_sink_orphan(node *i)
 			{
 				if (j->TS == TIME)
 				{
-					d += j -> DIST;
+					d += get_dist(j);
 					break;
 				}
 				a = j -> parent;
@@ -332,11 +460,11 @@ void Graph::process_sink_orphan(node *i)
 				if (a==TERMINAL)
 				{
 					j -> TS = TIME;
-					j -> DIST = 1;
+					set_dist(j, 1);
 					break;
 				}
 				if (a==ORPHAN) { d = INFINITE_D; break; }
-				j = a -> head;
+				j = head(a);
 			}
 			if (d<INFINITE_D) /* j originates from the sink - done */
 			{
@@ -346,42 +474,37 @@ void Graph::process_sink_orphan(node *i)
 					d_min = d;
 				}
 				/* set marks along the path */
-				for (j=a0->head; j->TS!=TIME; j=j->parent->head)
+				for (j=head(a0); j->TS!=TIME; j=head(j->parent))
 				{
 					j -> TS = TIME;
-					j -> DIST = d --;
+					set_dist(j, d --);
 				}
 			}
 		}
 	}
 
-	if ((i->parent = a0_min))
+	if ((i->parent = a0_min) != NONE)
 	{
 		i -> TS = TIME;
-		i -> DIST = d_min + 1;
+		set_dist(i, d_min + 1);
 	}
 	else
 	{
 		/* no parent is found */
+		add_to_changed_list(i);
 		i -> TS = 0;
 
 		/* process neighbors */
-		for (a0=i->first; a0; a0=a0->next)
+		for (a0=i->first; a0!=NONE; a0=arcs[a0].next)
 		{
-			j = a0 -> head;
-			if (j->is_sink && (a=j->parent))
+			j = head(a0);
+			if (is_sink(j) && (a=j->parent) != NONE)
 			{
-				if (a0->r_cap) set_active(j);
-				if (a!=TERMINAL && a!=ORPHAN && a->head==i)
+				if (r_cap(a0)) set_active(j);
+				if (a!=TERMINAL && a!=ORPHAN && head(a)==i)
 				{
 					/* add j to the adoption list */
-					j -> parent = ORPHAN;
-					np = nodeptr_block -> New();
-					np -> ptr = j;
-					if (orphan_last) orphan_last -> next = np;
-					else             orphan_first        = np;
-					orphan_last = np;
-					np -> next = NULL;
+					set_orphan_rear(j);
 				}
 			}
 		}
@@ -390,21 +513,33 @@ void Graph::process_sink_orphan(node *i)
 
 /***********************************************************************/
 
-Graph::flowtype Graph::maxflow()
+template <typename captype, typename tcaptype, typename flowtype>
+	flowtype Graph<captype,tcaptype,flowtype>::maxflow(bool reuse_trees, Block<node_id>* _changed_list)
 {
 	node *i, *j, *current_node = NULL;
-	arc *a;
+	arc_id a;
 	nodeptr *np, *np_next;
 
-	maxflow_init();
-	nodeptr_block = new DBlock<nodeptr>(NODEPTR_BLOCK_SIZE, error_function);
+	if (!nodeptr_block)
+	{
+		nodeptr_block = new DBlock<nodeptr>(NODEPTR_BLOCK_SIZE, error_function);
+	}
+
+	if (arc_linked < arc_num) link_arcs();
+
+	changed_list = _changed_list;
+	if (maxflow_iteration == 0 && reuse_trees) { if (error_function) (*error_function)("reuse_trees cannot be used in the first call to maxflow()!"); exit(1); }
+	if (changed_list && !reuse_trees) { if (error_function) (*error_function)("changed_list cannot be used without reuse_trees!"); exit(1); }
+
+	if (reuse_trees) maxflow_reuse_trees_init();
+	else             maxflow_init();
 
 	while ( 1 )
 	{
 		if ((i=current_node))
 		{
-			i -> next = NULL; /* remove active flag */
-			if (!i->parent) i = NULL;
+			i -> next = NONE; /* remove active flag */
+			if (i->parent == NONE) i = NULL;
 		}
 		if (!i)
 		{
@@ -412,64 +547,66 @@ Graph::flowtype Graph::maxflow()
 		}
 
 		/* growth */
-		if (!i->is_sink)
+		if (!is_sink(i))
 		{
 			/* grow source tree */
-			for (a=i->first; a; a=a->next)
-			if (a->r_cap)
+			for (a=i->first; a!=NONE; a=arcs[a].next)
+			if (r_cap(a))
 			{
-				j = a -> head;
-				if (!j->parent)
+				j = head(a);
+				if (j->parent == NONE)
 				{
-					j -> is_sink = 0;
-					j -> parent = a -> sister;
+					set_sink(j, false);
+					j -> parent = sister(a);
 					j -> TS = i -> TS;
-					j -> DIST = i -> DIST + 1;
+					set_dist(j, get_dist(i) + 1);
 					set_active(j);
+					add_to_changed_list(j);
 				}
-				else if (j->is_sink) break;
+				else if (is_sink(j)) break;
 				else if (j->TS <= i->TS &&
-				         j->DIST > i->DIST)
+				         get_dist(j) > get_dist(i))
 				{
 					/* heuristic - trying to make the distance from j to the source shorter */
-					j -> parent = a -> sister;
+					j -> parent = sister(a);
 					j -> TS = i -> TS;
-					j -> DIST = i -> DIST + 1;
+					set_dist(j, get_dist(i) + 1);
 				}
 			}
 		}
 		else
 		{
 			/* grow sink tree */
-			for (a=i->first; a; a=a->next)
-			if (a->sister->r_cap)
+			for (a=i->first; a!=NONE; a=arcs[a].next)
+			if (r_cap(sister(a)))
 			{
-				j = a -> head;
-				if (!j->parent)
+				j = head(a);
+				if (j->parent == NONE)
 				{
-					j -> is_sink = 1;
-					j -> parent = a -> sister;
+					set_sink(j, true);
+					j -> parent = sister(a);
 					j -> TS = i -> TS;
-					j -> DIST = i -> DIST + 1;
+					set_dist(j, get_dist(i) + 1);
 					set_active(j);
+					add_to_changed_list(j);
 				}
-				else if (!j->is_sink) { a = a -> sister; break; }
+				else if (!is_sink(j)) { a = sister(a); break; }
 				else if (j->TS <= i->TS &&
-				         j->DIST > i->DIST)
+				         get_dist(j) > get_dist(i))
 				{
 					/* heuristic - trying to make the distance from j to the sink shorter */
-					j -> parent = a -> sister;
+					j -> parent = sister(a);
 					j -> TS = i -> TS;
-					j -> DIST = i -> DIST + 1;
+					set_dist(j, get_dist(i) + 1);
 				}
 			}
 		}
 
 		TIME ++;
 
-		if (a)
+		if (a != NONE)
 		{
-			i -> next = i; /* set active flag */
+			i -> next = id(i); /* set active flag */
 			current_node = i;
 
 			/* augmentation */
@@ -485,10 +622,10 @@ Graph::flowtype Graph::maxflow()
 				while ((np=orphan_first))
 				{
 					orphan_first = np -> next;
-					i = np -> ptr;
+					i = nodes + np -> ptr;
 					nodeptr_block -> Delete(np);
 					if (!orphan_first) orphan_last = NULL;
-					if (i->is_sink) process_sink_orphan(i);
+					if (is_sink(i)) process_sink_orphan(i);
 					else            process_source_orphan(i);
 				}
 
@@ -499,16 +636,23 @@ Graph::flowtype Graph::maxflow()
 		else current_node = NULL;
 	}
 
-	delete nodeptr_block;
+	if (!reuse_trees || (maxflow_iteration % 64) == 0)
+	{
+		delete nodeptr_block;
+		nodeptr_block = NULL;
+	}
 
+	maxflow_iteration ++;
 	return flow;
 }
 
 /***********************************************************************/
 
-Graph::termtype Graph::what_segment(node_id i)
+template <typename captype, typename tcaptype, typename flowtype>
+	typename Graph<captype,tcaptype,flowtype>::termtype Graph<captype,tcaptype,flowtype>::what_segment(node_id i)
 {
-	if (((node*)i)->parent && !((node*)i)->is_sink) return SOURCE;
+	if (nodes[i].parent != NONE && !is_sink(nodes + i)) return SOURCE;
 	return SINK;
 }
 
+#include "instances.inc"
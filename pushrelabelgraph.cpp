@@ -0,0 +1,448 @@
+/* pushrelabelgraph.cpp */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "pushrelabelgraph.h"
+
+/*
+	Arcs leaving node i are numbered out_first[i] ... ARC_END(i)-1:
+	first the arcs of the edges added from i, then the reverse arcs
+	of the edges added to i (see forwardstargraph.cpp).
+	ARC(i, k) is the arc with number k; node->current is such a number.
+*/
+#define ARC_END(i) (out_first[id(i)+1] + (in_first[id(i)+1] - in_first[id(i)]))
+#define ARC(i, k) ((k < out_first[id(i)+1]) ? (k << 1) : ((in_edge[in_first[id(i)] + k - out_first[id(i)+1]] << 1) | 1))
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	PushRelabelGraph<captype,tcaptype,flowtype>::PushRelabelGraph(int node_num_max, int edge_num_max, void (*err_function)(const char *))
+	: node_num(0), edge_num(0),
+	  out_first(NULL), in_first(NULL), in_edge(NULL), ends(NULL), r_cap(NULL),
+	  error_function(err_function),
+	  bfs_queue(NULL)
+{
+	if (node_num_max < 16) node_num_max = 16;
+	if (edge_num_max < 16) edge_num_max = 16;
+
+	node_max = (node_id) node_num_max;
+	edge_max = (uint32_t) edge_num_max;
+
+	nodes = (node*) malloc(node_max*sizeof(node));
+	edges = (edge*) malloc(edge_max*sizeof(edge));
+	if (!nodes || !edges) error("Not enough memory!");
+
+	flow = 0;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	PushRelabelGraph<captype,tcaptype,flowtype>::~PushRelabelGraph()
+{
+	free(nodes);
+	free(edges);
+	free(out_first);
+	free(in_first);
+	free(in_edge);
+	free(ends);
+	free(r_cap);
+	free(bfs_queue);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::error(const char *msg)
+{
+	if (error_function) (*error_function)(msg);
+	exit(1);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	typename PushRelabelGraph<captype,tcaptype,flowtype>::node_id PushRelabelGraph<captype,tcaptype,flowtype>::add_node(int num)
+{
+	if (!edges) error("Nodes cannot be added after maxflow()!");
+	if ((uint64_t) node_num + num > node_max)
+	{
+		uint64_t new_max = (uint64_t) node_max + node_max / 2;
+		if (new_max < (uint64_t) node_num + num) new_max = (uint64_t) node_num + num;
+		if (new_max >= NONE / 2) error("Too many nodes!");
+		node_max = (node_id) new_max;
+		nodes = (node*) realloc(nodes, node_max*sizeof(node));
+		if (!nodes) error("Not enough memory!");
+	}
+
+	node_id first = node_num;
+	for (node *i=nodes+node_num; i<nodes+node_num+num; i++)
+	{
+		i -> next = NONE;
+		i -> tr_cap = 0;
+		i -> excess = 0;
+	}
+	node_num += num;
+
+	return first;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::reallocate_edges(int num)
+{
+	uint64_t new_max = (uint64_t) edge_max + edge_max / 2;
+	if (new_max < (uint64_t) edge_num + num) new_max = (uint64_t) edge_num + num;
+	/* arc ids 2*e+1 must fit in arc_id */
+	if (new_max > 0x7FFFFFFE) new_max = 0x7FFFFFFE;
+	if (new_max < (uint64_t) edge_num + num) error("Too many edges!");
+	edge_max = (uint32_t) new_max;
+	edges = (edge*) realloc(edges, edge_max*sizeof(edge));
+	if (!edges) error("Not enough memory!");
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::add_edge(node_id from, node_id to, captype cap, captype rev_cap)
+{
+	if (!edges) error("Edges cannot be added after maxflow()!");
+	if (edge_num == edge_max) reallocate_edges(1);
+
+	set_edge(edge_num ++, from, to, cap, rev_cap);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	typename PushRelabelGraph<captype,tcaptype,flowtype>::edge_id PushRelabelGraph<captype,tcaptype,flowtype>::add_edges(int num)
+{
+	if (!edges) error("Edges cannot be added after maxflow()!");
+	if ((uint64_t) edge_num + num > edge_max) reallocate_edges(num);
+
+	edge_id first = edge_num;
+	edge_num += num;
+
+	return first;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::set_edge(edge_id e, node_id from, node_id to, captype cap, captype rev_cap)
+{
+	edge *ed = edges + e;
+	ed -> from = from;
+	ed -> to = to;
+	ed -> cap = cap;
+	ed -> rev_cap = rev_cap;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::set_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink)
+{
+	flow += (cap_source < cap_sink) ? cap_source : cap_sink;
+	nodes[i].tr_cap = cap_source - cap_sink;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink)
+{
+	tcaptype delta = nodes[i].tr_cap;
+	if (delta > 0) cap_source += delta;
+	else           cap_sink   -= delta;
+	flow += (cap_source < cap_sink) ? cap_source : cap_sink;
+	nodes[i].tr_cap = cap_source - cap_sink;
+}
+
+/***********************************************************************/
+
+/*
+	Sorts the edges by their first node (counting sort) and builds
+	the lists of the incoming edges of every node
+*/
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::prepare_graph()
+{
+	node_id i;
+	uint32_t e, k;
+
+	out_first = (uint32_t*) malloc((node_num+1)*sizeof(uint32_t));
+	in_first  = (uint32_t*) malloc((node_num+1)*sizeof(uint32_t));
+	in_edge   = (uint32_t*) malloc(edge_num*sizeof(uint32_t) + 1);
+	ends      = (node_id*) malloc(edge_num*sizeof(node_id) + 1);
+	r_cap     = (captype*) malloc(2*edge_num*sizeof(captype) + 1);
+	bfs_queue = (node_id*) malloc(node_num*sizeof(node_id) + 1);
+	if (!out_first || !in_first || !in_edge || !ends || !r_cap || !bfs_queue) error("Not enough memory!");
+
+	/* count the outgoing and incoming edges of every node */
+	for (i=0; i<=node_num; i++) out_first[i] = in_first[i] = 0;
+	for (e=0; e<edge_num; e++)
+	{
+		out_first[edges[e].from + 1] ++;
+		in_first[edges[e].to + 1] ++;
+	}
+	for (i=0; i<node_num; i++)
+	{
+		out_first[i+1] += out_first[i];
+		in_first[i+1] += in_first[i];
+	}
+
+	/* place the edges; out_first[i] and in_first[i] are used as insertion positions
+	   and are shifted back by one node afterwards */
+	for (e=0; e<edge_num; e++)
+	{
+		edge *ed = edges + e;
+		k = out_first[ed->from] ++;
+		ends[k] = ed->from ^ ed->to;
+		r_cap[2*k] = ed->cap;
+		r_cap[2*k+1] = ed->rev_cap;
+		in_edge[in_first[ed->to] ++] = k;
+	}
+	for (i=node_num; i>0; i--)
+	{
+		out_first[i] = out_first[i-1];
+		in_first[i] = in_first[i-1];
+	}
+	out_first[0] = in_first[0] = 0;
+
+	free(edges);
+	edges = NULL;
+}
+
+/***********************************************************************/
+
+/*
+	Functions for processing active list (a FIFO).
+	i->next is NONE iff i is not in the list.
+*/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void PushRelabelGraph<captype,tcaptype,flowtype>::set_active(node *i)
+{
+	if (i->next == NONE)
+	{
+		/* it's not in the list yet */
+		if (queue_last != NONE) nodes[queue_last].next = id(i);
+		else                    queue_first            = id(i);
+		queue_last = id(i);
+		i -> next = id(i);
+	}
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline typename PushRelabelGraph<captype,tcaptype,flowtype>::node * PushRelabelGraph<captype,tcaptype,flowtype>::next_active()
+{
+	node *i;
+
+	if (queue_first == NONE) return NULL;
+	i = nodes + queue_first;
+
+	/* remove it from the active list */
+	if (i->next == id(i)) queue_first = queue_last = NONE;
+	else                  queue_first = i -> next;
+	i -> next = NONE;
+
+	return i;
+}
+
+/***********************************************************************/
+
+/*
+	Sets the distance labels to the exact distances to the sink in the
+	residual graph (breadth-first search along reversed residual arcs)
+	and makes active all nodes with excess that can reach the sink
+*/
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::global_relabel()
+{
+	node *i, *j;
+	arc_id a;
+	uint32_t k;
+	node_id d_inf = node_num + 1;
+	node_id *bfs_first = bfs_queue, *bfs_last = bfs_queue;
+
+	for (i=nodes; i<nodes+node_num; i++)
+	{
+		if (i->tr_cap > 0)
+		{
+			i -> d = 1;
+			*bfs_last ++ = id(i);
+		}
+		else i -> d = d_inf;
+	}
+
+	while (bfs_first < bfs_last)
+	{
+		j = nodes + *bfs_first ++;
+		for (k=out_first[id(j)]; k<ARC_END(j); k++)
+		{
+			a = ARC(j, k);
+			i = head(j, a);
+			if (i->d == d_inf && r_cap[a^1])
+			{
+				i -> d = j -> d + 1;
+				*bfs_last ++ = id(i);
+			}
+		}
+	}
+
+	for (i=nodes; i<nodes+node_num; i++)
+	{
+		i -> current = out_first[id(i)];
+		if (i->excess > 0 && i->d < d_inf) set_active(i);
+	}
+
+	relabel_count = 0;
+}
+
+/***********************************************************************/
+
+/*
+	Pushes the excess of node i along admissible arcs
+	and relabels it until the excess is zero or i cannot
+	reach the sink any more
+*/
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::discharge(node *i)
+{
+	node *j;
+	arc_id a;
+	uint32_t k, k_end = ARC_END(i);
+	node_id d_inf = node_num + 1, d_min;
+	captype delta;
+
+	while (i->excess > 0)
+	{
+		/* push to the sink */
+		if (i->tr_cap > 0)
+		{
+			delta = (i->excess < i->tr_cap) ? (tcaptype) i->excess : i->tr_cap;
+			i -> tr_cap -= delta;
+			i -> excess -= delta;
+			flow += delta;
+			continue;
+		}
+
+		/* push along admissible arcs */
+		for (k=i->current; k<k_end; k++)
+		{
+			a = ARC(i, k);
+			if (!r_cap[a]) continue;
+			j = head(i, a);
+			if (j->d + 1 != i->d) continue;
+
+			delta = (i->excess < r_cap[a]) ? (captype) i->excess : r_cap[a];
+			r_cap[a] -= delta;
+			r_cap[a^1] += delta;
+			i -> excess -= delta;
+			j -> excess += delta;
+			set_active(j);
+			if (!i->excess) break;
+		}
+		i -> current = k;
+		if (k < k_end) break;
+
+		/* relabel */
+		d_min = d_inf;
+		for (k=out_first[id(i)]; k<k_end; k++)
+		{
+			a = ARC(i, k);
+			if (r_cap[a] && head(i, a)->d + 1 < d_min) d_min = head(i, a)->d + 1;
+		}
+		i -> d = d_min;
+		i -> current = out_first[id(i)];
+		relabel_count ++;
+		if (i->d == d_inf) break;
+	}
+}
+
+/***********************************************************************/
+
+/*
+	Marks the source set of the minimum cut with the fewest source nodes,
+	which is the cut that Graph and GridGraph return: the nodes that can be
+	reached in the residual graph from a node with excess (the arcs from the
+	source are all saturated, and the excess would flow back to the source
+	in the second phase of the algorithm). Every arc leaving this set is
+	saturated, so its capacity is the maxflow.
+	The marked nodes get d = node_num+1, all others d = 0.
+*/
+template <typename captype, typename tcaptype, typename flowtype>
+	void PushRelabelGraph<captype,tcaptype,flowtype>::find_source_set()
+{
+	node *i, *j;
+	arc_id a;
+	uint32_t k;
+	node_id d_inf = node_num + 1;
+	node_id *bfs_first = bfs_queue, *bfs_last = bfs_queue;
+
+	for (i=nodes; i<nodes+node_num; i++)
+	{
+		if (i->excess > 0)
+		{
+			i -> d = d_inf;
+			*bfs_last ++ = id(i);
+		}
+		else i -> d = 0;
+	}
+
+	while (bfs_first < bfs_last)
+	{
+		i = nodes + *bfs_first ++;
+		for (k=out_first[id(i)]; k<ARC_END(i); k++)
+		{
+			a = ARC(i, k);
+			j = head(i, a);
+			if (j->d != d_inf && r_cap[a])
+			{
+				j -> d = d_inf;
+				*bfs_last ++ = id(j);
+			}
+		}
+	}
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	flowtype PushRelabelGraph<captype,tcaptype,flowtype>::maxflow()
+{
+	node *i;
+
+	if (!edges) error("maxflow() can be called only once!");
+	prepare_graph();
+
+	/* saturate the arcs from the source */
+	for (i=nodes; i<nodes+node_num; i++)
+	{
+		i -> next = NONE;
+		if (i->tr_cap > 0)
+		{
+			i -> excess = i -> tr_cap;
+			i -> tr_cap = 0;
+		}
+		else
+		{
+			i -> excess = 0;
+			i -> tr_cap = - i -> tr_cap;
+		}
+	}
+	queue_first = queue_last = NONE;
+
+	global_relabel();
+
+	while ((i=next_active()))
+	{
+		if (i->d > node_num) continue;
+		discharge(i);
+		if (relabel_count >= node_num) global_relabel();
+	}
+
+	/* the labels are now used for what_segment() */
+	find_source_set();
+
+	return flow;
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	typename PushRelabelGraph<captype,tcaptype,flowtype>::termtype PushRelabelGraph<captype,tcaptype,flowtype>::what_segment(node_id i)
+{
+	if (nodes[i].d > node_num) return SOURCE;
+	return SINK;
+}
+
+/***********************************************************************/
+
+/* Instantiations: <captype, tcaptype, flowtype> (see instances.inc) */
+template class PushRelabelGraph<float,float,double>;
+template class PushRelabelGraph<int,int,long long>;
@@ -0,0 +1,161 @@
+/* pushrelabelgraph.h */
+/*
+	Maxflow with the FIFO push-relabel algorithm
+	(A. V. Goldberg and R. E. Tarjan. "A new approach to the maximum-flow
+	problem", JACM 35(4), 1988) with the global relabeling heuristic
+	(B. V. Cherkassky and A. V. Goldberg. "On implementing push-relabel
+	method for the maximum flow problem", Algorithmica 19, 1997).
+
+	Only the first phase of the algorithm is run: it computes a maximum
+	preflow, which gives the maxflow value and a minimum cut. The flow
+	itself is not needed for segmentation, so excess that cannot reach
+	the sink is not returned to the source.
+
+	The graph representation is that of forwardstargraph.h and the
+	interface is that of Graph, except that maxflow() can be called only
+	once. Like Graph, what_segment() returns SOURCE only for the nodes
+	that are on the source side of every minimum cut (the nodes that the
+	source reaches in the residual graph) and SINK for all others, so
+	nodes with no preference (e.g. without any edges) are in the SINK set.
+*/
+
+#ifndef __PUSHRELABELGRAPH_H__
+#define __PUSHRELABELGRAPH_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+template <typename captype, typename tcaptype, typename flowtype> class PushRelabelGraph
+{
+public:
+	typedef enum
+	{
+		SOURCE	= 0,
+		SINK	= 1
+	} termtype; /* terminals */
+
+	/* Nodes are numbered 0,1,2,... in the order in which they are added */
+	typedef uint32_t node_id;
+
+	/* interface functions */
+
+	/* Constructor. See forwardstargraph.h */
+	PushRelabelGraph(int node_num_max = 0, int edge_num_max = 0, void (*err_function)(const char *) = NULL);
+
+	/* Destructor */
+	~PushRelabelGraph();
+
+	/* Adds 'num' nodes to the graph and returns the id of the first one.
+	   Can only be called before maxflow(). */
+	node_id add_node(int num = 1);
+
+	/* Adds a bidirectional edge between 'from' and 'to'
+	   with the weights 'cap' and 'rev_cap'.
+	   Can only be called before maxflow(). */
+	void add_edge(node_id from, node_id to, captype cap, captype rev_cap);
+
+	/* Edges are numbered 0,1,2,... in the order in which they are added */
+	typedef uint32_t edge_id;
+
+	/* Adds 'num' edges and returns the id of the first one. The ids of the
+	   others follow consecutively. Their ends and weights must be set by
+	   set_edge() before maxflow(); set_edge() can be called for different
+	   edges from several threads at once.
+	   Can only be called before maxflow(). */
+	edge_id add_edges(int num);
+	void set_edge(edge_id e, node_id from, node_id to, captype cap, captype rev_cap);
+
+	/* Sets the weights of the edges 'SOURCE->i' and 'i->SINK'
+	   Can be called at most once for each node before any call to 'add_tweights'.
+	   Weights can be negative */
+	void set_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink);
+
+	/* Adds new edges 'SOURCE->i' and 'i->SINK' with corresponding weights
+	   Can be called multiple times for each node.
+	   Weights can be negative */
+	void add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink);
+
+	/* After the maxflow is computed, this function returns to which
+	   segment the node 'i' belongs (SOURCE or SINK) */
+	termtype what_segment(node_id i);
+
+	/* Computes the maxflow. Can be called only once. */
+	flowtype maxflow();
+
+/***********************************************************************/
+/***********************************************************************/
+/***********************************************************************/
+
+private:
+	/* internal variables and functions */
+
+	/* An arc is 2*e for the arc of edge e in the direction in which the
+	   edge was added and 2*e+1 for the reverse arc; the sister of arc a is a^1 */
+	typedef uint32_t arc_id;
+
+	static const uint32_t NONE = 0xFFFFFFFF;
+
+	/* node structure */
+	typedef struct node_st
+	{
+		node_id			next;		/* next active node
+									   (or the node itself if it is the last node in the list) */
+		uint32_t		current;	/* current arc (an index as in FOR_ALL_ARCS) */
+		node_id			d;			/* distance label; node_num+1 if the sink cannot be reached.
+									   After maxflow(): node_num+1 for the SOURCE set, 0 otherwise */
+
+		tcaptype		tr_cap;		/* before maxflow(): as in Graph;
+									   after: residual capacity of the arc node->SINK */
+		flowtype		excess;
+	} node;
+
+	/* edge structure (before the graph is prepared) */
+	typedef struct edge_st
+	{
+		node_id			from, to;
+		captype			cap, rev_cap;
+	} edge;
+
+	node				*nodes;
+	node_id				node_num, node_max;
+
+	edge				*edges;			/* edges as they were added, freed by prepare_graph() */
+	uint32_t			edge_num, edge_max;
+
+	uint32_t			*out_first;		/* node_num+1 entries, see forwardstargraph.h */
+	uint32_t			*in_first;		/* node_num+1 entries */
+	uint32_t			*in_edge;		/* edge_num entries */
+	node_id				*ends;			/* ends[e] is the XOR of the two end nodes of edge e */
+	captype				*r_cap;			/* r_cap[a] is the residual capacity of arc a */
+
+	void	(*error_function)(const char *);	/* this function is called if a error occurs,
+										   with a corresponding error message
+										   (or exit(1) is called if it's NULL) */
+
+	flowtype			flow;		/* total flow */
+
+/***********************************************************************/
+
+	node_id				queue_first, queue_last;	/* FIFO of active nodes */
+	node_id				*bfs_queue;					/* node_num entries, for global_relabel() */
+	uint32_t			relabel_count;				/* relabels since the last global_relabel() */
+
+/***********************************************************************/
+
+	/* the node at the other end of arc a, which is traversed from node i */
+	node *head(node *i, arc_id a) { return nodes + ((node_id) (i - nodes) ^ ends[a >> 1]); }
+	node_id id(node *i) { return (node_id) (i - nodes); }
+
+	void error(const char *msg);
+	void reallocate_edges(int num);
+	void prepare_graph();
+
+	void set_active(node *i);
+	node *next_active();
+
+	void global_relabel();
+	void discharge(node *i);
+	void find_source_set();
+};
+
+#endif